@@ -9,10 +9,19 @@
 #include <QCheckBox>
 #include <QListWidget>
 #include <QHeaderView>
+#include <QKeySequence>
 #include <QPlainTextEdit>
+#include <QProgressDialog>
 #include <QRegularExpression>
 #include <QStringList>
-#include <random>
+#include <QTimer>
+#include <sstream>
+#include <unordered_set>
+#include "logic/pipeline.h"
+#include "logic/memory.h"
+#include "logic/merge.h"
+#include "logic/docwriter.h"
+#include "logic/duplicates.h"
 
 MainWindow::MainWindow(std::shared_ptr<QuestionDatabase> database, QWidget *parent)
     : QMainWindow(parent), db(database)
@@ -27,6 +36,19 @@ MainWindow::MainWindow(std::shared_ptr<QuestionDatabase> database, QWidget *pare
     statusBar = new QStatusBar(this);
     setStatusBar(statusBar);
     statusBar->showMessage("Готово");
+
+    // Live memory per subsystem, refreshed once a second.
+    memoryLabel = new QLabel(statusBar);
+    statusBar->addPermanentWidget(memoryLabel);
+    QTimer* memoryTimer = new QTimer(this);
+    connect(memoryTimer, &QTimer::timeout, this, &MainWindow::updateMemoryLabel);
+    memoryTimer->start(1000);
+    updateMemoryLabel();
+}
+
+void MainWindow::updateMemoryLabel()
+{
+    memoryLabel->setText(QString("Память: ") + QString::fromStdString(MemoryStats::instance().summary()));
 }
 
 MainWindow::~MainWindow()
@@ -61,8 +83,8 @@ void MainWindow::setupUi()
     QVBoxLayout* questionsLayout = new QVBoxLayout(questionsGroup);
     
     questionsTable = new QTableWidget(this);
-    questionsTable->setColumnCount(3);
-    questionsTable->setHorizontalHeaderLabels({"Вопрос", "Тип", "Опции"});
+    questionsTable->setColumnCount(4);
+    questionsTable->setHorizontalHeaderLabels({"Вопрос", "Тип", "Опции", "Теги"});
     questionsTable->horizontalHeader()->setStretchLastSection(true);
     questionsTable->setSelectionBehavior(QAbstractItemView::SelectRows);
     questionsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
@@ -130,6 +152,8 @@ void MainWindow::onImport()
             QRegularExpressionMatchIterator it = questionBlockRegex.globalMatch(text);
 
             int addedCount = 0;
+            HistoryEntry change;
+            change.label = "Импорт вопросов";
             while (it.hasNext()) {
                 QRegularExpressionMatch match = it.next();
                 QString rawBlock = match.captured(2).trimmed();
@@ -171,7 +195,7 @@ void MainWindow::onImport()
                         }
                     }
 
-                    auto newQuestion = std::make_shared<Question>(
+                    auto newQuestion = makeCounted<MemorySubsystem::Questions, Question>(
                         questionTextContent.toStdString(),
                         type,
                         optVec,
@@ -180,11 +204,13 @@ void MainWindow::onImport()
                     );
 
                     db->addQuestion(newQuestion);
+                    change.added.push_back(newQuestion);
                     ++addedCount;
                 }
             }
 
             if (addedCount > 0) {
+                recordChange(std::move(change));
                 updateQuestionsTable();
                 showInfo(QString("Импортировано вопросов: %1").arg(addedCount));
             } else {
@@ -207,16 +233,11 @@ void MainWindow::onEditQuestion()
         return;
     }
     
-    int row = selection.first().row();
-    auto topic = db->topics[topicsCombo->currentIndex()];
-    auto questions = db->getQuestionsByTopic(topic);
-    
-    if (row < 0 || row >= static_cast<int>(questions.size())) {
+    auto question = db->findQuestionById(questionIdAt(selection.first().row()));
+    if (!question) {
         return;
     }
     
-    auto question = questions[row];
-    
     QDialog dialog(this);
     dialog.setWindowTitle("Редактировать вопрос");
     dialog.setMinimumWidth(500);
@@ -259,7 +280,8 @@ void MainWindow::onEditQuestion()
     
     if (question->options) {
         for (size_t i = 0; i < question->options->size(); ++i) {
-            QListWidgetItem* item = new QListWidgetItem(QString::fromStdString(question->options->at(i)), optionsList);
+            std::string_view option = question->options->at(i);
+            QListWidgetItem* item = new QListWidgetItem(QString::fromUtf8(option.data(), static_cast<qsizetype>(option.size())), optionsList);
             item->setFlags(item->flags() | Qt::ItemIsEditable);
         }
     }
@@ -271,6 +293,15 @@ void MainWindow::onEditQuestion()
     correctOption->setEnabled(question->questionType == 1);
     formLayout->addRow("Правильный вариант:", correctOption);
     
+    QLineEdit* tagsEdit = new QLineEdit(&dialog);
+    tagsEdit->setPlaceholderText("difficulty:hard, chapter:3");
+    QStringList currentTags;
+    for (const auto& tag : question->tags) {
+        currentTags << QString::fromStdString(tag);
+    }
+    tagsEdit->setText(currentTags.join(", "));
+    formLayout->addRow("Теги (через запятую):", tagsEdit);
+    
     connect(autoAddBtn, &QPushButton::clicked, [=]() {
         QDialog autoDialog(this);
         autoDialog.setWindowTitle("Автодобавление вопроса");
@@ -433,15 +464,20 @@ void MainWindow::onEditQuestion()
             options = std::nullopt;
         }
         
-        auto updatedQuestion = std::make_shared<Question>(
+        auto updatedQuestion = makeCounted<MemorySubsystem::Questions, Question>(
             cleanedQuestionText.toStdString(),
             questionType,
             options,
             correctOptionIndex,
             db->topics[topicsCombo->currentIndex()]
         );
+        updatedQuestion->tags = TagIndex::parseTagList(tagsEdit->text().toStdString());
         
         db->editQuestion(question, updatedQuestion);
+        HistoryEntry change;
+        change.label = "Редактирование вопроса";
+        change.edited.emplace_back(question, updatedQuestion);
+        recordChange(std::move(change));
         updateQuestionsTable();
         showInfo("Вопрос успешно обновлен");
     }
@@ -450,11 +486,11 @@ void MainWindow::setupMenus()
 {
     QMenu* fileMenu = menuBar()->addMenu("Файл");
     
-    QAction* saveAction = new QAction("Сохранить базу вопросов", this);
+    saveAction = new QAction("Сохранить базу вопросов", this);
     connect(saveAction, &QAction::triggered, this, &MainWindow::onSaveDatabase);
     fileMenu->addAction(saveAction);
     
-    QAction* loadAction = new QAction("Загрузить базу вопросов", this);
+    loadAction = new QAction("Загрузить базу вопросов", this);
     connect(loadAction, &QAction::triggered, this, &MainWindow::onLoadDatabase);
     fileMenu->addAction(loadAction);
     
@@ -464,6 +500,22 @@ void MainWindow::setupMenus()
     connect(exitAction, &QAction::triggered, this, &QWidget::close);
     fileMenu->addAction(exitAction);
     
+    QMenu* editMenu = menuBar()->addMenu("Правка");
+    undoAction = new QAction("Отменить", this);
+    undoAction->setShortcut(QKeySequence::Undo);
+    connect(undoAction, &QAction::triggered, this, &MainWindow::onUndo);
+    editMenu->addAction(undoAction);
+    redoAction = new QAction("Повторить", this);
+    redoAction->setShortcut(QKeySequence::Redo);
+    connect(redoAction, &QAction::triggered, this, &MainWindow::onRedo);
+    editMenu->addAction(redoAction);
+    updateUndoActions();
+    
+    QMenu* toolsMenu = menuBar()->addMenu("Сервис");
+    duplicatesAction = new QAction("Похожие вопросы...", this);
+    connect(duplicatesAction, &QAction::triggered, this, &MainWindow::onFindDuplicates);
+    toolsMenu->addAction(duplicatesAction);
+    
     QMenu* helpMenu = menuBar()->addMenu("Справка");
     QAction* aboutAction = new QAction("О программе", this);
     connect(aboutAction, &QAction::triggered, this, &MainWindow::onAbout);
@@ -508,36 +560,283 @@ void MainWindow::updateQuestionsTable()
     questionsTable->setRowCount(questions.size());
     
     for (size_t i = 0; i < questions.size(); ++i) {
-        const auto& question = questions[i];
-        
-        QTableWidgetItem* textItem = new QTableWidgetItem(QString::fromStdString(question->questionText));
-        questionsTable->setItem(i, 0, textItem);
-        
-        QString typeText = question->questionType == 0 ? "Без вариантов" : "С вариантами";
-        QTableWidgetItem* typeItem = new QTableWidgetItem(typeText);
-        questionsTable->setItem(i, 1, typeItem);
-        
-        QString optionsText;
-        if (question->options) {
-            const auto& options = *(question->options);
-            for (size_t j = 0; j < options.size(); ++j) {
-                if (j > 0) optionsText += ", ";
-                optionsText += QString::fromStdString(options[j]);
-                if (j == question->correctOptionIndex) {
-                    optionsText += " ✓";
-                }
-            }
-        }
-        QTableWidgetItem* optionsItem = new QTableWidgetItem(optionsText);
-        questionsTable->setItem(i, 2, optionsItem);
+        setQuestionRow(static_cast<int>(i), questions[i]);
     }
     
     questionsTable->resizeColumnsToContents();
     removeQuestionBtn->setEnabled(!questions.empty());
 }
 
+void MainWindow::setQuestionRow(int row, const std::shared_ptr<Question>& question)
+{
+    QTableWidgetItem* textItem = new QTableWidgetItem(QString::fromStdString(question->questionText));
+    textItem->setData(Qt::UserRole, QVariant::fromValue<qulonglong>(question->id));
+    questionsTable->setItem(row, 0, textItem);
+    
+    QString typeText = question->questionType == 0 ? "Без вариантов" : "С вариантами";
+    QTableWidgetItem* typeItem = new QTableWidgetItem(typeText);
+    questionsTable->setItem(row, 1, typeItem);
+    
+    QString optionsText;
+    if (question->options) {
+        const auto& options = *(question->options);
+        for (size_t j = 0; j < options.size(); ++j) {
+            if (j > 0) optionsText += ", ";
+            optionsText += QString::fromUtf8(options[j].data(), static_cast<qsizetype>(options[j].size()));
+            if (j == question->correctOptionIndex) {
+                optionsText += " ✓";
+            }
+        }
+    }
+    QTableWidgetItem* optionsItem = new QTableWidgetItem(optionsText);
+    questionsTable->setItem(row, 2, optionsItem);
+    
+    QStringList tagList;
+    for (const auto& tag : question->tags) {
+        tagList << QString::fromStdString(tag);
+    }
+    questionsTable->setItem(row, 3, new QTableWidgetItem(tagList.join(", ")));
+}
+
+QuestionId MainWindow::questionIdAt(int row) const
+{
+    QTableWidgetItem* item = questionsTable->item(row, 0);
+    return item ? item->data(Qt::UserRole).toULongLong() : 0;
+}
+
+void MainWindow::setArchive(std::shared_ptr<VariantArchive> variantArchive)
+{
+    archive = variantArchive;
+}
+
+void MainWindow::beginLoading(BankLoader& loader)
+{
+    loading = true;
+    addTopicBtn->setEnabled(false);
+    removeTopicBtn->setEnabled(false);
+    addQuestionBtn->setEnabled(false);
+    editQuestionBtn->setEnabled(false);
+    batchImportBtn->setEnabled(false);
+    removeQuestionBtn->setEnabled(false);
+    generateQuizBtn->setEnabled(false);
+    saveAction->setEnabled(false);
+    loadAction->setEnabled(false);
+    duplicatesAction->setEnabled(false);
+    undoAction->setEnabled(false);
+    redoAction->setEnabled(false);
+    statusBar->showMessage("Загрузка базы вопросов...");
+    cancelLoadBtn = new QPushButton("Отменить", statusBar);
+    statusBar->addPermanentWidget(cancelLoadBtn);
+    connect(cancelLoadBtn, &QPushButton::clicked, this, [this, &loader]() {
+        cancelLoadBtn->setEnabled(false);
+        statusBar->showMessage("Отмена загрузки...");
+        loader.cancel();
+    });
+}
+
+void MainWindow::addLoadingTopic(const QString& name)
+{
+    if (!loading) {
+        return;
+    }
+    topicsCombo->blockSignals(true);
+    topicsCombo->addItem(name);
+    topicsCombo->blockSignals(false);
+}
+
+bool MainWindow::finishLoading(BankLoader& loader)
+{
+    if (!loading) {
+        return !loadFailed;
+    }
+    loading = false;
+
+    if (cancelLoadBtn) {
+        statusBar->removeWidget(cancelLoadBtn);
+        cancelLoadBtn->deleteLater();
+        cancelLoadBtn = nullptr;
+    }
+    statusBar->showMessage("Готово");
+
+    QString selectedTopic = topicsCombo->currentText();
+    try {
+        db->mergeDatabase(*loader.wait());
+    } catch (const OperationCancelled&) {
+        // The bank on disk was not read, so it must not be saved over either.
+        loadFailed = true;
+        if (isVisible()) {
+            showInfo("Загрузка базы вопросов отменена");
+        }
+    } catch (const std::exception& e) {
+        loadFailed = true;
+        if (isVisible()) {
+            showError(QString("Ошибка при загрузке базы вопросов: ") + e.what());
+        }
+    }
+
+    addTopicBtn->setEnabled(true);
+    saveAction->setEnabled(true);
+    loadAction->setEnabled(true);
+    duplicatesAction->setEnabled(true);
+    updateUndoActions();
+    updateTopicsCombo();
+    int selectedIndex = topicsCombo->findText(selectedTopic);
+    if (selectedIndex >= 0) {
+        topicsCombo->setCurrentIndex(selectedIndex);
+    }
+    if (!loadFailed) {
+        showInfo(QString("Загружено вопросов: %1").arg(db->getQuestionCount()));
+        // Changes seen while loading were held back until now.
+        onBankChanged();
+    }
+    return !loadFailed;
+}
+
+void MainWindow::watchBank(std::shared_ptr<BankWatcher> bankWatcher)
+{
+    watcher = bankWatcher;
+    watcher->start([this]() {
+        QMetaObject::invokeMethod(this, [this]() { onBankChanged(); }, Qt::QueuedConnection);
+    });
+}
+
+void MainWindow::onBankChanged()
+{
+    if (loading || loadFailed || !watcher || !watcher->takePendingChange()) {
+        return;
+    }
+    BankChanges changes;
+    try {
+        changes = db->reloadChanged(watcher->path());
+    } catch (const std::exception& e) {
+        showError(QString("Ошибка при обновлении базы вопросов: ") + e.what());
+        return;
+    }
+    if (changes.empty()) {
+        return;
+    }
+    // The reload leaves questions changed here alone, but entries from
+    // before the last save may refer to questions it replaced.
+    std::unordered_set<QuestionId> reloaded(changes.edited.begin(), changes.edited.end());
+    reloaded.insert(changes.removed.begin(), changes.removed.end());
+    if (history.mentions(reloaded)) {
+        history.clear();
+        updateUndoActions();
+    }
+    if (changes.topicsChanged) {
+        QString selectedTopic = topicsCombo->currentText();
+        updateTopicsCombo();
+        int selectedIndex = topicsCombo->findText(selectedTopic);
+        if (selectedIndex >= 0) {
+            topicsCombo->setCurrentIndex(selectedIndex);
+        }
+    } else {
+        refreshQuestionRows(changes);
+    }
+    showInfo(QString("База вопросов изменена на диске: добавлено %1, изменено %2, удалено %3")
+                 .arg(changes.added.size()).arg(changes.edited.size()).arg(changes.removed.size()));
+}
+
+void MainWindow::refreshQuestionRows(const BankChanges& changes)
+{
+    if (topicsCombo->currentIndex() < 0) {
+        return;
+    }
+    const std::string& topicName = db->topics[topicsCombo->currentIndex()]->name;
+    std::unordered_set<QuestionId> edited(changes.edited.begin(), changes.edited.end());
+    std::unordered_set<QuestionId> removed(changes.removed.begin(), changes.removed.end());
+    std::unordered_set<QuestionId> shown;
+    for (int row = questionsTable->rowCount() - 1; row >= 0; --row) {
+        QuestionId id = questionIdAt(row);
+        if (removed.count(id)) {
+            questionsTable->removeRow(row);
+            continue;
+        }
+        if (edited.count(id)) {
+            // An edit may have moved the question to another topic.
+            auto question = db->findQuestionById(id);
+            if (!question || question->topic->name != topicName) {
+                questionsTable->removeRow(row);
+                continue;
+            }
+            setQuestionRow(row, question);
+        }
+        shown.insert(id);
+    }
+    std::vector<QuestionId> arrived = changes.added;
+    arrived.insert(arrived.end(), changes.edited.begin(), changes.edited.end());
+    for (QuestionId id : arrived) {
+        auto question = db->findQuestionById(id);
+        if (question && question->topic->name == topicName && !shown.count(id)) {
+            int row = questionsTable->rowCount();
+            questionsTable->insertRow(row);
+            setQuestionRow(row, question);
+        }
+    }
+    removeQuestionBtn->setEnabled(questionsTable->rowCount() > 0);
+}
+
+void MainWindow::recordChange(HistoryEntry entry)
+{
+    history.record(std::move(entry));
+    updateUndoActions();
+}
+
+void MainWindow::onUndo()
+{
+    stepHistory(true);
+}
+
+void MainWindow::onRedo()
+{
+    stepHistory(false);
+}
+
+void MainWindow::stepHistory(bool undo)
+{
+    if (loading || !(undo ? history.canUndo() : history.canRedo())) {
+        return;
+    }
+    QString label = QString::fromStdString(undo ? history.undoLabel() : history.redoLabel());
+    bool applied = true;
+    try {
+        if (undo) {
+            history.undo(*db);
+        } else {
+            history.redo(*db);
+        }
+    } catch (const std::exception& e) {
+        showError((undo ? QString("Ошибка при отмене изменения: ") : QString("Ошибка при повторе изменения: ")) + e.what());
+        history.clear();
+        applied = false;
+    }
+    updateUndoActions();
+    QString selectedTopic = topicsCombo->currentText();
+    updateTopicsCombo();
+    int selectedIndex = topicsCombo->findText(selectedTopic);
+    if (selectedIndex >= 0) {
+        topicsCombo->setCurrentIndex(selectedIndex);
+    }
+    if (applied) {
+        showInfo((undo ? QString("Отменено: ") : QString("Повторено: ")) + label);
+    }
+}
+
+void MainWindow::updateUndoActions()
+{
+    bool canUndo = !loading && history.canUndo();
+    bool canRedo = !loading && history.canRedo();
+    undoAction->setEnabled(canUndo);
+    redoAction->setEnabled(canRedo);
+    undoAction->setText(canUndo ? QString("Отменить: ") + QString::fromStdString(history.undoLabel()) : QString("Отменить"));
+    redoAction->setText(canRedo ? QString("Повторить: ") + QString::fromStdString(history.redoLabel()) : QString("Повторить"));
+}
+
 void MainWindow::onTopicChanged(int index)
 {
+    if (loading) {
+        return;
+    }
     if (index >= 0) {
         updateQuestionsTable();
         batchImportBtn->setEnabled(true);
@@ -558,7 +857,7 @@ void MainWindow::onAddTopic()
             }
         }
         
-        auto newTopic = std::make_shared<Topic>(topicName.toStdString());
+        auto newTopic = makeCounted<MemorySubsystem::Topics, Topic>(topicName.toStdString());
         db->topics.push_back(newTopic);
         updateTopicsCombo();
         topicsCombo->setCurrentIndex(topicsCombo->count() - 1);
@@ -579,13 +878,12 @@ void MainWindow::onRemoveTopic()
         return;
     }
     
-    auto it = std::remove_if(db->questions.begin(), db->questions.end(),
-                           [&topic](const std::shared_ptr<Question>& q) {
-                               return q->topic->name == topic->name;
-                           });
-    db->questions.erase(it, db->questions.end());
-    
-    db->topics.erase(db->topics.begin() + topicsCombo->currentIndex());
+    HistoryEntry change;
+    change.label = "Удаление темы";
+    change.removed = db->getQuestionsByTopic(topic);
+    change.removedTopics.emplace_back(topicsCombo->currentIndex(), topic);
+    db->removeTopic(topic);
+    recordChange(std::move(change));
     
     updateTopicsCombo();
     showInfo("Тема успешно удалена");
@@ -637,6 +935,10 @@ void MainWindow::onAddQuestion()
     correctOption->setEnabled(false);
     formLayout->addRow("Правильный вариант:", correctOption);
     
+    QLineEdit* tagsEdit = new QLineEdit(&dialog);
+    tagsEdit->setPlaceholderText("difficulty:hard, chapter:3");
+    formLayout->addRow("Теги (через запятую):", tagsEdit);
+    
     connect(autoAddBtn, &QPushButton::clicked, [=]() {
         QDialog autoDialog(this);
         autoDialog.setWindowTitle("Автодобавление вопроса");
@@ -801,15 +1103,20 @@ void MainWindow::onAddQuestion()
             options = std::nullopt;
         }
         
-        auto newQuestion = std::make_shared<Question>(
+        auto newQuestion = makeCounted<MemorySubsystem::Questions, Question>(
             questionText->text().toStdString(),
             questionType,
             options,
             correctOptionIndex,
             db->topics[topicsCombo->currentIndex()]
         );
+        newQuestion->tags = TagIndex::parseTagList(tagsEdit->text().toStdString());
         
         db->addQuestion(newQuestion);
+        HistoryEntry change;
+        change.label = "Добавление вопроса";
+        change.added.push_back(newQuestion);
+        recordChange(std::move(change));
         updateQuestionsTable();
         showInfo("Вопрос успешно добавлен");
     }
@@ -823,19 +1130,120 @@ void MainWindow::onRemoveQuestion()
         return;
     }
     
-    if (!confirm("Вы действительно хотите удалить выбранный вопрос?")) {
+    QString prompt = selection.size() == 1
+        ? QString("Вы действительно хотите удалить выбранный вопрос?")
+        : QString("Вы действительно хотите удалить выбранные вопросы (%1)?").arg(selection.size());
+    if (!confirm(prompt)) {
         return;
     }
     
-    int row = selection.first().row();
-    auto topic = db->topics[topicsCombo->currentIndex()];
-    auto questions = db->getQuestionsByTopic(topic);
+    std::vector<QuestionId> ids;
+    HistoryEntry change;
+    change.label = "Удаление вопросов";
+    for (const QModelIndex& index : selection) {
+        ids.push_back(questionIdAt(index.row()));
+        if (auto question = db->findQuestionById(ids.back())) {
+            change.removed.push_back(question);
+        }
+    }
+    std::size_t removed = db->removeMany(ids);
+    recordChange(std::move(change));
+    updateQuestionsTable();
+    showInfo(removed == 1 ? QString("Вопрос успешно удален") : QString("Удалено вопросов: %1").arg(removed));
+}
+
+// Review list of reworded copies: each row is a pair, and the second
+// question of the selected rows can be removed from here.
+void MainWindow::onFindDuplicates()
+{
+    NearDuplicateOptions options;
+    bool ok = false;
+    options.threshold = QInputDialog::getDouble(this, "Похожие вопросы", "Минимальное сходство (0-1):",
+                                                options.threshold, 0.0, 1.0, 2, &ok);
+    if (!ok) {
+        return;
+    }
+    NearDuplicateReport report;
+    try {
+        report = findNearDuplicates(db->getAllQuestions(), options);
+    } catch (const std::exception& e) {
+        showError(QString("Ошибка при поиске похожих вопросов: ") + e.what());
+        return;
+    }
+    if (report.pairs.empty()) {
+        showInfo("Похожих вопросов не найдено");
+        return;
+    }
     
-    if (row >= 0 && row < static_cast<int>(questions.size())) {
-        db->removeQuestion(questions[row]);
-        updateQuestionsTable();
-        showInfo("Вопрос успешно удален");
+    QDialog dialog(this);
+    dialog.setWindowTitle(QString("Похожие вопросы: %1").arg(report.pairs.size()));
+    dialog.resize(1000, 600);
+    QVBoxLayout* layout = new QVBoxLayout(&dialog);
+    
+    QTableWidget* pairsTable = new QTableWidget(static_cast<int>(report.pairs.size()), 5, &dialog);
+    pairsTable->setHorizontalHeaderLabels({"Сходство", "Вопрос", "Тема", "Похожий вопрос", "Тема"});
+    pairsTable->horizontalHeader()->setStretchLastSection(true);
+    pairsTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    pairsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    auto topicName = [](const Question& question) {
+        return question.topic ? QString::fromStdString(question.topic->name) : QString();
+    };
+    for (int row = 0; row < static_cast<int>(report.pairs.size()); ++row) {
+        const NearDuplicatePair& pair = report.pairs[row];
+        pairsTable->setItem(row, 0, new QTableWidgetItem(QString::number(pair.similarity, 'f', 2)));
+        QTableWidgetItem* firstItem = new QTableWidgetItem(QString::fromStdString(pair.first->questionText));
+        firstItem->setData(Qt::UserRole, QVariant::fromValue<qulonglong>(pair.first->id));
+        pairsTable->setItem(row, 1, firstItem);
+        pairsTable->setItem(row, 2, new QTableWidgetItem(topicName(*pair.first)));
+        QTableWidgetItem* secondItem = new QTableWidgetItem(QString::fromStdString(pair.second->questionText));
+        secondItem->setData(Qt::UserRole, QVariant::fromValue<qulonglong>(pair.second->id));
+        pairsTable->setItem(row, 3, secondItem);
+        pairsTable->setItem(row, 4, new QTableWidgetItem(topicName(*pair.second)));
     }
+    layout->addWidget(pairsTable);
+    
+    QHBoxLayout* buttonLayout = new QHBoxLayout();
+    QPushButton* removeSecondBtn = new QPushButton("Удалить похожий вопрос", &dialog);
+    connect(removeSecondBtn, &QPushButton::clicked, &dialog, [this, pairsTable]() {
+        QModelIndexList selection = pairsTable->selectionModel()->selectedRows();
+        if (selection.isEmpty()) {
+            showError("Выберите пары вопросов");
+            return;
+        }
+        if (!confirm(QString("Удалить похожие вопросы выбранных пар (%1)?").arg(selection.size()))) {
+            return;
+        }
+        std::unordered_set<QuestionId> removedIds;
+        for (const QModelIndex& index : selection) {
+            removedIds.insert(pairsTable->item(index.row(), 3)->data(Qt::UserRole).toULongLong());
+        }
+        HistoryEntry change;
+        change.label = "Удаление похожих вопросов";
+        for (QuestionId id : removedIds) {
+            if (auto question = db->findQuestionById(id)) {
+                change.removed.push_back(question);
+            }
+        }
+        std::size_t removed = db->removeMany(std::vector<QuestionId>(removedIds.begin(), removedIds.end()));
+        recordChange(std::move(change));
+        // Pairs with a removed question on either side are settled.
+        for (int row = pairsTable->rowCount() - 1; row >= 0; --row) {
+            if (removedIds.count(pairsTable->item(row, 1)->data(Qt::UserRole).toULongLong()) ||
+                removedIds.count(pairsTable->item(row, 3)->data(Qt::UserRole).toULongLong())) {
+                pairsTable->removeRow(row);
+            }
+        }
+        updateQuestionsTable();
+        statusBar->showMessage(QString("Удалено вопросов: %1").arg(removed));
+    });
+    QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Close, &dialog);
+    connect(buttonBox, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    buttonLayout->addWidget(removeSecondBtn);
+    buttonLayout->addStretch();
+    buttonLayout->addWidget(buttonBox);
+    layout->addLayout(buttonLayout);
+    
+    dialog.exec();
 }
 
 void MainWindow::onGenerateQuiz()
@@ -860,7 +1268,8 @@ void MainWindow::onGenerateQuiz()
     topicsTable->setRowCount(db->topics.size());
     for (size_t i = 0; i < db->topics.size(); ++i) {
         const auto& topic = db->topics[i];
-        auto questions = db->getQuestionsByTopic(topic);
+        // Counted from the manifest so unread segments stay on disk.
+        int available = static_cast<int>(db->topicQuestionCount(topic));
         
         QWidget* checkboxWidget = new QWidget();
         QHBoxLayout* checkboxLayout = new QHBoxLayout(checkboxWidget);
@@ -875,22 +1284,22 @@ void MainWindow::onGenerateQuiz()
         nameItem->setFlags(nameItem->flags() & ~Qt::ItemIsEditable);
         topicsTable->setItem(i, 1, nameItem);
         
-        QTableWidgetItem* countItem = new QTableWidgetItem(QString::number(questions.size()));
+        QTableWidgetItem* countItem = new QTableWidgetItem(QString::number(available));
         countItem->setFlags(countItem->flags() & ~Qt::ItemIsEditable);
         topicsTable->setItem(i, 2, countItem);
         
         QSpinBox* spinBox = new QSpinBox(&dialog);
         spinBox->setMinimum(0);
-        spinBox->setMaximum(questions.size());
-        spinBox->setValue(questions.empty() ? 0 : std::min(5, static_cast<int>(questions.size())));
+        spinBox->setMaximum(available);
+        spinBox->setValue(std::min(5, available));
         topicsTable->setCellWidget(i, 3, spinBox);
         
-        connect(checkbox, &QCheckBox::toggled, [spinBox, questions](bool checked) {
+        connect(checkbox, &QCheckBox::toggled, [spinBox, available](bool checked) {
             spinBox->setEnabled(checked);
             if (!checked) {
                 spinBox->setValue(0);
-            } else if (spinBox->value() == 0 && !questions.empty()) {
-                spinBox->setValue(std::min(5, static_cast<int>(questions.size())));
+            } else if (spinBox->value() == 0 && available > 0) {
+                spinBox->setValue(std::min(5, available));
             }
         });
     }
@@ -906,6 +1315,24 @@ void MainWindow::onGenerateQuiz()
     QFormLayout* formLayout = new QFormLayout();
     formLayout->addRow("Количество вариантов:", variantCount);
     
+    QCheckBox* preferUnused = new QCheckBox("Предпочитать редко используемые вопросы", &dialog);
+    formLayout->addRow("", preferUnused);
+    
+    QLineEdit* seedEdit = new QLineEdit(&dialog);
+    seedEdit->setPlaceholderText("Случайное");
+    formLayout->addRow("Зерно генерации:", seedEdit);
+    
+    QLineEdit* tagFilterEdit = new QLineEdit(&dialog);
+    tagFilterEdit->setPlaceholderText("difficulty:hard|difficulty:medium has_options !author:bob");
+    tagFilterEdit->setToolTip("Пробел — «и», «|» — «или», «!» — «не»");
+    formLayout->addRow("Фильтр по тегам:", tagFilterEdit);
+    
+    QCheckBox* compactOutput = new QCheckBox("Компактные файлы с общей таблицей стилей", &dialog);
+    formLayout->addRow("", compactOutput);
+    QCheckBox* gzipOutput = new QCheckBox("Дополнительно сохранять сжатые копии (.gz)", &dialog);
+    gzipOutput->setEnabled(DocumentWriter::gzipAvailable());
+    formLayout->addRow("", gzipOutput);
+    
     // QCheckBox* shuffleQuestions = new QCheckBox("Перемешать вопросы", &dialog);
     // shuffleQuestions->setChecked(true);
     // formLayout->addRow("", shuffleQuestions);
@@ -928,7 +1355,8 @@ void MainWindow::onGenerateQuiz()
             return;
         }
         
-        std::vector<std::pair<std::shared_ptr<Topic>, int>> selectedTopics;
+        std::vector<QuestionQuota> quotas;
+        std::string tagFilter = tagFilterEdit->text().simplified().toStdString();
         int totalQuestions = 0;
         
         for (size_t i = 0; i < db->topics.size(); ++i) {
@@ -940,49 +1368,104 @@ void MainWindow::onGenerateQuiz()
                 int count = spinBox->value();
                 
                 if (count > 0) {
-                    selectedTopics.emplace_back(db->topics[i], count);
+                    quotas.emplace_back(db->topics[i], count, tagFilter);
                     totalQuestions += count;
                 }
             }
         }
         
-        if (selectedTopics.empty() || totalQuestions == 0) {
+        if (quotas.empty() || totalQuestions == 0) {
             showError("Выберите хотя бы один вопрос для включения в тест");
             return;
         }
         
+        if (!tagFilter.empty()) {
+            int matching = 0;
+            try {
+                for (const auto& quota : quotas) {
+                    matching += static_cast<int>(std::min<std::size_t>(quota.count, db->selectQuestions(quota).size()));
+                }
+            } catch (const std::invalid_argument&) {
+                showError("Некорректный фильтр по тегам");
+                return;
+            }
+            if (matching == 0) {
+                showError("Нет вопросов, подходящих под фильтр по тегам");
+                return;
+            }
+        }
+        
         int variants = variantCount->value();
         bool shuffle = false;
         
-        for (int i = 0; i < variants; ++i) {
-            auto quizVariant = std::make_shared<QuizVariant>("Вариант " + std::to_string(i + 1));
-            
-            for (const auto& topicPair : selectedTopics) {
-                auto topic = topicPair.first;
-                int questionCount = topicPair.second;
-                auto questions = db->getQuestionsByTopic(topic);
-                
-                std::shuffle(questions.begin(), questions.end(), std::mt19937(std::random_device{}()));
-                
-                for (int j = 0; j < std::min(questionCount, static_cast<int>(questions.size())); ++j) {
-                    quizVariant->addQuestion(questions[j]);
-                }
+        std::uint64_t seed = RngService::randomSeed();
+        QString seedText = seedEdit->text().trimmed();
+        if (!seedText.isEmpty()) {
+            bool seedOk = false;
+            seed = seedText.toULongLong(&seedOk);
+            if (!seedOk) {
+                showError("Некорректное зерно генерации");
+                return;
             }
-            
-            if (shuffle) {
-                quizVariant->shuffleQuestions();
+        }
+        RngService rng(seed);
+        PipelineOptions pipelineOptions;
+        pipelineOptions.shuffle = shuffle;
+        pipelineOptions.weighted = preferUnused->isChecked();
+        pipelineOptions.document.compact = compactOutput->isChecked();
+        pipelineOptions.document.gzip = gzipOutput->isChecked();
+        if (pipelineOptions.document.compact && !DocumentWriter(pipelineOptions.document).writeStylesheet(saveDir.toStdString())) {
+            showError("Ошибка при сохранении таблицы стилей");
+            return;
+        }
+        
+        std::string filePrefix = (saveDir + "/" + QDate::currentDate().toString("yyyy-MM-dd") + "_" + QString::fromStdString(quotas[0].topic->name) + "_variant_").toStdString();
+        auto pathFor = [&filePrefix](std::size_t index) {
+            return filePrefix + std::to_string(index + 1) + ".html";
+        };
+        // Written variants are counted here; Cancel stops the run after the
+        // variant being written and keeps what is on disk.
+        QProgressDialog progress("Создание вариантов теста...", "Отменить", 0, variants, this);
+        progress.setWindowModality(Qt::WindowModal);
+        progress.setMinimumDuration(500);
+        pipelineOptions.cancel = std::make_shared<CancellationToken>();
+        int written = 0;
+        QStringList archiveErrors;
+        auto onWritten = [this, &archiveErrors, &progress, &written, &pipelineOptions](const QuizVariant& quizVariant, const std::string&) {
+            progress.setValue(++written);
+            if (progress.wasCanceled()) {
+                pipelineOptions.cancel->cancel();
+            }
+            if (!archive) {
+                return;
             }
-            
-            QString fileName = saveDir + "/" + QDate::currentDate().toString("yyyy-MM-dd") + "_" + QString::fromStdString(selectedTopics[0].first->name) + "_variant_" + QString::number(i + 1) + ".html";
             try {
-                db->writeExamToDoc(fileName.toStdString(), quizVariant);
+                archive->add(quizVariant);
             } catch (const std::exception& e) {
-                showError(QString("Ошибка при сохранении варианта теста: ") + e.what());
-                continue;
+                archiveErrors << e.what();
             }
+        };
+        PipelineReport report;
+        try {
+            report = runVariantPipeline(*db, quotas, rng, variants, pathFor, pipelineOptions, onWritten);
+        } catch (const std::exception& e) {
+            showError(QString("Ошибка при создании вариантов теста: ") + e.what());
+            return;
+        }
+        progress.reset();
+        if (!report.failedPaths.empty() || !archiveErrors.isEmpty()) {
+            QStringList failures = archiveErrors;
+            for (const auto& path : report.failedPaths) {
+                failures << QString::fromStdString(path);
+            }
+            showError(QString("Ошибка при сохранении варианта теста: ") + failures.join(", "));
         }
         
-        showInfo(QString("Успешно создано %1 вариантов теста в папке %2").arg(variants).arg(saveDir));
+        if (report.cancelled) {
+            showInfo(QString("Создание отменено: создано %1 из %2 вариантов теста в папке %3 (зерно %4)").arg(report.variants).arg(variants).arg(saveDir).arg(seed));
+            return;
+        }
+        showInfo(QString("Успешно создано %1 вариантов теста в папке %2 (зерно %3)").arg(variants).arg(saveDir).arg(seed));
     }
 }
 
@@ -995,7 +1478,7 @@ void MainWindow::onSaveDatabase()
     }
     
     try {
-        db->writeQuestionsToFile(fileName.toStdString());
+        db->saveBank(fileName.toStdString());
         showInfo("База вопросов успешно сохранена");
     } catch (const std::exception& e) {
         showError(QString("Ошибка при сохранении базы вопросов: ") + e.what());
@@ -1004,16 +1487,23 @@ void MainWindow::onSaveDatabase()
 
 void MainWindow::onLoadDatabase()
 {
-    QString fileName = QFileDialog::getOpenFileName(this, "Загрузить базу вопросов", 
-                                                 "", "Text Files (*.txt);;All Files (*)");
-    if (fileName.isEmpty()) {
+    // Several files are merged in one pass, dropping duplicate questions.
+    QStringList fileNames = QFileDialog::getOpenFileNames(this, "Загрузить базы вопросов",
+                                                        "", "Text Files (*.txt);;All Files (*)");
+    if (fileNames.isEmpty()) {
         return;
     }
+    std::vector<std::string> paths;
+    for (const QString& fileName : fileNames) {
+        paths.push_back(fileName.toStdString());
+    }
     
     try {
-        db->readQuestionsFromFile(fileName.toStdString());
+        MergeReport report = mergeBanks(*db, paths);
         updateTopicsCombo();
-        showInfo("База вопросов успешно загружена");
+        std::ostringstream details;
+        report.dump(details);
+        showInfo(QString("База вопросов успешно загружена\n\n") + QString::fromStdString(details.str()));
     } catch (const std::exception& e) {
         showError(QString("Ошибка при загрузке базы вопросов: ") + e.what());
     }
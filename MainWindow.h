@@ -16,6 +16,10 @@
 #include <QInputDialog>
 #include <QFileDialog>
 #include "logic/quiz.h"
+#include "logic/loader.h"
+#include "logic/archive.h"
+#include "logic/history.h"
+#include "logic/watcher.h"
 
 class MainWindow : public QMainWindow
 {
@@ -25,6 +29,19 @@ public:
     MainWindow(std::shared_ptr<QuestionDatabase> database, QWidget *parent = nullptr);
     ~MainWindow();
 
+    // Generated variants are recorded here when set.
+    void setArchive(std::shared_ptr<VariantArchive> variantArchive);
+
+    // Background bank loading: editing is disabled until finishLoading(), and
+    // the status bar offers to cancel the load.
+    void beginLoading(BankLoader& loader);
+    void addLoadingTopic(const QString& name);
+    // Merges the loaded bank once; returns false if loading failed or was
+    // cancelled.
+    bool finishLoading(BankLoader& loader);
+    // Reloads the bank when the watcher reports a change on disk.
+    void watchBank(std::shared_ptr<BankWatcher> bankWatcher);
+
 private slots:
     void onTopicChanged(int index);
     void onAddTopic();
@@ -37,6 +54,9 @@ private slots:
     void onImport();
     void onQuestionSelectionChanged();
     void onLoadDatabase();
+    void onFindDuplicates();
+    void onUndo();
+    void onRedo();
     void onAbout();
 
 private:
@@ -44,12 +64,28 @@ private:
     void setupMenus();
     void updateTopicsCombo();
     void updateQuestionsTable();
+    void setQuestionRow(int row, const std::shared_ptr<Question>& question);
+    // Updates only the rows of the shown topic that a reload touched.
+    void refreshQuestionRows(const BankChanges& changes);
+    void onBankChanged();
+    void updateMemoryLabel();
+    // Undoable changes go through here once applied to the bank.
+    void recordChange(HistoryEntry entry);
+    void stepHistory(bool undo);
+    void updateUndoActions();
+    // Id of the question shown in the given row of questionsTable.
+    QuestionId questionIdAt(int row) const;
     void displayQuestion(const std::shared_ptr<Question>& question);
     void showError(const QString& message);
     void showInfo(const QString& message);
     bool confirm(const QString& message);
 
     std::shared_ptr<QuestionDatabase> db;
+    std::shared_ptr<VariantArchive> archive;
+    std::shared_ptr<BankWatcher> watcher;
+    EditHistory history;
+    bool loading = false;
+    bool loadFailed = false;
     
     // UI Elements
     QComboBox* topicsCombo;
@@ -61,5 +97,12 @@ private:
     QPushButton* batchImportBtn;
     QPushButton* removeQuestionBtn;
     QPushButton* generateQuizBtn;
+    QAction* saveAction;
+    QAction* loadAction;
+    QAction* duplicatesAction;
+    QAction* undoAction;
+    QAction* redoAction;
     QStatusBar* statusBar;
+    QPushButton* cancelLoadBtn = nullptr;
+    QLabel* memoryLabel;
 };
\ No newline at end of file
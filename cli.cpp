@@ -1,23 +1,96 @@
 # include "cli.h"
 # include "logic/quiz.h"
 #include <algorithm>
+#include <fstream>
 #include <limits>
 #include <sstream>
-#include <random>
+#include "logic/docwriter.h"
+#include "logic/duplicates.h"
+#include "logic/grading.h"
+#include "logic/itemstats.h"
+#include "logic/pipeline.h"
+#include "logic/memory.h"
+#include "logic/overlap.h"
+#include "logic/stats.h"
 
 
 CLI::CLI(std::shared_ptr<QuestionDatabase> database) : db(database) {}
 
+void CLI::setLoader(std::shared_ptr<BankLoader> bankLoader) {
+    loader = bankLoader;
+}
+
+void CLI::setArchive(std::shared_ptr<VariantArchive> variantArchive) {
+    archive = variantArchive;
+}
+
+void CLI::setWatcher(std::shared_ptr<BankWatcher> bankWatcher) {
+    watcher = bankWatcher;
+}
+
+void CLI::ensureLoaded() {
+    if (!loader) {
+        return;
+    }
+    if (!loader->isReady()) {
+        std::cout << "Waiting for the question bank to finish loading...\n";
+    }
+    try {
+        db->mergeDatabase(*loader->wait());
+    } catch (const std::exception& e) {
+        loadFailed = true;
+        std::cout << "Failed to read question DB: " << e.what() << "\n";
+    }
+    loader.reset();
+}
+
+void CLI::reloadIfChanged() {
+    if (!watcher || loadFailed || !watcher->takePendingChange()) {
+        return;
+    }
+    try {
+        BankChanges changes = db->reloadChanged(watcher->path());
+        if (changes.empty()) {
+            return;
+        }
+        std::cout << "Question bank changed on disk: " << changes.added.size() << " added, "
+                  << changes.edited.size() << " edited, " << changes.removed.size() << " removed.\n";
+        if (changes.topicsChanged) {
+            selectedTopicIndex = -1;
+            std::cout << "Topics changed; select a topic again.\n";
+        }
+    } catch (const std::exception& e) {
+        std::cout << "Failed to reload the changed question DB: " << e.what() << "\n";
+    }
+}
+
 void CLI::run() {
     std::string command;
     std::cout << "Welcome to the Quiz CLI! Type 'help' for a list of commands.\n";
-    while (true) {
-        std::cout << "> ";
-        std::getline(std::cin, command);
-        processCommand(command);
+    bool firstPrompt = true;
+    while (running) {
+        std::cout << "> " << std::flush;
+        if (firstPrompt) {
+            PerfStats::instance().recordSince(PerfStage::FirstFrame, PerfStats::processStartTime());
+            firstPrompt = false;
+        }
+        if (!std::getline(std::cin, command)) {
+            break;
+        }
+        // e.g. a damaged segment of a lazily opened bank
+        try {
+            processCommand(command);
+        } catch (const std::exception& e) {
+            std::cout << "Error: " << e.what() << "\n";
+        }
     }
+    ensureLoaded();
 }
 void CLI::processCommand(const std::string& command) {
+    if (command != "help" && command != "stats" && command != "mem") {
+        ensureLoaded();
+        reloadIfChanged();
+    }
     if (command == "help") {
         showHelp();
     } else if (command == "add_topic") {
@@ -36,6 +109,26 @@ void CLI::processCommand(const std::string& command) {
         generateQuiz();
     } else if (command == "list_questions") {
         listQuestions();
+    } else if (command == "list_tags") {
+        listTags();
+    } else if (command == "merge") {
+        mergeFiles();
+    } else if (command == "find_variants") {
+        findVariants();
+    } else if (command == "rerender") {
+        rerenderVariant();
+    } else if (command == "overlap") {
+        analyzeVariantOverlap();
+    } else if (command == "near_duplicates") {
+        findNearDuplicateQuestions();
+    } else if (command == "grade") {
+        gradeResponseFile();
+    } else if (command == "item_stats") {
+        analyzeItemResults();
+    } else if (command == "stats") {
+        showStats();
+    } else if (command == "mem") {
+        showMemory();
     } else if (command == "exit") {
         exit();
     } else {
@@ -51,9 +144,19 @@ void CLI::showHelp(){
               << "  select_topic - Select a topic for questions\n"
               << "  list_topics - List all topics\n"
               << "  add_question - Add a new question to the selected topic\n"
-              << "  remove_question - Remove a question from the selected topic\n"
+              << "  remove_question - Remove questions by id\n"
               << "  generate_quiz - Generate a quiz based on the selected topic\n"
-              << "  list_questions - List all questions in the selected topic\n";
+              << "  list_questions - List all questions in the selected topic\n"
+              << "  list_tags - List all question tags with their question counts\n"
+              << "  merge - Merge several bank files into this bank, dropping duplicates\n"
+              << "  find_variants - List archived variants that contain a question\n"
+              << "  rerender - Re-render an archived variant with current question texts\n"
+              << "  overlap - Compare archived variants pairwise by the questions they share\n"
+              << "  near_duplicates - List questions that look like reworded copies of each other\n"
+              << "  grade - Grade a file of student responses against the archived variants\n"
+              << "  item_stats - Compute difficulty and discrimination of questions from graded results\n"
+              << "  stats - Show per-stage performance counters\n"
+              << "  mem - Show live and peak memory per subsystem\n";
 }
 void CLI::addTopic() {
     std::string topicName;
@@ -71,7 +174,7 @@ void CLI::addTopic() {
             return;
         }
     }
-    auto newTopic = std::make_shared<Topic>(topicName);
+    auto newTopic = makeCounted<MemorySubsystem::Topics, Topic>(topicName);
     db->topics.push_back(newTopic);
     
     std::cout << "Topic '" << topicName << "' added successfully.\n";
@@ -81,13 +184,16 @@ void CLI::removeTopic() {
     std::cout << "Enter topic name to remove: ";
     std::getline(std::cin, topicName);
     
-    auto it = std::remove_if(db->topics.begin(), db->topics.end(),
-                             [&topicName](const std::shared_ptr<Topic>& topic) {
-                                 return topic->name == topicName;
-                             });
+    auto it = std::find_if(db->topics.begin(), db->topics.end(),
+                           [&topicName](const std::shared_ptr<Topic>& topic) {
+                               return topic->name == topicName;
+                           });
     
     if (it != db->topics.end()) {
-        db->topics.erase(it, db->topics.end());
+        // Through the database, so that its questions and segment go too.
+        std::shared_ptr<Topic> topic = *it;
+        db->removeTopic(topic);
+        selectedTopicIndex = -1;
         std::cout << "Topic '" << topicName << "' removed successfully.\n";
     } else {
         std::cout << "Topic '" << topicName << "' not found.\n";
@@ -158,27 +264,40 @@ void CLI::addQuestion(){
         correctOptionIndex = -1; 
     }
 
-    auto newQuestion = std::make_shared<Question>(questionText, questionType, options, correctOptionIndex, db->topics[selectedTopicIndex]);
+    std::string tagsInput;
+    std::cout << "Enter tags separated by commas (e.g. 'difficulty:hard, chapter:3'), or leave empty: ";
+    std::getline(std::cin, tagsInput);
+
+    auto newQuestion = makeCounted<MemorySubsystem::Questions, Question>(questionText, questionType, options, correctOptionIndex, db->topics[selectedTopicIndex]);
+    newQuestion->tags = TagIndex::parseTagList(tagsInput);
     db->addQuestion(newQuestion);
     
     std::cout << "Question added successfully.\n";
 }
 void CLI::removeQuestion(){
-    int questionIndex;
-    std::cout << "Enter question index to remove (0 to " << db->getQuestionCount() - 1 << "): ";
-    std::cin >> questionIndex;
-    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-    if (questionIndex < 0 || questionIndex >= db->getQuestionCount()) {
-        std::cout << "Invalid question index.\n";
-        return;
+    std::string input;
+    std::cout << "Enter id(s) of the questions to remove, separated by spaces (see list_questions): ";
+    std::getline(std::cin, input);
+    std::istringstream iss(input);
+    std::vector<QuestionId> ids;
+    std::string token;
+    while (iss >> token) {
+        try {
+            ids.push_back(std::stoull(token));
+        } catch (const std::exception&) {
+            std::cout << "Invalid question id: " << token << "\n";
+            return;
+        }
     }
-    auto question = db->getQuestionByIndex(questionIndex);
-    if (question->topic->name != db->topics[selectedTopicIndex]->name) {
-        std::cout << "Question does not belong to the selected topic.\n";
+    if (ids.empty()) {
+        std::cout << "No question ids given.\n";
         return;
     }
-    db->removeQuestion(question);
-    std::cout << "Question removed successfully.\n";
+    std::size_t removed = db->removeMany(ids);
+    if (removed < ids.size()) {
+        std::cout << ids.size() - removed << " id(s) did not match any question.\n";
+    }
+    std::cout << removed << " question(s) removed successfully.\n";
 }
 void CLI::generateQuiz(){
     auto topics = db->topics;
@@ -189,34 +308,60 @@ void CLI::generateQuiz(){
     for (size_t i = 0; i < topics.size(); ++i) {
         std::cout << i << ": " << topics[i]->name << "\n";
     }
-    std::vector<std::pair<std::shared_ptr<Topic>, int>> selectedTopics;
+    std::vector<QuestionQuota> quotas;
     std::string input;
-    std::cout << "Enter topic indices and number of questions per topic (e.g., '0 5' for topic 0 with 5 questions, or 'done' to finish): ";
+    std::cout << "Enter topic indices and number of questions per topic (e.g., '0 5' for topic 0 with 5 questions, or 'done' to finish).\n"
+              << "An optional tag filter may follow, and '*' matches any topic (e.g., '* 3 difficulty:hard|difficulty:medium has_options !author:bob'): ";
     while (true) {
-        std::getline(std::cin, input);
-        if (input == "done") {
+        if (!std::getline(std::cin, input) || input == "done") {
             break;
         }
         std::istringstream iss(input);
-        int topicIndex, questionCount;
-        if (!(iss >> topicIndex >> questionCount) || topicIndex < 0 || topicIndex >= static_cast<int>(topics.size()) || questionCount <= 0) {
+        std::string topicToken;
+        int questionCount;
+        if (!(iss >> topicToken >> questionCount) || questionCount <= 0) {
             std::cout << "Invalid input. Please enter valid topic index and question count.\n";
             continue;
         }
-        auto it = std::find_if(selectedTopics.begin(), selectedTopics.end(),
-                               [topicIndex, &topics](const std::pair<std::shared_ptr<Topic>, int>& pair) {
-                                   return pair.first->name == topics[topicIndex]->name;
-                               });
-        if (it != selectedTopics.end()) {
-            it->second += questionCount; 
+        std::shared_ptr<Topic> topic;
+        if (topicToken != "*") {
+            int topicIndex = -1;
+            try {
+                topicIndex = std::stoi(topicToken);
+            } catch (const std::exception&) {
+            }
+            if (topicIndex < 0 || topicIndex >= static_cast<int>(topics.size())) {
+                std::cout << "Invalid input. Please enter valid topic index and question count.\n";
+                continue;
+            }
+            topic = topics[topicIndex];
+        }
+        std::string filter;
+        std::getline(iss >> std::ws, filter);
+        QuestionQuota quota(topic, questionCount, filter);
+        std::string label = topic ? "topic '" + topic->name + "'" : "all topics";
+        if (!filter.empty()) {
+            label += " matching '" + filter + "'";
+        }
+        auto it = std::find_if(quotas.begin(), quotas.end(), [&quota](const QuestionQuota& existing) {
+            return existing.topic == quota.topic && existing.tagFilter == quota.tagFilter;
+        });
+        if (it != quotas.end()) {
+            it->count += questionCount;
+            continue;
+        }
+        std::size_t available;
+        try {
+            available = db->selectQuestions(quota).size();
+        } catch (const std::invalid_argument& e) {
+            std::cout << e.what() << "\n";
             continue;
         }
-        auto questions = db->getQuestionsByTopic(topics[topicIndex]);
-        if (questionCount > static_cast<int>(questions.size())) {
-            std::cout << "Warning: Requested question count exceeds available questions in topic '" << topics[topicIndex]->name << "'. Setting to " << questions.size() << ".\n";
-            questionCount = static_cast<int>(questions.size());
+        if (questionCount > static_cast<int>(available)) {
+            std::cout << "Warning: Requested question count exceeds available questions in " << label << ". Setting to " << available << ".\n";
+            quota.count = static_cast<int>(available);
         }
-        selectedTopics.emplace_back(topics[topicIndex], questionCount);
+        quotas.push_back(quota);
     }
     int variantCount;
     std::cout << "Enter the number of quiz variants to generate: ";
@@ -230,27 +375,52 @@ void CLI::generateQuiz(){
     std::string shuffleInput;
     std::getline(std::cin, shuffleInput);
     bool shuffleQuestions = (shuffleInput == "yes" || shuffleInput == "y");
-    for (int i = 0; i < variantCount; ++i) {
-        std::cout << "Generating variant " << (i + 1) << ":\n";
-        auto quizVariant = std::make_shared<QuizVariant>("Вариант " + std::to_string(i + 1));
-        for (const auto& topicPair : selectedTopics) {
-            auto topic = topicPair.first;
-            int questionCount = topicPair.second;
-            auto questions = db->getQuestionsByTopic(topic);
-            if (questions.size() < static_cast<size_t>(questionCount)) {
-                std::cout << "Warning: Not enough questions in topic '" << topic->name << "' to fulfill the request. Adding all available questions.\n";
-                questionCount = static_cast<int>(questions.size());
-            }
-            std::shuffle(questions.begin(), questions.end(), std::mt19937(std::random_device{}())); 
-            for (int j = 0; j < questionCount; ++j) {
-                quizVariant->addQuestion(questions[j]); 
-            }
-        }
-        if (shuffleQuestions) {
-            quizVariant->shuffleQuestions(); 
+    std::cout << "Prefer rarely used questions? (yes/no): ";
+    std::string weightedInput;
+    std::getline(std::cin, weightedInput);
+    bool weighted = (weightedInput == "yes" || weightedInput == "y");
+    DocumentOptions documentOptions;
+    std::cout << "Compact output with a shared stylesheet? (yes/no): ";
+    std::string compactInput;
+    std::getline(std::cin, compactInput);
+    documentOptions.compact = (compactInput == "yes" || compactInput == "y");
+    if (DocumentWriter::gzipAvailable()) {
+        std::cout << "Also write gzip-compressed copies? (yes/no): ";
+        std::string gzipInput;
+        std::getline(std::cin, gzipInput);
+        documentOptions.gzip = (gzipInput == "yes" || gzipInput == "y");
+    }
+    std::cout << "Enter a seed to reproduce earlier variants (leave empty for a new one): ";
+    std::string seedInput;
+    std::getline(std::cin, seedInput);
+    std::uint64_t seed;
+    try {
+        seed = seedInput.empty() ? RngService::randomSeed() : std::stoull(seedInput);
+    } catch (const std::exception&) {
+        std::cout << "Invalid seed.\n";
+        return;
+    }
+    RngService rng(seed);
+    std::cout << "Using seed " << seed << ".\n";
+    if (documentOptions.compact) {
+        if (!DocumentWriter(documentOptions).writeStylesheet(".")) {
+            std::cout << "Error saving the stylesheet.\n";
+            return;
         }
-        std::cout << "Quiz Variant '" << quizVariant->variantName << "' generated with " << quizVariant->getQuestions().size() << " questions:\n";
-        for (const auto& question : quizVariant->getQuestions()) {
+        std::cout << "Stylesheet saved to " << DocumentWriter::stylesheetName() << ".\n";
+    }
+    PipelineOptions pipelineOptions;
+    pipelineOptions.shuffle = shuffleQuestions;
+    pipelineOptions.weighted = weighted;
+    pipelineOptions.document = documentOptions;
+    auto pathFor = [](std::size_t index) {
+        return "quiz_variant_" + std::to_string(index + 1) + ".html";
+    };
+    // Runs on this thread, in variant order, while later variants are
+    // still being sampled and rendered.
+    auto onWritten = [this](const QuizVariant& quizVariant, const std::string& fileName) {
+        std::cout << "Quiz Variant '" << quizVariant.variantName << "' generated with " << quizVariant.questions.size() << " questions:\n";
+        for (const auto& question : quizVariant.questions) {
             std::cout << "- " << question->questionText << "\n";
             if (question->options) {
                 std::cout << "  Options:\n";
@@ -261,16 +431,28 @@ void CLI::generateQuiz(){
             }
             std::cout << "  Topic: " << question->topic->name << "\n";
         }
-        std::cout << "Variant " << (i + 1) << " generated successfully.\n";
-        std::string fileName = "quiz_variant_" + std::to_string(i + 1) + ".html";
-        try {
-            db->writeExamToDoc(fileName, quizVariant);
-            std::cout << "Quiz variant saved to " << fileName << ".\n";
-        } catch (const std::exception& e) {
-            std::cout << "Error saving quiz variant: " << e.what() << "\n";
+        std::cout << "Quiz variant saved to " << fileName << ".\n";
+        if (archive) {
+            try {
+                std::cout << "Archived as #" << archive->add(quizVariant) << ".\n";
+            } catch (const std::exception& e) {
+                std::cout << "Error archiving quiz variant: " << e.what() << "\n";
+            }
         }
+    };
+    PipelineReport report;
+    try {
+        report = runVariantPipeline(*db, quotas, rng, variantCount, pathFor, pipelineOptions, onWritten);
+    } catch (const std::exception& e) {
+        std::cout << "Error generating quiz variants: " << e.what() << "\n";
+        return;
+    }
+    for (const auto& path : report.failedPaths) {
+        std::cout << "Error saving quiz variant to " << path << ".\n";
+    }
+    if (report.failedPaths.empty()) {
+        std::cout << "All quiz variants generated successfully.\n";
     }
-    std::cout << "All quiz variants generated successfully.\n";
 }
 void CLI::listQuestions(){
     if (selectedTopicIndex < 0 || selectedTopicIndex >= static_cast<int>(db->topics.size())) {
@@ -286,12 +468,240 @@ void CLI::listQuestions(){
 
     std::cout << "Questions in topic '" << db->topics[selectedTopicIndex]->name << "':\n";
     for (size_t i = 0; i < questions.size(); ++i) {
-        std::cout << i << ": " << questions[i]->questionText << "\n";
+        std::cout << i << ": [id " << questions[i]->id << ", used " << questions[i]->usageCount << "x";
+        for (const auto& tag : questions[i]->tags) {
+            std::cout << ", " << tag;
+        }
+        std::cout << "] " << questions[i]->questionText << "\n";
+    }
+}
+
+void CLI::listTags() {
+    auto names = db->tagIndex().tagNames();
+    if (names.empty()) {
+        std::cout << "No tags available.\n";
+        return;
+    }
+    std::cout << "Available tags:\n";
+    for (const auto& name : names) {
+        std::cout << "  " << name << " (" << db->tagIndex().questionCount(name) << ")\n";
+    }
+}
+
+void CLI::mergeFiles() {
+    std::vector<std::string> paths;
+    std::string path;
+    std::cout << "Enter bank file paths, one per line ('done' to finish):\n";
+    while (std::getline(std::cin, path) && path != "done") {
+        if (!path.empty()) {
+            paths.push_back(path);
+        }
     }
+    if (paths.empty()) {
+        std::cout << "No files to merge.\n";
+        return;
+    }
+    try {
+        mergeBanks(*db, paths).dump(std::cout);
+    } catch (const std::exception& e) {
+        std::cout << "Merge failed, the bank is unchanged: " << e.what() << "\n";
+        return;
+    }
+    // New topics are sorted in, which shifts topic indices.
+    selectedTopicIndex = -1;
+}
+
+void CLI::findVariants() {
+    if (!archive) {
+        std::cout << "Variant archive is not available.\n";
+        return;
+    }
+    std::string input;
+    std::cout << "Enter question id: ";
+    std::getline(std::cin, input);
+    QuestionId questionId;
+    try {
+        questionId = std::stoull(input);
+    } catch (const std::exception&) {
+        std::cout << "Invalid question id.\n";
+        return;
+    }
+    auto matches = archive->variantsContaining(questionId);
+    if (matches.empty()) {
+        std::cout << "No archived variants contain question " << questionId << ".\n";
+        return;
+    }
+    std::cout << "Question " << questionId << " appears in " << matches.size() << " archived variant(s):\n";
+    for (std::uint32_t archiveId : matches) {
+        ArchivedVariant entry = archive->get(archiveId);
+        std::cout << "  #" << archiveId << ": " << entry.name;
+        if (entry.seed) {
+            std::cout << " (seed " << *entry.seed << "/" << entry.stream << ")";
+        }
+        std::cout << "\n";
+    }
+}
+
+void CLI::rerenderVariant() {
+    if (!archive) {
+        std::cout << "Variant archive is not available.\n";
+        return;
+    }
+    std::string input;
+    std::cout << "Enter archived variant number (0 to " << static_cast<long long>(archive->size()) - 1 << "): ";
+    std::getline(std::cin, input);
+    std::uint32_t archiveId;
+    try {
+        archiveId = static_cast<std::uint32_t>(std::stoul(input));
+        if (archiveId >= archive->size()) {
+            throw std::out_of_range("archive id");
+        }
+    } catch (const std::exception&) {
+        std::cout << "Invalid archived variant number.\n";
+        return;
+    }
+    std::string fileName = "archived_variant_" + std::to_string(archiveId) + ".html";
+    std::size_t missing = 0;
+    auto quizVariant = archive->restore(archiveId, *db, &missing);
+    if (missing > 0) {
+        std::cout << "Warning: " << missing << " question(s) no longer exist in the bank and were skipped.\n";
+    }
+    try {
+        db->writeExamToDoc(fileName, quizVariant);
+        std::cout << "Archived variant saved to " << fileName << ".\n";
+    } catch (const std::exception& e) {
+        std::cout << "Error saving quiz variant: " << e.what() << "\n";
+    }
+}
+
+void CLI::analyzeVariantOverlap() {
+    if (!archive || archive->size() == 0) {
+        std::cout << "There are no archived variants to compare.\n";
+        return;
+    }
+    std::string input;
+    std::cout << "Enter the first and last archived variant numbers (empty for all " << archive->size() << "): ";
+    std::getline(std::cin, input);
+    std::uint32_t first = 0;
+    std::uint32_t last = static_cast<std::uint32_t>(archive->size() - 1);
+    if (!input.empty()) {
+        std::istringstream range(input);
+        if (!(range >> first >> last) || first > last || last >= archive->size()) {
+            std::cout << "Invalid range.\n";
+            return;
+        }
+    }
+    OverlapOptions options;
+    std::cout << "Flag pairs with a Jaccard similarity above (0-1, empty for " << options.threshold << "): ";
+    std::getline(std::cin, input);
+    if (!input.empty()) {
+        try {
+            options.threshold = std::stod(input);
+        } catch (const std::exception&) {
+            std::cout << "Invalid threshold.\n";
+            return;
+        }
+    }
+    std::vector<std::vector<QuestionId>> questionIds;
+    std::vector<std::string> names;
+    for (std::uint32_t archiveId = first; archiveId <= last; ++archiveId) {
+        ArchivedVariant entry = archive->get(archiveId);
+        questionIds.push_back(std::move(entry.questionIds));
+        names.push_back("#" + std::to_string(archiveId) + " " + entry.name);
+    }
+    analyzeOverlap(questionIds, options).dump(std::cout, names);
+}
+
+void CLI::findNearDuplicateQuestions() {
+    NearDuplicateOptions options;
+    std::string input;
+    std::cout << "Minimum similarity (0-1, empty for " << options.threshold << "): ";
+    std::getline(std::cin, input);
+    if (!input.empty()) {
+        try {
+            options.threshold = std::stod(input);
+        } catch (const std::exception&) {
+            std::cout << "Invalid similarity.\n";
+            return;
+        }
+    }
+    findNearDuplicates(db->getAllQuestions(), options).dump(std::cout);
+}
+
+void CLI::gradeResponseFile() {
+    if (!archive || archive->size() == 0) {
+        std::cout << "There are no archived variants to grade against.\n";
+        return;
+    }
+    std::string responsesPath;
+    std::string totalsPath;
+    std::string itemsPath;
+    std::cout << "Enter the responses file (CSV or binary): ";
+    std::getline(std::cin, responsesPath);
+    std::cout << "Enter the file for per-student totals (empty for grades.csv): ";
+    std::getline(std::cin, totalsPath);
+    std::cout << "Enter the file for per-question results (empty to skip): ";
+    std::getline(std::cin, itemsPath);
+    if (totalsPath.empty()) {
+        totalsPath = "grades.csv";
+    }
+    std::ifstream responses(responsesPath, std::ios::binary);
+    if (!responses) {
+        std::cout << "Could not open " << responsesPath << ".\n";
+        return;
+    }
+    std::ofstream totals(totalsPath, std::ios::binary);
+    std::ofstream items;
+    if (!itemsPath.empty()) {
+        items.open(itemsPath, std::ios::binary);
+    }
+    if (!totals || (!itemsPath.empty() && !items)) {
+        std::cout << "Could not create the output files.\n";
+        return;
+    }
+    AnswerKeys keys(*archive, *db);
+    GradingReport report = gradeResponses(responses, keys, totals, itemsPath.empty() ? nullptr : &items);
+    report.dump(std::cout);
+    std::cout << "Totals written to " << totalsPath;
+    if (!itemsPath.empty()) {
+        std::cout << ", per-question results to " << itemsPath;
+    }
+    std::cout << ".\n";
+}
+
+void CLI::analyzeItemResults() {
+    std::string itemsPath;
+    std::cout << "Enter the per-question results file (see grade): ";
+    std::getline(std::cin, itemsPath);
+    std::ifstream items(itemsPath, std::ios::binary);
+    if (!items) {
+        std::cout << "Could not open " << itemsPath << ".\n";
+        return;
+    }
+    ItemAnalysis analysis = analyzeItems(items);
+    ItemTagOptions options;
+    analysis.dump(std::cout, 20, options.minResponses);
+    if (analysis.statistics.items().empty()) {
+        return;
+    }
+    std::string answer;
+    std::cout << "Tag questions with at least " << options.minResponses << " responses with their difficulty and discrimination? (y/n): ";
+    std::getline(std::cin, answer);
+    if (answer == "y" || answer == "Y") {
+        std::size_t retagged = tagItemStatistics(*db, analysis.statistics, options);
+        std::cout << retagged << " question(s) retagged.\n";
+    }
+}
+
+void CLI::showStats() {
+    PerfStats::instance().dump(std::cout);
+}
+
+void CLI::showMemory() {
+    MemoryStats::instance().dump(std::cout);
 }
 
 void CLI::exit() {
     std::cout << "Exiting the application.\n";
-    db->writeQuestionsToFile("db.txt");
-    std::exit(0);
+    running = false;
 }
\ No newline at end of file
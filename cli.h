@@ -3,15 +3,34 @@
 #include <string>
 #include <vector>
 #include "logic/quiz.h"
+#include "logic/loader.h"
+#include "logic/archive.h"
+#include "logic/merge.h"
+#include "logic/watcher.h"
 class CLI {
     private:
         std::shared_ptr<QuestionDatabase> db;
+        std::shared_ptr<BankLoader> loader;
+        std::shared_ptr<VariantArchive> archive;
+        std::shared_ptr<BankWatcher> watcher;
+        bool running = true;
+        bool loadFailed = false;
     public:
         CLI(std::shared_ptr<QuestionDatabase> database);
+        // Commands that touch the bank wait for this loader before running.
+        void setLoader(std::shared_ptr<BankLoader> bankLoader);
+        // Generated variants are recorded here when set.
+        void setArchive(std::shared_ptr<VariantArchive> variantArchive);
+        // Changes it reports are applied before the next command runs.
+        void setWatcher(std::shared_ptr<BankWatcher> bankWatcher);
+        // Returns after 'exit' or end of input, with any pending load merged.
         void run();
+        bool bankLoadFailed() const { return loadFailed; }
         void processCommand(const std::string& command);
         int selectedTopicIndex = -1; // Index of the currently selected topic, -1 means no topic is selected
     private:
+        void ensureLoaded();
+        void reloadIfChanged();
         void showHelp();
         void addTopic();
         void removeTopic();
@@ -21,5 +40,15 @@ class CLI {
         void removeQuestion();
         void generateQuiz();
         void listQuestions();
+        void listTags();
+        void mergeFiles();
+        void showStats();
+        void showMemory();
+        void findVariants();
+        void rerenderVariant();
+        void analyzeVariantOverlap();
+        void findNearDuplicateQuestions();
+        void gradeResponseFile();
+        void analyzeItemResults();
         void exit();
 };
\ No newline at end of file
@@ -0,0 +1,14 @@
+#include "startup.h"
+#include "logic/stats.h"
+
+// Headless entry point: links only quizcore, so no Qt libraries are loaded.
+int main(int argc, char *argv[]) {
+    PerfStats::processStartTime();
+    AppOptions options = parseAppOptions(argc, argv);
+    options.useGui = false;
+    installExitReporters(options);
+    if (!options.socketPath.empty()) {
+        return runDaemon(options);
+    }
+    return runHeadless(options);
+}
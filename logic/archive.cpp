@@ -0,0 +1,255 @@
+#include "archive.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+static const char kArchiveMagic[] = "MXARCH1\n";
+static const std::size_t kArchiveMagicSize = sizeof(kArchiveMagic) - 1;
+
+static void putVarint(std::vector<std::uint8_t>& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+// Returns false if the buffer ends before the varint does.
+static bool getVarint(const std::uint8_t*& p, const std::uint8_t* end, std::uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        std::uint8_t byte = *p++;
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::uint64_t zigzag(std::int64_t value) {
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+static std::int64_t unzigzag(std::uint64_t value) {
+    return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+VariantArchive::VariantArchive(const std::string& filePath) : filePath(filePath) {
+    load();
+}
+
+void VariantArchive::load() {
+    std::ifstream in(filePath, std::ios::binary);
+    if (!in) {
+        return;
+    }
+    std::vector<std::uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    if (data.empty()) {
+        return;
+    }
+    if (data.size() < kArchiveMagicSize || !std::equal(kArchiveMagic, kArchiveMagic + kArchiveMagicSize, data.begin())) {
+        throw std::runtime_error("Not a variant archive: " + filePath);
+    }
+
+    const std::uint8_t* p = data.data() + kArchiveMagicSize;
+    const std::uint8_t* end = data.data() + data.size();
+    const std::uint8_t* lastGood = p;
+    while (p < end) {
+        std::uint64_t length;
+        if (!getVarint(p, end, length) || length > static_cast<std::uint64_t>(end - p)) {
+            break;
+        }
+        const std::uint8_t* record = p;
+        const std::uint8_t* recordEnd = p + length;
+        p = recordEnd;
+
+        std::uint64_t createdAt, flags, seed = 0, stream, nameLength, count;
+        bool ok = getVarint(record, recordEnd, createdAt) && getVarint(record, recordEnd, flags);
+        if (ok && (flags & 1)) {
+            ok = getVarint(record, recordEnd, seed);
+        }
+        ok = ok && getVarint(record, recordEnd, stream) && getVarint(record, recordEnd, nameLength)
+                && nameLength <= static_cast<std::uint64_t>(recordEnd - record);
+        if (!ok) {
+            throw std::runtime_error("Corrupt variant archive record in " + filePath);
+        }
+        std::string name(reinterpret_cast<const char*>(record), nameLength);
+        record += nameLength;
+        if (!getVarint(record, recordEnd, count)) {
+            throw std::runtime_error("Corrupt variant archive record in " + filePath);
+        }
+
+        std::vector<QuestionId> ids;
+        ids.reserve(count);
+        std::int64_t previous = 0;
+        for (std::uint64_t i = 0; i < count; ++i) {
+            std::uint64_t delta;
+            if (!getVarint(record, recordEnd, delta)) {
+                throw std::runtime_error("Corrupt variant archive record in " + filePath);
+            }
+            previous += unzigzag(delta);
+            ids.push_back(static_cast<QuestionId>(previous));
+        }
+
+        Entry entry{name, unzigzag(createdAt), std::nullopt, stream,
+                    static_cast<std::uint32_t>(questionBytes.size()), static_cast<std::uint32_t>(count)};
+        if (flags & 1) {
+            entry.seed = seed;
+        }
+        entries.push_back(entry);
+        index(static_cast<std::uint32_t>(entries.size() - 1), ids);
+        lastGood = p;
+    }
+
+    // A crash mid-append leaves a partial record; drop it so appends stay aligned.
+    if (lastGood != end) {
+        std::error_code error;
+        std::filesystem::resize_file(filePath, static_cast<std::uintmax_t>(lastGood - data.data()), error);
+    }
+}
+
+void VariantArchive::index(std::uint32_t archiveId, const std::vector<QuestionId>& questionIds) {
+    std::int64_t previous = 0;
+    for (QuestionId id : questionIds) {
+        putVarint(questionBytes, zigzag(static_cast<std::int64_t>(id) - previous));
+        previous = static_cast<std::int64_t>(id);
+
+        Postings& list = postings[id];
+        // Archive ids only grow, so postings are sorted; a variant listing the
+        // same question twice is recorded once.
+        if (!list.deltas.empty() && list.last == archiveId) {
+            continue;
+        }
+        putVarint(list.deltas, list.deltas.empty() ? archiveId : archiveId - list.last);
+        list.last = archiveId;
+    }
+}
+
+void VariantArchive::appendToFile(const std::vector<std::uint8_t>& record) {
+    bool isNew = !std::filesystem::exists(filePath) || std::filesystem::file_size(filePath) == 0;
+    std::ofstream out(filePath, std::ios::binary | std::ios::app);
+    if (!out) {
+        throw std::runtime_error("Could not open variant archive: " + filePath);
+    }
+    if (isNew) {
+        out.write(kArchiveMagic, kArchiveMagicSize);
+    }
+    std::vector<std::uint8_t> length;
+    putVarint(length, record.size());
+    out.write(reinterpret_cast<const char*>(length.data()), length.size());
+    out.write(reinterpret_cast<const char*>(record.data()), record.size());
+    out.flush();
+    if (!out) {
+        throw std::runtime_error("Could not write variant archive: " + filePath);
+    }
+}
+
+std::uint32_t VariantArchive::add(const QuizVariant& variant) {
+    std::vector<QuestionId> ids;
+    ids.reserve(variant.questions.size());
+    for (const auto& question : variant.questions) {
+        ids.push_back(question->id);
+    }
+    std::int64_t createdAt = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::vector<std::uint8_t> record;
+    putVarint(record, zigzag(createdAt));
+    putVarint(record, variant.seed ? 1 : 0);
+    if (variant.seed) {
+        putVarint(record, *variant.seed);
+    }
+    putVarint(record, variant.stream);
+    putVarint(record, variant.variantName.size());
+    record.insert(record.end(), variant.variantName.begin(), variant.variantName.end());
+    putVarint(record, ids.size());
+    std::int64_t previous = 0;
+    for (QuestionId id : ids) {
+        putVarint(record, zigzag(static_cast<std::int64_t>(id) - previous));
+        previous = static_cast<std::int64_t>(id);
+    }
+    appendToFile(record);
+
+    entries.push_back(Entry{variant.variantName, createdAt, variant.seed, variant.stream,
+                            static_cast<std::uint32_t>(questionBytes.size()), static_cast<std::uint32_t>(ids.size())});
+    std::uint32_t archiveId = static_cast<std::uint32_t>(entries.size() - 1);
+    index(archiveId, ids);
+    return archiveId;
+}
+
+ArchivedVariant VariantArchive::get(std::uint32_t archiveId) const {
+    if (archiveId >= entries.size()) {
+        throw std::out_of_range("No archived variant with id " + std::to_string(archiveId));
+    }
+    const Entry& entry = entries[archiveId];
+    ArchivedVariant result;
+    result.archiveId = archiveId;
+    result.name = entry.name;
+    result.createdAt = entry.createdAt;
+    result.seed = entry.seed;
+    result.stream = entry.stream;
+    result.questionIds.reserve(entry.count);
+
+    const std::uint8_t* p = questionBytes.data() + entry.offset;
+    const std::uint8_t* end = questionBytes.data() + questionBytes.size();
+    std::int64_t previous = 0;
+    for (std::uint32_t i = 0; i < entry.count; ++i) {
+        std::uint64_t delta;
+        getVarint(p, end, delta);
+        previous += unzigzag(delta);
+        result.questionIds.push_back(static_cast<QuestionId>(previous));
+    }
+    return result;
+}
+
+std::vector<std::uint32_t> VariantArchive::variantsContaining(QuestionId questionId) const {
+    std::vector<std::uint32_t> result;
+    auto it = postings.find(questionId);
+    if (it == postings.end()) {
+        return result;
+    }
+    const auto& deltas = it->second.deltas;
+    const std::uint8_t* p = deltas.data();
+    const std::uint8_t* end = p + deltas.size();
+    std::uint64_t current = 0;
+    std::uint64_t delta;
+    while (p < end && getVarint(p, end, delta)) {
+        current = result.empty() ? delta : current + delta;
+        result.push_back(static_cast<std::uint32_t>(current));
+    }
+    return result;
+}
+
+std::shared_ptr<QuizVariant> VariantArchive::restore(std::uint32_t archiveId, const QuestionDatabase& db, std::size_t* missing) const {
+    ArchivedVariant archived = get(archiveId);
+    auto variant = std::make_shared<QuizVariant>(archived.name);
+    variant->seed = archived.seed;
+    variant->stream = archived.stream;
+    std::size_t missingCount = 0;
+    for (QuestionId id : archived.questionIds) {
+        if (auto question = db.findQuestionById(id)) {
+            variant->addQuestion(question);
+        } else {
+            ++missingCount;
+        }
+    }
+    if (missing) {
+        *missing = missingCount;
+    }
+    return variant;
+}
+
+std::size_t VariantArchive::memoryBytes() const {
+    std::size_t bytes = entries.capacity() * sizeof(Entry) + questionBytes.capacity();
+    for (const auto& entry : entries) {
+        bytes += entry.name.capacity();
+    }
+    for (const auto& list : postings) {
+        bytes += sizeof(list) + list.second.deltas.capacity() + sizeof(void*);
+    }
+    return bytes;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "quiz.h"
+
+struct ArchivedVariant {
+    std::uint32_t archiveId = 0;
+    std::string name;
+    std::int64_t createdAt = 0;
+    std::optional<std::uint64_t> seed;
+    std::uint64_t stream = 0;
+    std::vector<QuestionId> questionIds;
+};
+
+// Append-only store of every generated variant. Question ids are kept in
+// order as zigzag-varint deltas in one shared byte buffer, and an inverted
+// index (also delta-varint) maps each question to the variants using it.
+class VariantArchive {
+public:
+    // Loads the archive at filePath if it exists; new entries are appended.
+    explicit VariantArchive(const std::string& filePath);
+
+    std::uint32_t add(const QuizVariant& variant);
+    std::size_t size() const { return entries.size(); }
+    ArchivedVariant get(std::uint32_t archiveId) const;
+    std::vector<std::uint32_t> variantsContaining(QuestionId questionId) const;
+    // Rebuilds the variant from the bank's current question texts. Questions
+    // deleted since are skipped and counted in `missing`.
+    std::shared_ptr<QuizVariant> restore(std::uint32_t archiveId, const QuestionDatabase& db, std::size_t* missing = nullptr) const;
+    std::size_t memoryBytes() const;
+
+private:
+    struct Entry {
+        std::string name;
+        std::int64_t createdAt;
+        std::optional<std::uint64_t> seed;
+        std::uint64_t stream;
+        std::uint32_t offset;
+        std::uint32_t count;
+    };
+
+    struct Postings {
+        std::vector<std::uint8_t> deltas;
+        std::uint32_t last = 0;
+    };
+
+    void index(std::uint32_t archiveId, const std::vector<QuestionId>& questionIds);
+    void load();
+    void appendToFile(const std::vector<std::uint8_t>& record);
+
+    std::string filePath;
+    std::vector<Entry> entries;
+    std::vector<std::uint8_t> questionBytes;
+    std::unordered_map<QuestionId, Postings> postings;
+};
@@ -0,0 +1,43 @@
+#include "bankformat.h"
+#include <algorithm>
+#include <stdexcept>
+
+std::string escapeField(std::string_view value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        switch (c) {
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            default: escaped += c;
+        }
+    }
+    return escaped;
+}
+
+std::string unescapeField(const std::string& value) {
+    std::string unescaped;
+    unescaped.reserve(value.size());
+    for (std::size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == '\\' && i + 1 < value.size()) {
+            char next = value[++i];
+            unescaped += next == 'n' ? '\n' : next == 'r' ? '\r' : next;
+        } else {
+            unescaped += value[i];
+        }
+    }
+    return unescaped;
+}
+
+std::string readField(std::istream& in, int version) {
+    std::string line;
+    if (!std::getline(in, line)) {
+        throw std::runtime_error("Unexpected end of question bank file");
+    }
+    return version >= 2 ? unescapeField(line) : line;
+}
+
+std::size_t plausibleSlotCount(std::size_t questions) {
+    return std::min(kMaxSlots, std::max<std::size_t>(questions, 1 << 12) * 16);
+}
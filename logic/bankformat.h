@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+
+// Line-level helpers shared by the bank and segment manifest formats. From
+// format 2 on, backslashes and line breaks are escaped so that every field
+// stays on one line.
+std::string escapeField(std::string_view value);
+std::string unescapeField(const std::string& value);
+// Reads one line, unescaping it for format 2 and later; throws at end of input.
+std::string readField(std::istream& in, int version);
+
+// Slot tables are never grown past this many slots, whatever a file says.
+constexpr std::size_t kMaxSlots = std::size_t(1) << 26;
+// Largest slot count a bank or manifest holding `questions` questions may
+// claim. Removed questions leave their slots behind, hence the headroom; a
+// larger count is taken to be corrupt and is not reserved.
+std::size_t plausibleSlotCount(std::size_t questions);
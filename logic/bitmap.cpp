@@ -0,0 +1,290 @@
+#include "bitmap.h"
+#include <algorithm>
+#include <iterator>
+#include "bits.h"
+
+bool RoaringBitmap::Container::contains(std::uint16_t low) const {
+    if (isBitset()) {
+        return (bits[low >> 6] >> (low & 63)) & 1;
+    }
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+void RoaringBitmap::Container::add(std::uint16_t low) {
+    if (isBitset()) {
+        std::uint64_t mask = 1ULL << (low & 63);
+        if (!(bits[low >> 6] & mask)) {
+            bits[low >> 6] |= mask;
+            ++cardinality;
+        }
+        return;
+    }
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it != array.end() && *it == low) {
+        return;
+    }
+    array.insert(it, low);
+    ++cardinality;
+    if (cardinality > kArrayMax) {
+        toBitset();
+    }
+}
+
+void RoaringBitmap::Container::remove(std::uint16_t low) {
+    if (isBitset()) {
+        std::uint64_t mask = 1ULL << (low & 63);
+        if (bits[low >> 6] & mask) {
+            bits[low >> 6] &= ~mask;
+            --cardinality;
+            normalize();
+        }
+        return;
+    }
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it != array.end() && *it == low) {
+        array.erase(it);
+        --cardinality;
+    }
+}
+
+void RoaringBitmap::Container::toBitset() {
+    bits.assign(kBitsetWords, 0);
+    for (std::uint16_t low : array) {
+        bits[low >> 6] |= 1ULL << (low & 63);
+    }
+    array.clear();
+    array.shrink_to_fit();
+}
+
+void RoaringBitmap::Container::normalize() {
+    if (isBitset() && cardinality <= kArrayMax) {
+        array.clear();
+        array.reserve(cardinality);
+        for (std::size_t word = 0; word < kBitsetWords; ++word) {
+            std::uint64_t w = bits[word];
+            while (w) {
+                array.push_back(static_cast<std::uint16_t>(word * 64 + lowestBit(w)));
+                w &= w - 1;
+            }
+        }
+        bits.clear();
+        bits.shrink_to_fit();
+    } else if (!isBitset() && cardinality > kArrayMax) {
+        toBitset();
+    }
+}
+
+RoaringBitmap::Container RoaringBitmap::intersect(const Container& a, const Container& b) {
+    Container result;
+    if (a.isBitset() && b.isBitset()) {
+        result.bits.resize(kBitsetWords);
+        for (std::size_t i = 0; i < kBitsetWords; ++i) {
+            result.bits[i] = a.bits[i] & b.bits[i];
+            result.cardinality += popCount(result.bits[i]);
+        }
+        result.normalize();
+    } else if (a.isBitset() || b.isBitset()) {
+        const Container& sparse = a.isBitset() ? b : a;
+        const Container& dense = a.isBitset() ? a : b;
+        for (std::uint16_t low : sparse.array) {
+            if (dense.contains(low)) {
+                result.array.push_back(low);
+            }
+        }
+        result.cardinality = static_cast<std::uint32_t>(result.array.size());
+    } else {
+        std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                              std::back_inserter(result.array));
+        result.cardinality = static_cast<std::uint32_t>(result.array.size());
+    }
+    return result;
+}
+
+RoaringBitmap::Container RoaringBitmap::unite(const Container& a, const Container& b) {
+    Container result;
+    if (a.isBitset() || b.isBitset()) {
+        const Container& dense = a.isBitset() ? a : b;
+        const Container& other = a.isBitset() ? b : a;
+        result.bits = dense.bits;
+        if (other.isBitset()) {
+            for (std::size_t i = 0; i < kBitsetWords; ++i) {
+                result.bits[i] |= other.bits[i];
+            }
+        } else {
+            for (std::uint16_t low : other.array) {
+                result.bits[low >> 6] |= 1ULL << (low & 63);
+            }
+        }
+        for (std::uint64_t word : result.bits) {
+            result.cardinality += popCount(word);
+        }
+    } else {
+        result.array.reserve(a.array.size() + b.array.size());
+        std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                       std::back_inserter(result.array));
+        result.cardinality = static_cast<std::uint32_t>(result.array.size());
+        result.normalize();
+    }
+    return result;
+}
+
+RoaringBitmap::Container RoaringBitmap::subtract(const Container& a, const Container& b) {
+    Container result;
+    if (!a.isBitset()) {
+        for (std::uint16_t low : a.array) {
+            if (!b.contains(low)) {
+                result.array.push_back(low);
+            }
+        }
+        result.cardinality = static_cast<std::uint32_t>(result.array.size());
+        return result;
+    }
+    result.bits = a.bits;
+    if (b.isBitset()) {
+        for (std::size_t i = 0; i < kBitsetWords; ++i) {
+            result.bits[i] &= ~b.bits[i];
+        }
+    } else {
+        for (std::uint16_t low : b.array) {
+            result.bits[low >> 6] &= ~(1ULL << (low & 63));
+        }
+    }
+    for (std::uint64_t word : result.bits) {
+        result.cardinality += popCount(word);
+    }
+    result.normalize();
+    return result;
+}
+
+std::size_t RoaringBitmap::find(std::uint16_t key) const {
+    auto it = std::lower_bound(keys.begin(), keys.end(), key);
+    return static_cast<std::size_t>(it - keys.begin());
+}
+
+void RoaringBitmap::add(std::uint32_t value) {
+    std::uint16_t key = static_cast<std::uint16_t>(value >> 16);
+    std::size_t i = find(key);
+    if (i == keys.size() || keys[i] != key) {
+        keys.insert(keys.begin() + i, key);
+        containers.insert(containers.begin() + i, Container());
+    }
+    containers[i].add(static_cast<std::uint16_t>(value));
+}
+
+void RoaringBitmap::remove(std::uint32_t value) {
+    std::uint16_t key = static_cast<std::uint16_t>(value >> 16);
+    std::size_t i = find(key);
+    if (i == keys.size() || keys[i] != key) {
+        return;
+    }
+    containers[i].remove(static_cast<std::uint16_t>(value));
+    if (containers[i].cardinality == 0) {
+        keys.erase(keys.begin() + i);
+        containers.erase(containers.begin() + i);
+    }
+}
+
+bool RoaringBitmap::contains(std::uint32_t value) const {
+    std::uint16_t key = static_cast<std::uint16_t>(value >> 16);
+    std::size_t i = find(key);
+    return i < keys.size() && keys[i] == key && containers[i].contains(static_cast<std::uint16_t>(value));
+}
+
+std::uint64_t RoaringBitmap::cardinality() const {
+    std::uint64_t total = 0;
+    for (const auto& container : containers) {
+        total += container.cardinality;
+    }
+    return total;
+}
+
+std::vector<std::uint32_t> RoaringBitmap::toVector() const {
+    std::vector<std::uint32_t> values;
+    values.reserve(cardinality());
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        std::uint32_t high = static_cast<std::uint32_t>(keys[i]) << 16;
+        const Container& container = containers[i];
+        if (container.isBitset()) {
+            for (std::size_t word = 0; word < kBitsetWords; ++word) {
+                std::uint64_t w = container.bits[word];
+                while (w) {
+                    values.push_back(high | static_cast<std::uint32_t>(word * 64 + lowestBit(w)));
+                    w &= w - 1;
+                }
+            }
+        } else {
+            for (std::uint16_t low : container.array) {
+                values.push_back(high | low);
+            }
+        }
+    }
+    return values;
+}
+
+std::size_t RoaringBitmap::memoryBytes() const {
+    std::size_t bytes = keys.capacity() * sizeof(std::uint16_t) + containers.capacity() * sizeof(Container);
+    for (const auto& container : containers) {
+        bytes += container.array.capacity() * sizeof(std::uint16_t) + container.bits.capacity() * sizeof(std::uint64_t);
+    }
+    return bytes;
+}
+
+RoaringBitmap RoaringBitmap::operator&(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    std::size_t i = 0, j = 0;
+    while (i < keys.size() && j < other.keys.size()) {
+        if (keys[i] < other.keys[j]) {
+            ++i;
+        } else if (keys[i] > other.keys[j]) {
+            ++j;
+        } else {
+            Container merged = intersect(containers[i], other.containers[j]);
+            if (merged.cardinality > 0) {
+                result.keys.push_back(keys[i]);
+                result.containers.push_back(std::move(merged));
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator|(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    std::size_t i = 0, j = 0;
+    while (i < keys.size() || j < other.keys.size()) {
+        if (j == other.keys.size() || (i < keys.size() && keys[i] < other.keys[j])) {
+            result.keys.push_back(keys[i]);
+            result.containers.push_back(containers[i++]);
+        } else if (i == keys.size() || other.keys[j] < keys[i]) {
+            result.keys.push_back(other.keys[j]);
+            result.containers.push_back(other.containers[j++]);
+        } else {
+            result.keys.push_back(keys[i]);
+            result.containers.push_back(unite(containers[i++], other.containers[j++]));
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::andNot(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    std::size_t j = 0;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        while (j < other.keys.size() && other.keys[j] < keys[i]) {
+            ++j;
+        }
+        if (j < other.keys.size() && other.keys[j] == keys[i]) {
+            Container remaining = subtract(containers[i], other.containers[j]);
+            if (remaining.cardinality > 0) {
+                result.keys.push_back(keys[i]);
+                result.containers.push_back(std::move(remaining));
+            }
+        } else {
+            result.keys.push_back(keys[i]);
+            result.containers.push_back(containers[i]);
+        }
+    }
+    return result;
+}
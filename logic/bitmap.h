@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Compressed bitmap of 32-bit values in the style of Roaring: values are
+// split by their high 16 bits into containers that are either a sorted array
+// (sparse, up to 4096 values) or a 65536-bit bitset (dense).
+class RoaringBitmap {
+public:
+    void add(std::uint32_t value);
+    void remove(std::uint32_t value);
+    bool contains(std::uint32_t value) const;
+    std::uint64_t cardinality() const;
+    bool empty() const { return keys.empty(); }
+    std::vector<std::uint32_t> toVector() const;
+    std::size_t memoryBytes() const;
+
+    RoaringBitmap operator&(const RoaringBitmap& other) const;
+    RoaringBitmap operator|(const RoaringBitmap& other) const;
+    RoaringBitmap andNot(const RoaringBitmap& other) const;
+
+private:
+    static constexpr std::uint32_t kArrayMax = 4096;
+    static constexpr std::size_t kBitsetWords = 1024;
+
+    struct Container {
+        std::vector<std::uint16_t> array;
+        std::vector<std::uint64_t> bits;
+        std::uint32_t cardinality = 0;
+
+        bool isBitset() const { return !bits.empty(); }
+        bool contains(std::uint16_t low) const;
+        void add(std::uint16_t low);
+        void remove(std::uint16_t low);
+        void toBitset();
+        // Switches to whichever representation suits the cardinality.
+        void normalize();
+    };
+
+    static Container intersect(const Container& a, const Container& b);
+    static Container unite(const Container& a, const Container& b);
+    static Container subtract(const Container& a, const Container& b);
+
+    std::size_t find(std::uint16_t key) const;
+
+    std::vector<std::uint16_t> keys;
+    std::vector<Container> containers;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#if defined(_MSC_VER) && !defined(__GNUC__)
+#include <intrin.h>
+#endif
+
+// Bit scans and population count on GCC/Clang builtins, with MSVC intrinsics
+// or plain code elsewhere. None of them need instructions beyond the
+// baseline of the target.
+
+// Index of the highest set bit; `x` must not be 0.
+inline int highestBit(std::uint64_t x) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(x);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return static_cast<int>(index);
+#else
+    int index = 0;
+    while (x >>= 1) {
+        ++index;
+    }
+    return index;
+#endif
+}
+
+// Index of the lowest set bit; `x` must not be 0.
+inline int lowestBit(std::uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return static_cast<int>(index);
+#else
+    int index = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        ++index;
+    }
+    return index;
+#endif
+}
+
+inline int popCount(std::uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    // MSVC's __popcnt64 needs the POPCNT instruction, so count in parallel.
+    x -= (x >> 1) & 0x5555555555555555ULL;
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return static_cast<int>((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
@@ -0,0 +1,465 @@
+#include "daemon.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "docwriter.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "watcher.h"
+
+// Larger requests are a client bug, not a spec; the connection is dropped.
+static const std::uint32_t kMaxRequestBytes = 1 << 20;
+// Bounds the memory held by pools of specs that are not asked for again.
+static const std::size_t kMaxCachedSpecs = 256;
+// Replies a client has not read yet; past this it is dropped as stalled.
+static const std::size_t kMaxUnsentBytes = 64 << 20;
+
+struct GenerationServer::Connection {
+    int fd;
+    // Only touched by the I/O thread.
+    std::string inbox;
+    bool readClosed = false;
+    // Guarded by GenerationServer::outputMutex. Replies are queued here by
+    // the worker and sent by the I/O thread as the socket takes them.
+    std::string outbox;
+    std::size_t unanswered = 0;
+    bool dropped = false;
+
+    explicit Connection(int socketFd) : fd(socketFd) {}
+    ~Connection() { close(fd); }
+};
+
+static bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static bool writeAll(int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+static bool readAll(int fd, char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t got = read(fd, data, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        data += got;
+        size -= static_cast<std::size_t>(got);
+    }
+    return true;
+}
+
+static void appendFrame(std::string& out, const std::string& payload) {
+    std::uint32_t size = static_cast<std::uint32_t>(payload.size());
+    for (int i = 0; i < 4; ++i) {
+        out += static_cast<char>((size >> (8 * i)) & 0xff);
+    }
+    out += payload;
+}
+
+static std::uint32_t frameLength(const char* header) {
+    std::uint32_t size = 0;
+    for (int i = 0; i < 4; ++i) {
+        size |= static_cast<std::uint32_t>(static_cast<unsigned char>(header[i])) << (8 * i);
+    }
+    return size;
+}
+
+bool writeFrame(int fd, const std::string& payload) {
+    std::string frame;
+    frame.reserve(payload.size() + 4);
+    appendFrame(frame, payload);
+    return writeAll(fd, frame.data(), frame.size());
+}
+
+bool readFrame(int fd, std::string& payload) {
+    char header[4];
+    if (!readAll(fd, header, sizeof(header))) {
+        return false;
+    }
+    payload.resize(frameLength(header));
+    return readAll(fd, payload.data(), payload.size());
+}
+
+GenerationServer::GenerationServer(std::shared_ptr<QuestionDatabase> database, const std::string& path)
+    : db(std::move(database)), bankPath(path) {
+    if (pipe(wakeFds) != 0) {
+        throw std::runtime_error("Could not create the daemon's wake-up pipe");
+    }
+    // Wake-ups are drained without blocking, and coalesce once the pipe is full.
+    setNonBlocking(wakeFds[0]);
+    setNonBlocking(wakeFds[1]);
+}
+
+GenerationServer::~GenerationServer() {
+    close(wakeFds[0]);
+    close(wakeFds[1]);
+}
+
+void GenerationServer::stop() {
+    stopping = true;
+    wake();
+}
+
+void GenerationServer::wake() {
+    char byte = 0;
+    while (write(wakeFds[1], &byte, 1) < 0 && errno == EINTR) {
+    }
+}
+
+void GenerationServer::run(const std::string& socketPath) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path is too long: " + socketPath);
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        throw std::runtime_error("Could not create a Unix socket");
+    }
+    // A socket file left by a daemon that died is replaced; anything else is
+    // not ours to remove.
+    struct stat existing;
+    if (lstat(socketPath.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(socketPath.c_str());
+    }
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenFd, 64) != 0) {
+        std::string reason = std::strerror(errno);
+        close(listenFd);
+        throw std::runtime_error("Could not listen on " + socketPath + ": " + reason);
+    }
+
+    std::thread worker([this]() { processBatches(); });
+    serveConnections(listenFd);
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        finished = true;
+    }
+    queueReady.notify_one();
+    worker.join();
+    close(listenFd);
+    unlink(socketPath.c_str());
+}
+
+void GenerationServer::serveConnections(int listenFd) {
+    Tracer::instance().setThreadName("daemon-io");
+    std::unordered_map<int, std::shared_ptr<Connection>> connections;
+    std::vector<pollfd> fds;
+    char buffer[64 * 1024];
+    while (!stopping) {
+        fds.clear();
+        fds.push_back({wakeFds[0], POLLIN, 0});
+        fds.push_back({listenFd, POLLIN, 0});
+        {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            for (auto it = connections.begin(); it != connections.end();) {
+                Connection& connection = *it->second;
+                // A client that stopped sending is kept until it has its replies.
+                if (connection.dropped || (connection.readClosed && connection.unanswered == 0 && connection.outbox.empty())) {
+                    it = connections.erase(it);
+                    continue;
+                }
+                short events = static_cast<short>((connection.readClosed ? 0 : POLLIN) | (connection.outbox.empty() ? 0 : POLLOUT));
+                if (events) {
+                    fds.push_back({it->first, events, 0});
+                }
+                ++it;
+            }
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents) {
+            // Either stop() or the worker queued replies.
+            while (read(wakeFds[0], buffer, sizeof(buffer)) > 0) {
+            }
+            if (stopping) {
+                break;
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            int clientFd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (clientFd >= 0) {
+                if (setNonBlocking(clientFd)) {
+                    connections[clientFd] = std::make_shared<Connection>(clientFd);
+                } else {
+                    close(clientFd);
+                }
+            }
+        }
+        std::vector<Request> received;
+        for (std::size_t i = 2; i < fds.size(); ++i) {
+            auto connection = connections[fds[i].fd];
+            if (fds[i].revents & (POLLOUT | POLLERR | POLLHUP)) {
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::size_t sent = 0;
+                while (sent < connection->outbox.size()) {
+                    ssize_t written = send(connection->fd, connection->outbox.data() + sent, connection->outbox.size() - sent, MSG_NOSIGNAL);
+                    if (written < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (written < 0) {
+                        // A client that went away just misses its replies.
+                        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                            connection->dropped = true;
+                        }
+                        break;
+                    }
+                    sent += static_cast<std::size_t>(written);
+                }
+                connection->outbox.erase(0, sent);
+            }
+            if (!(fds[i].events & POLLIN) || !(fds[i].revents & (POLLIN | POLLERR | POLLHUP))) {
+                continue;
+            }
+            ssize_t got = read(connection->fd, buffer, sizeof(buffer));
+            if (got < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+                continue;
+            }
+            if (got <= 0) {
+                connection->readClosed = true;
+                continue;
+            }
+            connection->inbox.append(buffer, static_cast<std::size_t>(got));
+            std::size_t offset = 0;
+            std::size_t framed = 0;
+            while (connection->inbox.size() - offset >= 4) {
+                std::uint32_t size = frameLength(connection->inbox.data() + offset);
+                if (size > kMaxRequestBytes) {
+                    std::lock_guard<std::mutex> lock(outputMutex);
+                    connection->dropped = true;
+                    break;
+                }
+                if (connection->inbox.size() - offset - 4 < size) {
+                    break;
+                }
+                received.push_back({connection, connection->inbox.substr(offset + 4, size)});
+                offset += 4 + size;
+                ++framed;
+            }
+            connection->inbox.erase(0, offset);
+            std::lock_guard<std::mutex> lock(outputMutex);
+            connection->unanswered += framed;
+        }
+        if (!received.empty()) {
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                for (auto& request : received) {
+                    queue.push_back(std::move(request));
+                }
+            }
+            queueReady.notify_one();
+        }
+    }
+}
+
+void GenerationServer::processBatches() {
+    Tracer::instance().setThreadName("daemon-worker");
+    std::vector<Request> batch;
+    std::string replies;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueReady.wait(lock, [this]() { return finished || !queue.empty(); });
+            if (finished) {
+                return;
+            }
+            // Everything that arrived while the last batch was answered is
+            // handled together.
+            batch.swap(queue);
+        }
+        if (watcher && watcher->takePendingChange()) {
+            try {
+                reload();
+            } catch (const std::exception& e) {
+                // E.g. a bank caught half-written; the bank is unchanged
+                // and the next change notification retries.
+                std::cerr << "Could not reload the question bank: " << e.what() << std::endl;
+            }
+        }
+        TraceScope trace("batch", "daemon", static_cast<std::int64_t>(batch.size()));
+        for (auto& request : batch) {
+            std::vector<std::string> items;
+            try {
+                items = handle(request.payload);
+                replies.clear();
+                appendFrame(replies, "ok " + std::to_string(items.size()));
+            } catch (const std::exception& e) {
+                items.clear();
+                replies.clear();
+                appendFrame(replies, std::string("error ") + e.what());
+            }
+            for (const auto& item : items) {
+                appendFrame(replies, item);
+            }
+            std::lock_guard<std::mutex> lock(outputMutex);
+            Connection& connection = *request.connection;
+            --connection.unanswered;
+            if (connection.outbox.size() + replies.size() > kMaxUnsentBytes) {
+                connection.dropped = true;
+            } else if (!connection.dropped) {
+                connection.outbox += replies;
+            }
+        }
+        batch.clear();
+        // The I/O thread sends the replies as each client's socket takes them.
+        wake();
+    }
+}
+
+const GenerationServer::PreparedSpec& GenerationServer::prepare(const std::string& specText) {
+    auto cached = specCache.find(specText);
+    if (cached != specCache.end()) {
+        return cached->second;
+    }
+    PreparedSpec spec;
+    std::istringstream lines(specText);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        std::size_t firstTab = line.find('\t');
+        if (firstTab == std::string::npos) {
+            throw std::runtime_error("Quota needs TOPIC<TAB>COUNT: " + line);
+        }
+        std::size_t secondTab = line.find('\t', firstTab + 1);
+        std::string topicName = line.substr(0, firstTab);
+        std::string countText = line.substr(firstTab + 1, secondTab == std::string::npos ? std::string::npos : secondTab - firstTab - 1);
+        std::string filter = secondTab == std::string::npos ? "" : line.substr(secondTab + 1);
+        int count = 0;
+        try {
+            count = std::stoi(countText);
+        } catch (const std::exception&) {
+            throw std::runtime_error("Invalid question count: " + countText);
+        }
+        std::shared_ptr<Topic> topic;
+        if (topicName != "*") {
+            for (const auto& candidate : db->topics) {
+                if (candidate->name == topicName) {
+                    topic = candidate;
+                    break;
+                }
+            }
+            if (!topic) {
+                throw std::runtime_error("Unknown topic: " + topicName);
+            }
+        }
+        spec.quotas.emplace_back(topic, count, filter);
+    }
+    if (spec.quotas.empty()) {
+        throw std::runtime_error("Request has no quotas");
+    }
+    spec.pools = db->preparePools(spec.quotas);
+    if (specCache.size() >= kMaxCachedSpecs) {
+        specCache.clear();
+    }
+    return specCache.emplace(specText, std::move(spec)).first->second;
+}
+
+std::string GenerationServer::reload() {
+    BankChanges changes = db->reloadChanged(bankPath);
+    if (!changes.empty()) {
+        specCache.clear();
+    }
+    return std::to_string(changes.added.size()) + " added, " + std::to_string(changes.edited.size()) + " edited, " +
+           std::to_string(changes.removed.size()) + " removed";
+}
+
+std::vector<std::string> GenerationServer::handle(const std::string& payload) {
+    std::size_t endOfCommand = payload.find('\n');
+    std::istringstream command(payload.substr(0, endOfCommand));
+    std::string specText = endOfCommand == std::string::npos ? "" : payload.substr(endOfCommand + 1);
+    std::string verb;
+    command >> verb;
+
+    if (verb == "reload") {
+        return {reload()};
+    }
+    if (verb != "generate" && verb != "key") {
+        throw std::runtime_error("Unknown command: " + verb);
+    }
+    std::uint64_t seed = 0;
+    std::uint64_t firstStream = 0;
+    std::uint64_t variantCount = 1;
+    std::string format = "ids";
+    std::string flag;
+    command >> seed >> firstStream;
+    if (verb == "generate") {
+        command >> variantCount >> format;
+    }
+    if (!command) {
+        throw std::runtime_error(verb == "generate" ? "Usage: generate SEED FIRST_STREAM COUNT html|ids [shuffle]"
+                                                    : "Usage: key SEED STREAM [shuffle]");
+    }
+    bool shuffle = command >> flag && flag == "shuffle";
+    if (format != "html" && format != "ids") {
+        throw std::runtime_error("Unknown format: " + format);
+    }
+    if (variantCount == 0 || variantCount > 10000) {
+        throw std::runtime_error("Variant count must be between 1 and 10000");
+    }
+
+    const PreparedSpec& spec = prepare(specText);
+    RngService rng(seed);
+    bool key = verb == "key";
+    bool html = format == "html";
+    // Large requests are spread over the shared scheduler; small ones run
+    // inline on the worker.
+    std::vector<std::string> items(variantCount);
+    parallelFor(variantCount, 16, [&](std::size_t begin, std::size_t end) {
+        DocumentWriter writer;
+        for (std::size_t i = begin; i < end; ++i) {
+            std::uint64_t stream = firstStream + i;
+            auto variant = db->generateVariant("Вариант " + std::to_string(stream), spec.quotas, spec.pools, shuffle, rng, stream);
+            std::string& item = items[i];
+            if (key) {
+                for (std::size_t n = 0; n < variant->questions.size(); ++n) {
+                    const auto& question = variant->questions[n];
+                    bool answered = question->options && question->correctOptionIndex >= 0;
+                    item += std::to_string(n + 1) + '\t' + std::to_string(question->id) + '\t' +
+                            (answered ? std::string(1, static_cast<char>('A' + question->correctOptionIndex)) : "-") + '\n';
+                }
+            } else if (html) {
+                item = writer.generateHtmlDocument(variant);
+            } else {
+                for (const auto& question : variant->questions) {
+                    if (!item.empty()) {
+                        item += ' ';
+                    }
+                    item += std::to_string(question->id);
+                }
+            }
+        }
+    });
+    return items;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "quiz.h"
+
+class BankWatcher;
+
+// Frames on the daemon socket are a 4-byte little-endian length followed by
+// that many bytes. Both return false on EOF or a socket error.
+bool writeFrame(int fd, const std::string& payload);
+bool readFrame(int fd, std::string& payload);
+
+// Keeps a question bank resident and generates variants for clients on a
+// Unix socket, so a caller pays for neither process start nor bank parsing.
+//
+// A request frame is a command line followed by one quota per line, written
+// as "TOPIC<TAB>COUNT<TAB>FILTER" (TOPIC "*" for any topic, FILTER optional):
+//
+//   generate SEED FIRST_STREAM COUNT html|ids [shuffle]
+//   key SEED STREAM [shuffle]
+//   reload
+//
+// The reply is a status frame, "ok N" or "error MESSAGE", followed by N
+// frames: one HTML document or line of question ids per variant, the answer
+// key ("NUMBER<TAB>ID<TAB>LETTER" per question), or a reload summary.
+// Variant STREAM is "Вариант STREAM" and matches what the CLI generates for
+// the same seed, so a key can be fetched for any variant handed out.
+//
+// One thread reads requests from every connection and sends the replies as
+// each socket takes them, so a client that stops reading only holds up
+// itself (and is dropped once too much is waiting for it); another thread
+// drains the requests in batches and answers them. The candidate pools of a spec are cached, so
+// repeated requests for the same spec only pay for the draw and rendering.
+// The daemon never records usage or saves the bank.
+class GenerationServer {
+public:
+    GenerationServer(std::shared_ptr<QuestionDatabase> database, const std::string& bankPath);
+    ~GenerationServer();
+
+    GenerationServer(const GenerationServer&) = delete;
+    GenerationServer& operator=(const GenerationServer&) = delete;
+
+    // Reloads the bank between batches whenever the watcher reports a change.
+    void setWatcher(std::shared_ptr<BankWatcher> bankWatcher) { watcher = bankWatcher; }
+    // Serves until stop(); a stale socket file is replaced. Throws
+    // std::runtime_error if the socket cannot be set up.
+    void run(const std::string& socketPath);
+    // Only writes to a pipe, so it is safe to call from a signal handler.
+    void stop();
+
+private:
+    struct Connection;
+    struct Request {
+        std::shared_ptr<Connection> connection;
+        std::string payload;
+    };
+    struct PreparedSpec {
+        std::vector<QuestionQuota> quotas;
+        std::vector<std::vector<std::shared_ptr<Question>>> pools;
+    };
+
+    void serveConnections(int listenFd);
+    void wake();
+    void processBatches();
+    std::vector<std::string> handle(const std::string& payload);
+    const PreparedSpec& prepare(const std::string& specText);
+    std::string reload();
+
+    std::shared_ptr<QuestionDatabase> db;
+    std::string bankPath;
+    std::shared_ptr<BankWatcher> watcher;
+    std::unordered_map<std::string, PreparedSpec> specCache;
+
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::vector<Request> queue;
+    // Guards the reply side of every Connection.
+    std::mutex outputMutex;
+    bool finished = false;
+    std::atomic<bool> stopping{false};
+    int wakeFds[2] = {-1, -1};
+};
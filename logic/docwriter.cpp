@@ -3,26 +3,91 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <charconv>
+#include <initializer_list>
 #include <ctime>
 #include <filesystem>
+#include "memory.h"
+#include "stats.h"
+#include "trace.h"
 
-DocumentWriter::DocumentWriter() {}
+#ifdef MADEXAM_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+DocumentWriter::DocumentWriter(const DocumentOptions& options) : options(options) {}
 DocumentWriter::~DocumentWriter() {}
 
+bool DocumentWriter::gzipAvailable() {
+#ifdef MADEXAM_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef MADEXAM_HAVE_ZLIB
+// Deflates into a small buffer that is flushed to the file as it fills, so
+// the compressed copy is never held in memory.
+static bool writeGzipFile(const std::filesystem::path& path, std::string_view content) {
+    TraceScope trace("compress", "io");
+    ScopedStageTimer timer(PerfStage::Compress, content.size());
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        return false;
+    }
+    z_stream stream{};
+    // windowBits 15 + 16 selects the gzip wrapper; its mtime stays 0, so the
+    // same input always compresses to the same bytes.
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(content.data()));
+    stream.avail_in = static_cast<uInt>(content.size());
+    unsigned char buffer[16384];
+    int status;
+    do {
+        stream.next_out = buffer;
+        stream.avail_out = sizeof(buffer);
+        status = deflate(&stream, Z_FINISH);
+        out.write(reinterpret_cast<const char*>(buffer), static_cast<std::streamsize>(sizeof(buffer) - stream.avail_out));
+    } while (status == Z_OK);
+    deflateEnd(&stream);
+    return status == Z_STREAM_END && out.good();
+}
+#endif
+
+bool DocumentWriter::writeOutput(const std::filesystem::path& path, std::string_view content) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to create file: " << path << std::endl;
+        return false;
+    }
+    {
+        TraceScope trace("write", "io");
+        ScopedStageTimer timer(PerfStage::WriteDocument, content.size());
+        file << content;
+        file.close();
+    }
+#ifdef MADEXAM_HAVE_ZLIB
+    if (options.gzip) {
+        std::filesystem::path gzipPath = path;
+        gzipPath += ".gz";
+        if (!writeGzipFile(gzipPath, content)) {
+            std::cerr << "Failed to create compressed file: " << gzipPath << std::endl;
+            return false;
+        }
+    }
+#endif
+    return true;
+}
 
 bool DocumentWriter::createDocument(const std::string& filePath, const std::shared_ptr<QuizVariant>& quizvariant) {
     try {
         std::filesystem::path path(filePath);  // Automatically handles UTF-8 and wide strings
-
-        std::ofstream htmlFile(path, std::ios::binary);
-        if (!htmlFile) {
-            std::cerr << "Failed to create HTML file: " << path << std::endl;
+        if (!writeOutput(path, renderHtml(*quizvariant))) {
             return false;
         }
-
-        htmlFile << generateHtmlDocument(quizvariant);
-        htmlFile.close();
-
         std::cout << "HTML document created successfully: " << path << std::endl;
         return true;
     } catch (const std::exception& e) {
@@ -31,66 +96,161 @@ bool DocumentWriter::createDocument(const std::string& filePath, const std::shar
     }
 }
 
+bool DocumentWriter::writeStylesheet(const std::string& directory) {
+    // Whitespace next to punctuation is dropped; runs elsewhere (e.g. between
+    // the values of a shorthand property) shrink to one space.
+    std::string_view source = css();
+    std::string minified;
+    minified.reserve(source.size());
+    bool pendingSpace = false;
+    for (char c : source) {
+        if (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
+            pendingSpace = !minified.empty();
+            continue;
+        }
+        bool punctuation = std::string_view("{};:,").find(c) != std::string_view::npos;
+        if (pendingSpace && !punctuation && std::string_view("{};:,").find(minified.back()) == std::string_view::npos) {
+            minified += ' ';
+        }
+        pendingSpace = false;
+        minified += c;
+    }
+    try {
+        return writeOutput(std::filesystem::path(directory) / stylesheetName(), minified);
+    } catch (const std::exception& e) {
+        std::cerr << "Error creating stylesheet: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+// Appends to the reused render buffer; none of these allocate once the
+// buffer has room for the document.
+static void put(RenderBuffer& out, std::initializer_list<std::string_view> parts) {
+    for (std::string_view part : parts) {
+        out.append(part.data(), part.size());
+    }
+}
+
+static void putEscaped(RenderBuffer& out, std::string_view text) {
+    std::size_t plain = 0;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        std::string_view entity;
+        switch (text[i]) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = "&quot;"; break;
+            default: continue;
+        }
+        out.append(text.data() + plain, i - plain);
+        out.append(entity.data(), entity.size());
+        plain = i + 1;
+    }
+    out.append(text.data() + plain, text.size() - plain);
+}
+
+static void putNumber(RenderBuffer& out, std::uint64_t value) {
+    char digits[20];
+    char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    out.append(digits, static_cast<std::size_t>(end - digits));
+}
+
 std::string DocumentWriter::generateHtmlDocument(const std::shared_ptr<QuizVariant>& quizvariant) {
-    std::stringstream html;
-    
-    html << "<!DOCTYPE html>\n"
-         << "<html lang=\"en\">\n"
-         << "<head>\n"
-         << "    <meta charset=\"UTF-8\">\n"
-         << "    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
-         << "    <title>" << escapeHtml(quizvariant->variantName) << "</title>\n"
-         << "    <style>\n"
-         << generateCss()
-         << "    </style>\n"
-         << "</head>\n"
-         << "<body>\n";
-    
-    html << "    <div class=\"title\">" << escapeHtml(quizvariant->variantName) << "</div>\n";
-    
-    html << "    <div class=\"quiz-container\">\n";
+    return std::string(renderHtml(*quizvariant));
+}
+
+std::string_view DocumentWriter::renderHtml(const QuizVariant& quizvariant) {
+    TraceScope trace("render");
+    ScopedStageTimer timer(PerfStage::Render);
+    // Kept for the thread's lifetime, so it soon has room for any document.
+    static thread_local RenderBuffer html;
+    html.clear();
+    const bool compact = options.compact;
+    const std::string_view nl = compact ? "" : "\n";
+    auto indent = [compact](int depth) {
+        static const std::string_view spaces = "                    ";
+        return compact ? std::string_view() : spaces.substr(0, depth * 4);
+    };
+
+    put(html, {"<!DOCTYPE html>", nl,
+               "<html lang=\"en\">", nl,
+               "<head>", nl,
+               indent(1), "<meta charset=\"UTF-8\">", nl,
+               indent(1), "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">", nl,
+               indent(1), "<title>"});
+    putEscaped(html, quizvariant.variantName);
+    put(html, {"</title>", nl});
+    if (quizvariant.seed) {
+        put(html, {indent(1), "<meta name=\"madexam-seed\" content=\""});
+        putNumber(html, *quizvariant.seed);
+        html += '/';
+        putNumber(html, quizvariant.stream);
+        put(html, {"\">", nl});
+    }
+    if (compact) {
+        put(html, {"<link rel=\"stylesheet\" href=\"", stylesheetName(), "\">"});
+    } else {
+        put(html, {"    <style>\n", css(), "    </style>\n"});
+    }
+    put(html, {"</head>", nl,
+               "<body>", nl,
+               indent(1), "<div class=\"title\">"});
+    putEscaped(html, quizvariant.variantName);
+    put(html, {"</div>", nl,
+               indent(1), "<div class=\"quiz-container\">", nl});
+
     int questionNum = 1;
-    
-    std::string currentTopic = "";
-    
-    for (const auto& question : quizvariant->questions) {
+    std::string_view currentTopic;
+    for (const auto& question : quizvariant.questions) {
         if (currentTopic != question->topic->name) {
-            html << "        <div class=\"topic-section\">\n"
-                 << "            <h2 class=\"topic-title\">" << escapeHtml(question->topic->name) << "</h2>\n"
-                 << "        </div>\n";
-                 
+            put(html, {indent(2), "<div class=\"topic-section\">", nl,
+                       indent(3), "<h2 class=\"topic-title\">"});
+            putEscaped(html, question->topic->name);
+            put(html, {"</h2>", nl,
+                       indent(2), "</div>", nl});
             currentTopic = question->topic->name;
         }
-        
-        html << "        <div class=\"question\">\n"
-             << "            <div class=\"question-text\">Q" << questionNum << ": " 
-             << escapeHtml(question->questionText) << "</div>\n";
-        
+
+        put(html, {indent(2), "<div class=\"question\">", nl,
+                   indent(3), "<div class=\"question-text\">Q"});
+        putNumber(html, static_cast<std::uint64_t>(questionNum));
+        html += ": ";
+        putEscaped(html, question->questionText);
+        put(html, {"</div>", nl});
+
         if (question->options) {
-            html << "            <div class=\"options\">\n";
+            put(html, {indent(3), "<div class=\"options\">", nl});
             char optionLetter = 'A';
             for (const auto& option : *question->options) {
-                html << "                <div class=\"option\">" 
-                     << optionLetter << ") " << escapeHtml(option) << "</div>\n";
+                put(html, {indent(4), "<div class=\"option\">", std::string_view(&optionLetter, 1), ") "});
+                putEscaped(html, option);
+                put(html, {"</div>", nl});
                 optionLetter++;
             }
-            html << "            </div>\n";
+            put(html, {indent(3), "</div>", nl});
         }
-        
-        html << "        </div>\n";
+
+        put(html, {indent(2), "</div>", nl});
         questionNum++;
     }
-    html << "    </div>\n";
-    
-    html << "    <div class=\"footer\">Сгенерировано MadExam " << getCurrentDate() << "</div>\n";
-    
-    html << "</body>\n"
-         << "</html>";
-    
-    return html.str();
+    put(html, {indent(1), "</div>", nl,
+               indent(1), "<div class=\"footer\">Сгенерировано MadExam "});
+    putCurrentDate(html);
+    if (quizvariant.seed) {
+        html += " &middot; seed ";
+        putNumber(html, *quizvariant.seed);
+        html += '/';
+        putNumber(html, quizvariant.stream);
+    }
+    put(html, {"</div>", nl,
+               "</body>", nl,
+               "</html>"});
+
+    timer.addBytes(html.size());
+    return std::string_view(html.data(), html.size());
 }
 
-std::string DocumentWriter::generateCss() {
+std::string_view DocumentWriter::css() {
     return R"(
         body {
             font-family: 'Calibri', 'Segoe UI', Arial, sans-serif;
@@ -169,38 +329,21 @@ std::string DocumentWriter::generateCss() {
     )";
 }
 
-std::string DocumentWriter::escapeHtml(const std::string& str) {
-    std::string escaped = str;
-    size_t pos = 0;
-    while ((pos = escaped.find('&', pos)) != std::string::npos) {
-        escaped.replace(pos, 1, "&amp;");
-        pos += 5; 
-    }
-    
-    pos = 0;
-    while ((pos = escaped.find('<', pos)) != std::string::npos) {
-        escaped.replace(pos, 1, "&lt;");
-        pos += 4; 
-    }
-    
-    pos = 0;
-    while ((pos = escaped.find('>', pos)) != std::string::npos) {
-        escaped.replace(pos, 1, "&gt;");
-        pos += 4; 
-    }
-    
-    pos = 0;
-    while ((pos = escaped.find('"', pos)) != std::string::npos) {
-        escaped.replace(pos, 1, "&quot;");
-        pos += 6; 
-    }
-    
-    return escaped;
+// Thread-safe std::localtime: documents are rendered on several threads at once.
+static std::tm localTime(std::time_t time) {
+    std::tm local{};
+#if defined(_WIN32)
+    localtime_s(&local, &time);
+#else
+    localtime_r(&time, &local);
+#endif
+    return local;
 }
 
-std::string DocumentWriter::getCurrentDate() {
+void DocumentWriter::putCurrentDate(RenderBuffer& out) {
     std::time_t now = std::time(nullptr);
     char buf[100];
-    std::strftime(buf, sizeof(buf), "%B %d, %Y", std::localtime(&now));
-    return std::string(buf);
-}
\ No newline at end of file
+    std::tm local = localTime(now);
+    std::size_t length = std::strftime(buf, sizeof(buf), "%B %d, %Y", &local);
+    out.append(buf, length);
+}
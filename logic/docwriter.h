@@ -27,20 +27,48 @@
 // };
 
 #pragma once
+#include <filesystem>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include "memory.h"
 #include "quiz.h"
 
+struct DocumentOptions {
+    // Link the shared stylesheet from writeStylesheet() instead of embedding
+    // it, and leave out indentation and line breaks.
+    bool compact = false;
+    // Also write a gzip-compressed copy (FILE.gz) of every file written.
+    bool gzip = false;
+};
+
+using RenderBuffer = CountedString<MemorySubsystem::Render>;
+
 class DocumentWriter {
 public:
-    DocumentWriter();
+    explicit DocumentWriter(const DocumentOptions& options = DocumentOptions());
     ~DocumentWriter();
     bool createDocument(const std::string& filePath, const std::shared_ptr<QuizVariant>& quizVariant);
+    // Writes the stylesheet compact documents link to; once per output
+    // directory is enough.
+    bool writeStylesheet(const std::string& directory);
 
-private:
+    static const char* stylesheetName() { return "madexam.css"; }
+    // False when built without zlib; gzip output is then skipped.
+    static bool gzipAvailable();
+    // The document createDocument() writes, for callers that ship it elsewhere.
     std::string generateHtmlDocument(const std::shared_ptr<QuizVariant>& quizvariant);
-    std::string generateCss();
-    std::string escapeHtml(const std::string& str);
-    std::string getCurrentDate();
+    // The same document, rendered into a buffer each thread reuses: the view
+    // stays valid until the next render on this thread. Once the buffer has
+    // grown to fit, rendering does not touch the heap.
+    std::string_view renderHtml(const QuizVariant& quizvariant);
+    // Writes rendered content, plus its .gz copy when gzip is set.
+    bool writeOutput(const std::filesystem::path& path, std::string_view content);
+
+private:
+    static std::string_view css();
+    static void putCurrentDate(RenderBuffer& out);
+
+    DocumentOptions options;
 };
\ No newline at end of file
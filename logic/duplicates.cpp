@@ -0,0 +1,312 @@
+#include "duplicates.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include "scheduler.h"
+#include "trace.h"
+
+// Buckets larger than this (mostly exact copies) pair every member with the
+// first one only, so a thousand copies cost a thousand pairs, not half a million.
+static const std::size_t kMaxBucketPairs = 64;
+// How far below the threshold an estimated similarity may be and still get
+// the exact comparison.
+static const double kEstimateMargin = 0.05;
+
+static std::uint64_t mix64(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Decodes the UTF-8 sequence at text[pos] and moves past it; a malformed
+// byte decodes as itself.
+static char32_t nextCodePoint(std::string_view text, std::size_t& pos) {
+    unsigned char lead = static_cast<unsigned char>(text[pos]);
+    std::size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xe ? 3 : (lead >> 3) == 0x1e ? 4 : 0;
+    if (length <= 1 || pos + length > text.size()) {
+        ++pos;
+        return lead;
+    }
+    char32_t code = lead & (0x7f >> length);
+    for (std::size_t k = 1; k < length; ++k) {
+        unsigned char next = static_cast<unsigned char>(text[pos + k]);
+        if ((next & 0xc0) != 0x80) {
+            ++pos;
+            return lead;
+        }
+        code = (code << 6) | (next & 0x3f);
+    }
+    pos += length;
+    return code;
+}
+
+static char32_t foldCase(char32_t c) {
+    if (c >= U'A' && c <= U'Z') {
+        return c + 0x20;
+    }
+    if (c >= 0x410 && c <= 0x42f) {
+        c += 0x20;
+    } else if (c >= 0x400 && c <= 0x40f) {
+        c += 0x50;
+    }
+    // ё and е are used interchangeably.
+    return c == 0x451 ? 0x435 : c;
+}
+
+static bool isWordCharacter(char32_t c) {
+    if (c < 0x80) {
+        return (c >= U'a' && c <= U'z') || (c >= U'0' && c <= U'9');
+    }
+    // No-break space, guillemets and the General Punctuation block.
+    return c != 0xa0 && c != 0xab && c != 0xbb && !(c >= 0x2000 && c <= 0x206f);
+}
+
+// Appends `text` lowercased, as words separated by single spaces.
+static void appendNormalized(std::string_view text, std::u32string& out) {
+    for (std::size_t pos = 0; pos < text.size();) {
+        char32_t c = foldCase(nextCodePoint(text, pos));
+        if (isWordCharacter(c)) {
+            out.push_back(c);
+        } else if (!out.empty() && out.back() != U' ') {
+            out.push_back(U' ');
+        }
+    }
+}
+
+// Fingerprints of every shingle of the question text and options, sorted
+// and distinct.
+static std::vector<std::uint32_t> shingleSet(const Question& question, std::size_t shingleSize) {
+    std::u32string text;
+    appendNormalized(question.questionText, text);
+    if (question.options) {
+        for (std::string_view option : *question.options) {
+            if (!text.empty() && text.back() != U' ') {
+                text.push_back(U' ');
+            }
+            appendNormalized(option, text);
+        }
+    }
+    if (!text.empty() && text.back() == U' ') {
+        text.pop_back();
+    }
+    std::vector<std::uint32_t> shingles;
+    if (text.empty()) {
+        return shingles;
+    }
+    std::size_t width = std::min(shingleSize, text.size());
+    for (std::size_t start = 0; start + width <= text.size(); ++start) {
+        std::uint64_t hash = 0;
+        for (std::size_t k = 0; k < width; ++k) {
+            hash = (hash + text[start + k]) * 0x9e3779b97f4a7c15ULL;
+        }
+        shingles.push_back(static_cast<std::uint32_t>(mix64(hash) >> 32));
+    }
+    std::sort(shingles.begin(), shingles.end());
+    shingles.erase(std::unique(shingles.begin(), shingles.end()), shingles.end());
+    return shingles;
+}
+
+static double jaccard(const std::vector<std::uint32_t>& a, const std::vector<std::uint32_t>& b) {
+    std::size_t shared = 0;
+    for (std::size_t x = 0, y = 0; x < a.size() && y < b.size();) {
+        if (a[x] < b[y]) {
+            ++x;
+        } else if (b[y] < a[x]) {
+            ++y;
+        } else {
+            ++shared;
+            ++x;
+            ++y;
+        }
+    }
+    std::size_t united = a.size() + b.size() - shared;
+    return united ? static_cast<double>(shared) / static_cast<double>(united) : 0.0;
+}
+
+// Multiply-shift hashes h(x) = (a * x + b) >> 32, one per signature row; the
+// inner loop over rows vectorizes.
+struct MinHashFamily {
+    std::vector<std::uint64_t> multipliers;
+    std::vector<std::uint64_t> offsets;
+
+    explicit MinHashFamily(std::size_t count) {
+        std::uint64_t state = 0x6d696e68617368ULL;
+        for (std::size_t i = 0; i < count; ++i) {
+            multipliers.push_back(mix64(++state) | 1u);
+            offsets.push_back(mix64(++state));
+        }
+    }
+
+    void sign(const std::vector<std::uint32_t>& shingles, std::uint32_t* signature) const {
+        std::size_t count = multipliers.size();
+        std::fill(signature, signature + count, std::numeric_limits<std::uint32_t>::max());
+        const std::uint64_t* a = multipliers.data();
+        const std::uint64_t* b = offsets.data();
+        for (std::uint32_t x : shingles) {
+            for (std::size_t i = 0; i < count; ++i) {
+                auto hash = static_cast<std::uint32_t>((a[i] * x + b[i]) >> 32);
+                signature[i] = std::min(signature[i], hash);
+            }
+        }
+    }
+};
+
+NearDuplicateReport findNearDuplicates(const std::vector<std::shared_ptr<Question>>& questions,
+                                       const NearDuplicateOptions& options) {
+    if (options.shingleSize == 0 || options.bands == 0 || options.rowsPerBand == 0) {
+        throw std::invalid_argument("Shingle size, bands and rows per band must be positive");
+    }
+    TraceScope trace("near_duplicates", "analysis", static_cast<std::int64_t>(questions.size()));
+    auto started = std::chrono::steady_clock::now();
+    const std::size_t count = questions.size();
+    const std::size_t rows = options.bands * options.rowsPerBand;
+
+    // Signatures, row-major per question. Questions without any text get no
+    // signature: they would all land in one bucket.
+    MinHashFamily family(rows);
+    std::vector<std::uint32_t> signatures(count * rows);
+    std::vector<char> hasSignature(count, 0);
+    parallelFor(count, 512, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            std::vector<std::uint32_t> shingles = shingleSet(*questions[i], options.shingleSize);
+            if (!shingles.empty()) {
+                family.sign(shingles, &signatures[i * rows]);
+                hasSignature[i] = 1;
+            }
+        }
+    });
+
+    // The share of agreeing rows estimates the Jaccard similarity of two
+    // questions' shingles, within about 0.05 at 96 rows. Where many pairs sit
+    // just below the threshold that still lets plenty through, so the
+    // estimate only picks the pairs whose shingles are then compared.
+    auto estimate = [&signatures, rows](std::uint32_t x, std::uint32_t y) {
+        const std::uint32_t* a = &signatures[static_cast<std::size_t>(x) * rows];
+        const std::uint32_t* b = &signatures[static_cast<std::size_t>(y) * rows];
+        std::size_t agreeing = 0;
+        for (std::size_t r = 0; r < rows; ++r) {
+            agreeing += a[r] == b[r];
+        }
+        return static_cast<double>(agreeing) / static_cast<double>(rows);
+    };
+
+    // Per band, questions whose rows of that band all agree share a bucket;
+    // sorting by the band's hash brings each bucket together. Pairs are
+    // checked as they come, so only likely duplicates are kept.
+    std::mutex candidateMutex;
+    std::vector<std::uint64_t> matches;
+    std::size_t candidates = 0;
+    parallelFor(options.bands, 1, [&](std::size_t begin, std::size_t end) {
+        std::vector<std::uint64_t> found;
+        std::size_t examined = 0;
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> keys;
+        for (std::size_t band = begin; band < end; ++band) {
+            keys.clear();
+            for (std::size_t i = 0; i < count; ++i) {
+                if (!hasSignature[i]) {
+                    continue;
+                }
+                std::uint64_t key = band;
+                for (std::size_t r = 0; r < options.rowsPerBand; ++r) {
+                    key = mix64(key ^ signatures[i * rows + band * options.rowsPerBand + r]);
+                }
+                keys.emplace_back(key, static_cast<std::uint32_t>(i));
+            }
+            std::sort(keys.begin(), keys.end());
+            for (std::size_t first = 0; first < keys.size();) {
+                std::size_t last = first + 1;
+                while (last < keys.size() && keys[last].first == keys[first].first) {
+                    ++last;
+                }
+                bool star = last - first > kMaxBucketPairs;
+                for (std::size_t x = first; x < last; ++x) {
+                    for (std::size_t y = x + 1; y < last; ++y) {
+                        ++examined;
+                        if (estimate(keys[x].second, keys[y].second) >= options.threshold - kEstimateMargin) {
+                            found.push_back(static_cast<std::uint64_t>(keys[x].second) << 32 | keys[y].second);
+                        }
+                    }
+                    if (star) {
+                        break;
+                    }
+                }
+                first = last;
+            }
+        }
+        std::lock_guard<std::mutex> lock(candidateMutex);
+        candidates += examined;
+        matches.insert(matches.end(), found.begin(), found.end());
+    });
+    std::sort(matches.begin(), matches.end());
+    matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+
+    std::vector<std::int32_t> shingleSlot(count, -1);
+    std::vector<std::uint32_t> involved;
+    for (std::uint64_t pair : matches) {
+        for (auto index : {static_cast<std::uint32_t>(pair >> 32), static_cast<std::uint32_t>(pair)}) {
+            if (shingleSlot[index] < 0) {
+                shingleSlot[index] = static_cast<std::int32_t>(involved.size());
+                involved.push_back(index);
+            }
+        }
+    }
+    std::vector<std::vector<std::uint32_t>> shingles(involved.size());
+    parallelFor(involved.size(), 256, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t k = begin; k < end; ++k) {
+            shingles[k] = shingleSet(*questions[involved[k]], options.shingleSize);
+        }
+    });
+    std::vector<double> similarity(matches.size());
+    parallelFor(matches.size(), 1024, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t k = begin; k < end; ++k) {
+            similarity[k] = jaccard(shingles[shingleSlot[matches[k] >> 32]],
+                                    shingles[shingleSlot[static_cast<std::uint32_t>(matches[k])]]);
+        }
+    });
+
+    NearDuplicateReport report;
+    report.questions = count;
+    report.candidates = candidates;
+    for (std::size_t k = 0; k < matches.size(); ++k) {
+        if (similarity[k] >= options.threshold) {
+            report.pairs.push_back({questions[matches[k] >> 32], questions[static_cast<std::uint32_t>(matches[k])],
+                                    similarity[k]});
+        }
+    }
+    std::stable_sort(report.pairs.begin(), report.pairs.end(), [](const NearDuplicatePair& a, const NearDuplicatePair& b) {
+        return a.similarity > b.similarity;
+    });
+    report.millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
+
+void NearDuplicateReport::dump(std::ostream& out, std::size_t maxListed) const {
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(1) << pairs.size() << " near-duplicate pair(s) among " << questions
+        << " questions (" << candidates << " candidates) in " << millis << " ms\n" << std::setprecision(2);
+    auto describe = [&out](const Question& question) {
+        out << "[" << question.id << "] ";
+        if (question.topic) {
+            out << "(" << question.topic->name << ") ";
+        }
+        out << question.questionText << "\n";
+    };
+    for (std::size_t k = 0; k < pairs.size() && k < maxListed; ++k) {
+        out << pairs[k].similarity << "  ";
+        describe(*pairs[k].first);
+        out << "      ";
+        describe(*pairs[k].second);
+    }
+    if (pairs.size() > maxListed) {
+        out << "... and " << pairs.size() - maxListed << " more\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include "quiz.h"
+
+struct NearDuplicateOptions {
+    // Characters per shingle of the normalized text.
+    std::size_t shingleSize = 3;
+    // The signature has bands * rowsPerBand hashes. Two questions become
+    // candidates when all rows of any band agree, which happens mostly above
+    // a similarity of about (1 / bands)^(1 / rowsPerBand), here 0.3.
+    std::size_t bands = 32;
+    std::size_t rowsPerBand = 3;
+    // Pairs less similar than this (Jaccard over shingles) are dropped.
+    // Rewordings such as "Какой год..." / "В каком году..." score 0.5-0.8.
+    double threshold = 0.4;
+};
+
+struct NearDuplicatePair {
+    std::shared_ptr<Question> first;
+    std::shared_ptr<Question> second;
+    double similarity = 0;
+};
+
+struct NearDuplicateReport {
+    std::size_t questions = 0;
+    // Pairs that shared a bucket, once per band they shared.
+    std::size_t candidates = 0;
+    // Most similar first.
+    std::vector<NearDuplicatePair> pairs;
+    double millis = 0;
+
+    // Lists at most `maxListed` pairs.
+    void dump(std::ostream& out, std::size_t maxListed = 50) const;
+};
+
+// Finds questions that are reworded copies of each other, comparing the
+// question text together with the options. The text is lowercased (Latin
+// and Cyrillic, with ё as е), stripped of punctuation and cut into character
+// shingles; each question gets a MinHash signature of its shingles, computed
+// on the shared TaskScheduler, and LSH banding of the signatures yields the
+// candidate pairs without comparing every pair. Candidates whose signatures
+// suggest a similarity near the threshold or above get their shingles
+// compared exactly.
+NearDuplicateReport findNearDuplicates(const std::vector<std::shared_ptr<Question>>& questions,
+                                       const NearDuplicateOptions& options = NearDuplicateOptions());
@@ -0,0 +1,376 @@
+#include "grading.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include "scheduler.h"
+#include "trace.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const char kBinaryMagic[8] = {'M', 'X', 'R', 'E', 'S', 'P', '0', '1'};
+// Input is read and graded a block at a time.
+static const std::size_t kBlockBytes = 1 << 20;
+static const std::size_t kResponsesPerTask = 512;
+static const std::size_t kRejectedListed = 10;
+// Vector loads read up to 15 bytes past the last answer or key.
+static const std::size_t kLoadSlack = 16;
+
+AnswerKeys::AnswerKeys(const VariantArchive& archive, const QuestionDatabase& db) {
+    offsets.push_back(0);
+    for (std::uint32_t variant = 0; variant < archive.size(); ++variant) {
+        for (QuestionId id : archive.get(variant).questionIds) {
+            auto question = db.findQuestionById(id);
+            bool keyed = question && question->options && question->correctOptionIndex >= 0 &&
+                         question->correctOptionIndex < static_cast<int>(std::min<std::size_t>(question->options->size(), 26));
+            answerBytes.push_back(keyed ? static_cast<char>('A' + question->correctOptionIndex) : kUngraded);
+            ids.push_back(id);
+        }
+        offsets.push_back(answerBytes.size());
+    }
+    answerBytes.append(kLoadSlack, kUngraded);
+}
+
+// Maps every input byte to 'A'-'Z' or '-' (unanswered).
+static const std::array<char, 256>& answerTable() {
+    static const std::array<char, 256> table = []() {
+        std::array<char, 256> result;
+        result.fill('-');
+        for (char c = 'A'; c <= 'Z'; ++c) {
+            result[static_cast<unsigned char>(c)] = c;
+            result[static_cast<unsigned char>(c - 'A' + 'a')] = c;
+        }
+        for (char c = '1'; c <= '9'; ++c) {
+            result[static_cast<unsigned char>(c)] = static_cast<char>('A' + (c - '1'));
+        }
+        return result;
+    }();
+    return table;
+}
+
+// One response, pointing into the block it was read from.
+struct Response {
+    std::string_view student;
+    std::uint32_t variant = 0;
+    char* answers = nullptr;
+    std::size_t answerCount = 0;
+};
+
+struct Score {
+    std::uint32_t correct = 0;
+    std::uint32_t answered = 0;
+    // Questions of the variant that have a key.
+    std::uint32_t questions = 0;
+};
+
+// Both `answers` and `key` must be readable 15 bytes past their ends.
+static Score scoreResponse(const char* answers, std::size_t answerCount, const char* key, std::size_t keyCount) {
+    Score score;
+    std::size_t given = std::min(answerCount, keyCount);
+#ifdef __SSE2__
+    const __m128i ungraded = _mm_set1_epi8(AnswerKeys::kUngraded);
+    const __m128i blank = _mm_set1_epi8('-');
+    for (std::size_t k = 0; k < keyCount; k += 16) {
+        __m128i keys = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + k));
+        unsigned inKey = k + 16 <= keyCount ? 0xffffu : (1u << (keyCount - k)) - 1;
+        unsigned keyed = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(keys, ungraded))) & inKey;
+        score.questions += __builtin_popcount(keyed);
+        if (k < given) {
+            __m128i chosen = _mm_loadu_si128(reinterpret_cast<const __m128i*>(answers + k));
+            unsigned inAnswers = k + 16 <= given ? 0xffffu : (1u << (given - k)) - 1;
+            unsigned matching = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chosen, keys)));
+            unsigned blanks = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chosen, blank)));
+            score.correct += __builtin_popcount(matching & keyed & inAnswers);
+            score.answered += __builtin_popcount(~blanks & keyed & inAnswers);
+        }
+    }
+#else
+    for (std::size_t k = 0; k < keyCount; ++k) {
+        if (key[k] == AnswerKeys::kUngraded) {
+            continue;
+        }
+        ++score.questions;
+        if (k < given && answers[k] != '-') {
+            ++score.answered;
+            score.correct += answers[k] == key[k];
+        }
+    }
+#endif
+    return score;
+}
+
+template <typename Number>
+static void appendNumber(std::string& out, Number value) {
+    char digits[24];
+    char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    out.append(digits, end);
+}
+
+static void appendCsvField(std::string& out, std::string_view field) {
+    if (field.find_first_of(",\"\r\n") == std::string_view::npos) {
+        out.append(field);
+        return;
+    }
+    out.push_back('"');
+    for (char c : field) {
+        if (c == '"') {
+            out.push_back('"');
+        }
+        out.push_back(c);
+    }
+    out.push_back('"');
+}
+
+// Splits "student,variant,answers" in place; a quoted student name is
+// unescaped where it stands.
+static bool parseCsvLine(char* begin, char* end, Response& response) {
+    char* p = begin;
+    if (p < end && *p == '"') {
+        char* out = begin;
+        for (++p;; ++p) {
+            if (p >= end) {
+                return false;
+            }
+            if (*p == '"') {
+                if (p + 1 < end && p[1] == '"') {
+                    ++p;
+                } else {
+                    ++p;
+                    break;
+                }
+            }
+            *out++ = *p;
+        }
+        response.student = std::string_view(begin, static_cast<std::size_t>(out - begin));
+    } else {
+        char* comma = static_cast<char*>(std::memchr(p, ',', static_cast<std::size_t>(end - p)));
+        if (!comma) {
+            return false;
+        }
+        response.student = std::string_view(begin, static_cast<std::size_t>(comma - begin));
+        p = comma;
+    }
+    if (p >= end || *p != ',') {
+        return false;
+    }
+    ++p;
+    auto parsed = std::from_chars(p, end, response.variant);
+    if (parsed.ec != std::errc() || parsed.ptr >= end || *parsed.ptr != ',') {
+        return false;
+    }
+    response.answers = const_cast<char*>(parsed.ptr) + 1;
+    response.answerCount = static_cast<std::size_t>(end - response.answers);
+    return true;
+}
+
+static void reject(GradingReport& report, std::size_t number, bool unknownVariant) {
+    ++(unknownVariant ? report.unknownVariants : report.malformed);
+    if (report.rejected.size() < kRejectedListed) {
+        report.rejected.push_back(number);
+    }
+}
+
+// Grades and formats the batch on the scheduler, then writes it in order.
+static void gradeBatch(std::vector<Response>& batch, const AnswerKeys& keys, std::ostream& totals, std::ostream* items) {
+    std::size_t tasks = (batch.size() + kResponsesPerTask - 1) / kResponsesPerTask;
+    std::vector<std::string> totalsText(tasks);
+    std::vector<std::string> itemsText(items ? tasks : 0);
+    parallelFor(tasks, 1, [&](std::size_t begin, std::size_t end) {
+        const std::array<char, 256>& table = answerTable();
+        for (std::size_t task = begin; task < end; ++task) {
+            std::string& totalsOut = totalsText[task];
+            std::size_t last = std::min(batch.size(), (task + 1) * kResponsesPerTask);
+            for (std::size_t i = task * kResponsesPerTask; i < last; ++i) {
+                Response& response = batch[i];
+                for (std::size_t k = 0; k < response.answerCount; ++k) {
+                    response.answers[k] = table[static_cast<unsigned char>(response.answers[k])];
+                }
+                std::string_view key = keys.answers(response.variant);
+                Score score = scoreResponse(response.answers, response.answerCount, key.data(), key.size());
+                appendCsvField(totalsOut, response.student);
+                totalsOut.push_back(',');
+                appendNumber(totalsOut, response.variant);
+                totalsOut.push_back(',');
+                appendNumber(totalsOut, score.correct);
+                totalsOut.push_back(',');
+                appendNumber(totalsOut, score.answered);
+                totalsOut.push_back(',');
+                appendNumber(totalsOut, score.questions);
+                totalsOut.push_back('\n');
+                if (!items) {
+                    continue;
+                }
+                std::string& itemsOut = itemsText[task];
+                const QuestionId* ids = keys.questionIds(response.variant);
+                for (std::size_t k = 0; k < key.size(); ++k) {
+                    if (key[k] == AnswerKeys::kUngraded) {
+                        continue;
+                    }
+                    char chosen = k < response.answerCount ? response.answers[k] : '-';
+                    appendCsvField(itemsOut, response.student);
+                    itemsOut.push_back(',');
+                    appendNumber(itemsOut, response.variant);
+                    itemsOut.push_back(',');
+                    appendNumber(itemsOut, k + 1);
+                    itemsOut.push_back(',');
+                    appendNumber(itemsOut, ids[k]);
+                    itemsOut.push_back(',');
+                    itemsOut.push_back(chosen);
+                    itemsOut.append(chosen == key[k] ? ",1\n" : ",0\n");
+                }
+            }
+        }
+    });
+    for (std::size_t task = 0; task < tasks; ++task) {
+        totals.write(totalsText[task].data(), static_cast<std::streamsize>(totalsText[task].size()));
+        if (items) {
+            items->write(itemsText[task].data(), static_cast<std::streamsize>(itemsText[task].size()));
+        }
+    }
+}
+
+// Appends up to kBlockBytes more of the input to `buffer`; false once the
+// input is exhausted.
+static bool readBlock(std::istream& in, std::string& buffer) {
+    std::size_t kept = buffer.size();
+    buffer.resize(kept + kBlockBytes);
+    in.read(&buffer[kept], static_cast<std::streamsize>(kBlockBytes));
+    buffer.resize(kept + static_cast<std::size_t>(in.gcount()));
+    return in.gcount() > 0;
+}
+
+static std::uint32_t readLittleEndian(const char* bytes, std::size_t size) {
+    std::uint32_t value = 0;
+    for (std::size_t k = size; k-- > 0;) {
+        value = (value << 8) | static_cast<unsigned char>(bytes[k]);
+    }
+    return value;
+}
+
+GradingReport gradeResponses(std::istream& in, const AnswerKeys& keys, std::ostream& totals, std::ostream* items) {
+    TraceScope trace("grade_responses", "io");
+    auto started = std::chrono::steady_clock::now();
+    GradingReport report;
+    totals << "student,variant,correct,answered,questions\n";
+    if (items) {
+        *items << "student,variant,position,question,answer,correct\n";
+    }
+
+    std::string buffer;
+    std::vector<Response> batch;
+    readBlock(in, buffer);
+    bool binary = buffer.size() >= sizeof(kBinaryMagic) && std::memcmp(buffer.data(), kBinaryMagic, sizeof(kBinaryMagic)) == 0;
+    std::size_t start = binary ? sizeof(kBinaryMagic) : 0;
+    std::size_t number = 0;
+    bool more = true;
+    while (start < buffer.size() || more) {
+        // Responses point into the buffer, which must not move from here on.
+        std::size_t length = buffer.size();
+        buffer.append(kLoadSlack, '\0');
+        char* data = &buffer[0];
+        batch.clear();
+        std::size_t consumed = start;
+        if (binary) {
+            while (true) {
+                std::size_t p = consumed;
+                if (p + 2 > length) {
+                    break;
+                }
+                std::size_t nameLength = readLittleEndian(data + p, 2);
+                if (p + 2 + nameLength + 6 > length) {
+                    break;
+                }
+                std::size_t answerCount = readLittleEndian(data + p + 2 + nameLength + 4, 2);
+                std::size_t recordEnd = p + 2 + nameLength + 6 + answerCount;
+                if (recordEnd > length) {
+                    break;
+                }
+                Response response;
+                response.student = std::string_view(data + p + 2, nameLength);
+                response.variant = readLittleEndian(data + p + 2 + nameLength, 4);
+                response.answers = data + p + 2 + nameLength + 6;
+                response.answerCount = answerCount;
+                ++number;
+                ++report.responses;
+                if (keys.contains(response.variant)) {
+                    batch.push_back(response);
+                } else {
+                    reject(report, number, true);
+                }
+                consumed = recordEnd;
+            }
+        } else {
+            while (consumed < length) {
+                char* lineBegin = data + consumed;
+                char* newline = static_cast<char*>(std::memchr(lineBegin, '\n', length - consumed));
+                if (!newline && more) {
+                    break;
+                }
+                char* lineEnd = newline ? newline : data + length;
+                consumed = static_cast<std::size_t>(lineEnd - data) + (newline ? 1 : 0);
+                ++number;
+                if (lineEnd > lineBegin && lineEnd[-1] == '\r') {
+                    --lineEnd;
+                }
+                std::string_view line(lineBegin, static_cast<std::size_t>(lineEnd - lineBegin));
+                if (line.empty() || (number == 1 && line.rfind("student", 0) == 0)) {
+                    continue;
+                }
+                ++report.responses;
+                Response response;
+                if (!parseCsvLine(lineBegin, lineEnd, response)) {
+                    reject(report, number, false);
+                } else if (!keys.contains(response.variant)) {
+                    reject(report, number, true);
+                } else {
+                    batch.push_back(response);
+                }
+            }
+        }
+        gradeBatch(batch, keys, totals, items);
+        report.graded += batch.size();
+
+        buffer.erase(0, consumed);
+        buffer.resize(length - consumed);
+        start = 0;
+        if (!more) {
+            if (!buffer.empty()) {
+                // A binary record cut short by the end of the file.
+                ++report.responses;
+                reject(report, number + 1, false);
+            }
+            break;
+        }
+        more = readBlock(in, buffer);
+    }
+    report.millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
+
+void GradingReport::dump(std::ostream& out) const {
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(1) << graded << " of " << responses << " responses graded in " << millis << " ms";
+    if (millis > 0) {
+        out << " (" << std::setprecision(0) << responses * 1000.0 / millis << " per second)";
+    }
+    out << "\n";
+    if (unknownVariants > 0) {
+        out << unknownVariants << " for variants that are not in the archive\n";
+    }
+    if (malformed > 0) {
+        out << malformed << " malformed\n";
+    }
+    if (!rejected.empty()) {
+        out << "first rejected at:";
+        for (std::size_t number : rejected) {
+            out << " " << number;
+        }
+        out << "\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
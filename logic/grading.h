@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "archive.h"
+#include "quiz.h"
+
+// Answer key of every archived variant: one byte per question in variant
+// order, 'A' + correctOptionIndex, or kUngraded where the question has no
+// options or is no longer in the bank. Options are printed in bank order,
+// so this is the letter a student sees next to the right answer.
+class AnswerKeys {
+public:
+    static constexpr char kUngraded = '\0';
+
+    AnswerKeys(const VariantArchive& archive, const QuestionDatabase& db);
+
+    std::size_t size() const { return offsets.size() - 1; }
+    bool contains(std::uint32_t variant) const { return variant < size(); }
+    std::string_view answers(std::uint32_t variant) const {
+        return std::string_view(answerBytes).substr(offsets[variant], offsets[variant + 1] - offsets[variant]);
+    }
+    const QuestionId* questionIds(std::uint32_t variant) const { return ids.data() + offsets[variant]; }
+
+private:
+    // Variant v owns [offsets[v], offsets[v + 1]) of both; answerBytes ends
+    // in spare bytes so that vector loads may run past the last key.
+    std::vector<std::size_t> offsets;
+    std::string answerBytes;
+    std::vector<QuestionId> ids;
+};
+
+struct GradingReport {
+    std::size_t responses = 0;
+    std::size_t graded = 0;
+    std::size_t unknownVariants = 0;
+    std::size_t malformed = 0;
+    // Line (CSV) or record (binary) numbers of the first rejected responses.
+    std::vector<std::size_t> rejected;
+    double millis = 0;
+
+    void dump(std::ostream& out) const;
+};
+
+// Grades student responses against `keys`. The input is either CSV, one
+// response per line (a header line starting with "student" is skipped):
+//
+//   student,variant,answers        e.g.  Иванов,12,ABD-CA
+//
+// or binary: the 8 bytes "MXRESP01", then per response a little-endian u16
+// name length, the name, a u32 variant and a u16 answer count followed by
+// the answers. `variant` is the archived variant number. Answers hold one
+// character per question: a letter (either case) or an option number 1-9;
+// anything else, or a missing answer, counts as unanswered.
+//
+// Responses are graded in batches on the shared TaskScheduler, comparing 16
+// answers at a time with SSE2 where available. Output is streamed in input
+// order: `totals` gets
+//
+//   student,variant,correct,answered,questions
+//
+// per graded response, counting only questions with a key, and `items` (if
+// given) one line per such question:
+//
+//   student,variant,position,question,answer,correct
+GradingReport gradeResponses(std::istream& in, const AnswerKeys& keys, std::ostream& totals, std::ostream* items = nullptr);
@@ -0,0 +1,128 @@
+#include "history.h"
+#include <algorithm>
+
+// Approximate heap footprint of a question and the pointer to it.
+static std::size_t questionBytes(const Question& question) {
+    std::size_t bytes = sizeof(std::shared_ptr<Question>) + sizeof(Question) + question.questionText.capacity();
+    if (question.options) {
+        bytes += question.options->size() * sizeof(StringId);
+    }
+    for (const auto& tag : question.tags) {
+        bytes += sizeof(std::string) + tag.capacity();
+    }
+    return bytes;
+}
+
+static std::size_t entryBytes(const HistoryEntry& entry) {
+    std::size_t bytes = sizeof(HistoryEntry) + entry.label.capacity();
+    for (const auto& question : entry.added) {
+        bytes += questionBytes(*question);
+    }
+    for (const auto& question : entry.removed) {
+        bytes += questionBytes(*question);
+    }
+    for (const auto& edit : entry.edited) {
+        bytes += questionBytes(*edit.first) + questionBytes(*edit.second);
+    }
+    bytes += entry.removedTopics.size() * (sizeof(std::pair<std::size_t, std::shared_ptr<Topic>>) + sizeof(Topic));
+    return bytes;
+}
+
+void EditHistory::record(HistoryEntry entry) {
+    for (const Charged& charged : redoStack) {
+        used -= charged.bytes;
+    }
+    redoStack.clear();
+    std::sort(entry.removedTopics.begin(), entry.removedTopics.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    std::size_t bytes = entryBytes(entry);
+    if (bytes > budget) {
+        // Older entries could no longer be undone in order.
+        clear();
+        return;
+    }
+    undoStack.push_back(Charged{std::move(entry), bytes});
+    used += bytes;
+    trim();
+}
+
+void EditHistory::undo(QuestionDatabase& db) {
+    Charged charged = std::move(undoStack.back());
+    undoStack.pop_back();
+    const HistoryEntry& entry = charged.entry;
+    // Topics go back first, so that their questions are unified with them.
+    for (const auto& removed : entry.removedTopics) {
+        const std::string& name = removed.second->name;
+        bool present = std::any_of(db.topics.begin(), db.topics.end(),
+                                   [&name](const std::shared_ptr<Topic>& topic) { return topic->name == name; });
+        if (!present) {
+            db.topics.insert(db.topics.begin() + std::min(removed.first, db.topics.size()), removed.second);
+        }
+    }
+    QuestionBatch batch;
+    for (const auto& edit : entry.edited) {
+        batch.edited.emplace_back(edit.second->id, edit.first);
+    }
+    for (const auto& question : entry.added) {
+        batch.removed.push_back(question->id);
+    }
+    batch.restored = entry.removed;
+    db.applyBatch(batch);
+    redoStack.push_back(std::move(charged));
+}
+
+void EditHistory::redo(QuestionDatabase& db) {
+    Charged charged = std::move(redoStack.back());
+    redoStack.pop_back();
+    const HistoryEntry& entry = charged.entry;
+    QuestionBatch batch;
+    for (const auto& edit : entry.edited) {
+        batch.edited.emplace_back(edit.first->id, edit.second);
+    }
+    for (const auto& question : entry.removed) {
+        batch.removed.push_back(question->id);
+    }
+    batch.restored = entry.added;
+    db.applyBatch(batch);
+    for (const auto& removed : entry.removedTopics) {
+        db.topics.erase(std::remove(db.topics.begin(), db.topics.end(), removed.second), db.topics.end());
+    }
+    undoStack.push_back(std::move(charged));
+}
+
+void EditHistory::clear() {
+    undoStack.clear();
+    redoStack.clear();
+    used = 0;
+    updateCounted();
+}
+
+bool EditHistory::mentions(const std::unordered_set<QuestionId>& ids) const {
+    auto listed = [&ids](const HistoryEntry& entry) {
+        auto has = [&ids](const std::shared_ptr<Question>& question) { return ids.count(question->id) != 0; };
+        return std::any_of(entry.added.begin(), entry.added.end(), has) ||
+               std::any_of(entry.removed.begin(), entry.removed.end(), has) ||
+               std::any_of(entry.edited.begin(), entry.edited.end(),
+                           [&has](const auto& edit) { return has(edit.first) || has(edit.second); });
+    };
+    return std::any_of(undoStack.begin(), undoStack.end(), [&listed](const Charged& charged) { return listed(charged.entry); }) ||
+           std::any_of(redoStack.begin(), redoStack.end(), [&listed](const Charged& charged) { return listed(charged.entry); });
+}
+
+void EditHistory::setBudget(std::size_t budgetBytes) {
+    budget = budgetBytes;
+    trim();
+}
+
+void EditHistory::trim() {
+    while (used > budget && !undoStack.empty()) {
+        used -= undoStack.front().bytes;
+        undoStack.pop_front();
+    }
+    // Only a lowered budget gets here: the furthest redo goes first.
+    while (used > budget && !redoStack.empty()) {
+        used -= redoStack.front().bytes;
+        redoStack.erase(redoStack.begin());
+    }
+    updateCounted();
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "memory.h"
+#include "quiz.h"
+
+// One change to the bank, recorded after it was applied. An edit swaps in a
+// new Question object rather than changing the content fields (text,
+// options, answer, topic, tags) of the old one, so an entry holds the very
+// objects the bank held rather than copies, and undoing or redoing it
+// touches only the questions it lists. Bookkeeping fields do change in
+// place: usageCount grows as variants are recorded, and the id is
+// reassigned when a question is restored; applyBatch carries usageCount
+// over from the replaced object, so undoing an edit keeps exposure counts.
+struct HistoryEntry {
+    std::string label;
+    // In the bank after the change only.
+    std::vector<std::shared_ptr<Question>> added;
+    // In the bank before the change only.
+    std::vector<std::shared_ptr<Question>> removed;
+    // Before and after versions of edited questions.
+    std::vector<std::pair<std::shared_ptr<Question>, std::shared_ptr<Question>>> edited;
+    // Topics removed by the change, with their position in the topic list.
+    std::vector<std::pair<std::size_t, std::shared_ptr<Topic>>> removedTopics;
+};
+
+// Undo/redo stacks of HistoryEntry. Each entry is charged for its lists and
+// for every question it references, whether or not the bank still holds it;
+// the oldest entries are dropped once the charges exceed the budget. An entry
+// that alone exceeds it empties the history instead.
+class EditHistory {
+public:
+    static constexpr std::size_t kDefaultBudget = 64u << 20;
+
+    explicit EditHistory(std::size_t budgetBytes = kDefaultBudget) : budget(budgetBytes) {}
+
+    // Starts a new branch: whatever could be redone is dropped.
+    void record(HistoryEntry entry);
+    bool canUndo() const { return !undoStack.empty(); }
+    bool canRedo() const { return !redoStack.empty(); }
+    const std::string& undoLabel() const { return undoStack.back().entry.label; }
+    const std::string& redoLabel() const { return redoStack.back().entry.label; }
+    // Revert or reapply the latest entry; the caller checks canUndo/canRedo.
+    void undo(QuestionDatabase& db);
+    void redo(QuestionDatabase& db);
+    // E.g. after the bank was replaced or reloaded from disk, when the
+    // entries no longer describe it.
+    void clear();
+    // Whether an entry that can be undone or redone lists a question with
+    // one of `ids`.
+    bool mentions(const std::unordered_set<QuestionId>& ids) const;
+
+    std::size_t budgetBytes() const { return budget; }
+    void setBudget(std::size_t budgetBytes);
+    std::size_t usedBytes() const { return used; }
+    std::size_t undoCount() const { return undoStack.size(); }
+    std::size_t redoCount() const { return redoStack.size(); }
+
+private:
+    struct Charged {
+        HistoryEntry entry;
+        std::size_t bytes = 0;
+    };
+
+    void trim();
+    void updateCounted() { counted.set(used); }
+
+    std::deque<Charged> undoStack;
+    std::vector<Charged> redoStack;
+    std::size_t budget;
+    std::size_t used = 0;
+    CountedBytes<MemorySubsystem::History> counted;
+};
@@ -0,0 +1,374 @@
+#include "itemstats.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include "memory.h"
+#include "scheduler.h"
+#include "trace.h"
+
+static const std::size_t kBlockBytes = 1 << 20;
+static const std::size_t kRejectedListed = 10;
+static const std::size_t kUnanswered = ItemAccumulator::kChoices - 1;
+
+void ItemAccumulator::add(bool correct, double rest, char answer) {
+    double x = correct ? 1.0 : 0.0;
+    ++count;
+    double dx = x - meanCorrect;
+    double dy = rest - meanRest;
+    meanCorrect += dx / static_cast<double>(count);
+    meanRest += dy / static_cast<double>(count);
+    m2Correct += dx * (x - meanCorrect);
+    m2Rest += dy * (rest - meanRest);
+    coMoment += dx * (rest - meanRest);
+    ++choices[answer >= 'A' && answer <= 'Z' ? static_cast<std::size_t>(answer - 'A') : kUnanswered];
+    if (correct && key == '\0') {
+        key = answer;
+    }
+}
+
+void ItemAccumulator::merge(const ItemAccumulator& other) {
+    if (other.count == 0) {
+        return;
+    }
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    double n = static_cast<double>(count + other.count);
+    double weight = static_cast<double>(count) * static_cast<double>(other.count) / n;
+    double dx = other.meanCorrect - meanCorrect;
+    double dy = other.meanRest - meanRest;
+    m2Correct += other.m2Correct + dx * dx * weight;
+    m2Rest += other.m2Rest + dy * dy * weight;
+    coMoment += other.coMoment + dx * dy * weight;
+    meanCorrect += dx * static_cast<double>(other.count) / n;
+    meanRest += dy * static_cast<double>(other.count) / n;
+    count += other.count;
+    for (std::size_t k = 0; k < kChoices; ++k) {
+        choices[k] += other.choices[k];
+    }
+    if (key == '\0') {
+        key = other.key;
+    }
+}
+
+double ItemAccumulator::discrimination() const {
+    if (m2Correct <= 0 || m2Rest <= 0) {
+        return 0;
+    }
+    return coMoment / std::sqrt(m2Correct * m2Rest);
+}
+
+void ItemStatistics::addResponse(const Answer* answers, std::size_t count) {
+    std::size_t correctTotal = 0;
+    for (std::size_t k = 0; k < count; ++k) {
+        correctTotal += answers[k].correct;
+    }
+    double others = count > 1 ? static_cast<double>(count - 1) : 1.0;
+    for (std::size_t k = 0; k < count; ++k) {
+        double rest = static_cast<double>(correctTotal - answers[k].correct) / others;
+        accumulators[answers[k].question].add(answers[k].correct, rest, answers[k].choice);
+    }
+    ++responseCount;
+}
+
+void ItemStatistics::merge(const ItemStatistics& other) {
+    for (const auto& entry : other.accumulators) {
+        accumulators[entry.first].merge(entry.second);
+    }
+    responseCount += other.responseCount;
+}
+
+const ItemAccumulator* ItemStatistics::find(QuestionId question) const {
+    auto it = accumulators.find(question);
+    return it == accumulators.end() ? nullptr : &it->second;
+}
+
+// One CSV row; `fields` starts after "student,variant,".
+struct Row {
+    const char* fields = nullptr;
+    const char* end = nullptr;
+    std::size_t number = 0;
+};
+
+// Shard of the rows accumulated by one task.
+struct Shard {
+    ItemStatistics statistics;
+    std::size_t malformed = 0;
+    std::vector<std::size_t> rejected;
+    std::vector<ItemStatistics::Answer> answers;
+};
+
+// Length of the "student,variant," prefix of a line, 0 if it has none.
+static std::size_t responseKeyLength(const char* begin, const char* end) {
+    const char* p = begin;
+    if (p < end && *p == '"') {
+        for (++p; p < end; ++p) {
+            if (*p == '"') {
+                if (p + 1 < end && p[1] == '"') {
+                    ++p;
+                } else {
+                    break;
+                }
+            }
+        }
+        ++p;
+    } else {
+        p = static_cast<const char*>(std::memchr(p, ',', static_cast<std::size_t>(end - p)));
+    }
+    if (!p || p >= end || *p != ',') {
+        return 0;
+    }
+    ++p;
+    const char* comma = static_cast<const char*>(std::memchr(p, ',', static_cast<std::size_t>(end - p)));
+    if (!comma || comma == p) {
+        return 0;
+    }
+    return static_cast<std::size_t>(comma + 1 - begin);
+}
+
+// Parses "position,question,answer,correct".
+static bool parseRow(const Row& row, ItemStatistics::Answer& answer) {
+    const char* p = static_cast<const char*>(std::memchr(row.fields, ',', static_cast<std::size_t>(row.end - row.fields)));
+    if (!p) {
+        return false;
+    }
+    auto parsed = std::from_chars(p + 1, row.end, answer.question);
+    p = parsed.ptr;
+    if (parsed.ec != std::errc() || row.end - p != 4 || p[0] != ',' || p[2] != ',' || (p[3] != '0' && p[3] != '1')) {
+        return false;
+    }
+    char choice = p[1];
+    if (choice >= 'a' && choice <= 'z') {
+        choice = static_cast<char>(choice - 'a' + 'A');
+    }
+    answer.choice = choice >= 'A' && choice <= 'Z' ? choice : '-';
+    answer.correct = p[3] == '1';
+    return true;
+}
+
+static void reject(std::size_t& malformed, std::vector<std::size_t>& rejected, std::size_t number) {
+    ++malformed;
+    if (rejected.size() < kRejectedListed) {
+        rejected.push_back(number);
+    }
+}
+
+// Accumulates responses [begin, end) of `rows`, delimited by `starts`.
+static void accumulate(Shard& shard, const std::vector<Row>& rows, const std::vector<std::size_t>& starts,
+                       std::size_t begin, std::size_t end) {
+    for (std::size_t r = begin; r < end; ++r) {
+        shard.answers.clear();
+        for (std::size_t k = starts[r]; k < starts[r + 1]; ++k) {
+            ItemStatistics::Answer answer;
+            if (parseRow(rows[k], answer)) {
+                shard.answers.push_back(answer);
+            } else {
+                reject(shard.malformed, shard.rejected, rows[k].number);
+            }
+        }
+        if (!shard.answers.empty()) {
+            shard.statistics.addResponse(shard.answers.data(), shard.answers.size());
+        }
+    }
+}
+
+static bool readBlock(std::istream& in, std::string& buffer) {
+    std::size_t kept = buffer.size();
+    buffer.resize(kept + kBlockBytes);
+    in.read(&buffer[kept], static_cast<std::streamsize>(kBlockBytes));
+    buffer.resize(kept + static_cast<std::size_t>(in.gcount()));
+    return in.gcount() > 0;
+}
+
+ItemAnalysis analyzeItems(std::istream& in) {
+    TraceScope trace("analyze_items", "io");
+    auto started = std::chrono::steady_clock::now();
+    ItemAnalysis analysis;
+    std::vector<Shard> shards(TaskScheduler::instance().concurrency());
+    std::vector<Row> rows;
+    std::vector<std::size_t> starts;
+    std::string buffer;
+    std::size_t number = 0;
+    bool more = readBlock(in, buffer);
+    while (!buffer.empty()) {
+        const char* data = buffer.data();
+        std::size_t length = buffer.size();
+        rows.clear();
+        starts.clear();
+        std::string_view previousKey;
+        // Where the last response started, so that it can be held back until
+        // the next block shows whether it is complete.
+        std::size_t lastStart = 0;
+        std::size_t lastStartLine = number;
+        std::size_t rowsBefore = analysis.rows;
+        std::size_t malformedBefore = analysis.malformed;
+        std::size_t rejectedBefore = analysis.rejected.size();
+        std::size_t consumed = 0;
+        while (consumed < length) {
+            const char* lineBegin = data + consumed;
+            const char* newline = static_cast<const char*>(std::memchr(lineBegin, '\n', length - consumed));
+            if (!newline && more) {
+                break;
+            }
+            const char* lineEnd = newline ? newline : data + length;
+            std::size_t lineOffset = consumed;
+            consumed = static_cast<std::size_t>(lineEnd - data) + (newline ? 1 : 0);
+            ++number;
+            if (lineEnd > lineBegin && lineEnd[-1] == '\r') {
+                --lineEnd;
+            }
+            std::string_view line(lineBegin, static_cast<std::size_t>(lineEnd - lineBegin));
+            if (line.empty() || (number == 1 && line.rfind("student", 0) == 0)) {
+                continue;
+            }
+            ++analysis.rows;
+            std::size_t keyLength = responseKeyLength(lineBegin, lineEnd);
+            if (keyLength == 0) {
+                reject(analysis.malformed, analysis.rejected, number);
+                continue;
+            }
+            std::string_view key = line.substr(0, keyLength);
+            if (starts.empty() || key != previousKey) {
+                starts.push_back(rows.size());
+                previousKey = key;
+                lastStart = lineOffset;
+                lastStartLine = number - 1;
+                rowsBefore = analysis.rows - 1;
+                malformedBefore = analysis.malformed;
+                rejectedBefore = analysis.rejected.size();
+            }
+            rows.push_back(Row{lineBegin + keyLength, lineEnd, number});
+        }
+        if (more && !starts.empty()) {
+            // The last response may go on in the next block.
+            analysis.rows = rowsBefore;
+            analysis.malformed = malformedBefore;
+            analysis.rejected.resize(rejectedBefore);
+            rows.resize(starts.back());
+            starts.pop_back();
+            consumed = lastStart;
+            number = lastStartLine;
+        }
+        starts.push_back(rows.size());
+
+        std::size_t responses = starts.size() - 1;
+        std::size_t shardCount = shards.size();
+        parallelFor(shardCount, 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t s = begin; s < end; ++s) {
+                accumulate(shards[s], rows, starts, responses * s / shardCount, responses * (s + 1) / shardCount);
+            }
+        });
+
+        buffer.erase(0, consumed);
+        if (!more) {
+            break;
+        }
+        more = readBlock(in, buffer);
+    }
+
+    for (Shard& shard : shards) {
+        analysis.statistics.merge(shard.statistics);
+        analysis.malformed += shard.malformed;
+        analysis.rejected.insert(analysis.rejected.end(), shard.rejected.begin(), shard.rejected.end());
+    }
+    std::sort(analysis.rejected.begin(), analysis.rejected.end());
+    if (analysis.rejected.size() > kRejectedListed) {
+        analysis.rejected.resize(kRejectedListed);
+    }
+    analysis.millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    return analysis;
+}
+
+void ItemAnalysis::dump(std::ostream& out, std::size_t maxListed, std::uint64_t minResponses) const {
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    const auto& items = statistics.items();
+    out << std::fixed << std::setprecision(1) << rows << " rows, " << statistics.responses() << " responses, "
+        << items.size() << " questions in " << millis << " ms";
+    if (millis > 0) {
+        out << " (" << std::setprecision(0) << rows * 1000.0 / millis << " rows per second)";
+    }
+    out << "\n";
+    if (malformed > 0) {
+        out << malformed << " malformed, first at line(s):";
+        for (std::size_t line : rejected) {
+            out << " " << line;
+        }
+        out << "\n";
+    }
+
+    std::vector<std::pair<QuestionId, const ItemAccumulator*>> listed;
+    for (const auto& entry : items) {
+        if (entry.second.count >= minResponses) {
+            listed.emplace_back(entry.first, &entry.second);
+        }
+    }
+    std::sort(listed.begin(), listed.end(), [](const auto& a, const auto& b) {
+        double ra = a.second->discrimination();
+        double rb = b.second->discrimination();
+        return ra != rb ? ra < rb : a.first < b.first;
+    });
+    if (listed.size() > maxListed) {
+        listed.resize(maxListed);
+    }
+    if (!listed.empty()) {
+        out << "Least discriminating questions with at least " << minResponses << " responses"
+            << " (p: share correct, r: point-biserial, * marks the key):\n";
+    }
+    for (const auto& entry : listed) {
+        const ItemAccumulator& item = *entry.second;
+        out << "[" << entry.first << "] n=" << item.count << std::setprecision(2) << " p=" << item.difficulty()
+            << " r=" << item.discrimination() << " " << std::setprecision(0);
+        for (std::size_t k = 0; k < ItemAccumulator::kChoices; ++k) {
+            if (item.choices[k] == 0) {
+                continue;
+            }
+            char choice = k == kUnanswered ? '-' : static_cast<char>('A' + k);
+            out << " " << choice << (choice == item.key ? "*" : "") << " "
+                << item.choices[k] * 100.0 / static_cast<double>(item.count) << "%";
+        }
+        out << "\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+std::size_t tagItemStatistics(QuestionDatabase& db, const ItemStatistics& statistics, const ItemTagOptions& options) {
+    QuestionBatch batch;
+    for (const auto& entry : statistics.items()) {
+        const ItemAccumulator& item = entry.second;
+        if (item.count < options.minResponses) {
+            continue;
+        }
+        auto question = db.findQuestionById(entry.first);
+        if (!question) {
+            continue;
+        }
+        double p = item.difficulty();
+        double r = item.discrimination();
+        std::string difficulty = p > options.easyAbove ? "difficulty:easy" : p < options.hardBelow ? "difficulty:hard" : "difficulty:medium";
+        std::string discrimination = r >= options.goodFrom ? "discrimination:good" : r < options.poorBelow ? "discrimination:poor" : "discrimination:fair";
+        std::vector<std::string> tags;
+        for (const auto& tag : question->tags) {
+            if (tag.rfind("difficulty:", 0) != 0 && tag.rfind("discrimination:", 0) != 0) {
+                tags.push_back(tag);
+            }
+        }
+        tags.push_back(difficulty);
+        tags.push_back(discrimination);
+        if (tags == question->tags) {
+            continue;
+        }
+        auto retagged = makeCounted<MemorySubsystem::Questions, Question>(*question);
+        retagged->tags = std::move(tags);
+        batch.edited.emplace_back(entry.first, retagged);
+    }
+    db.applyBatch(batch);
+    return batch.edited.size();
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "quiz.h"
+
+// Running statistics of one question over the responses that included it.
+// Moments are Welford-style, so shards of the responses can be accumulated
+// independently and merged without loss of precision.
+struct ItemAccumulator {
+    // Choices 'A'-'Z', then unanswered.
+    static constexpr std::size_t kChoices = 27;
+
+    std::uint64_t count = 0;
+    // Of x (1 when answered correctly) and y (the student's rest score: the
+    // fraction of the other questions of the response answered correctly).
+    double meanCorrect = 0;
+    double meanRest = 0;
+    double m2Correct = 0;
+    double m2Rest = 0;
+    double coMoment = 0;
+    std::array<std::uint32_t, kChoices> choices = {};
+    // The letter seen on correct answers, '\0' until one was seen.
+    char key = '\0';
+
+    void add(bool correct, double rest, char answer);
+    void merge(const ItemAccumulator& other);
+
+    // Classical difficulty: the share of students who answered correctly.
+    double difficulty() const { return meanCorrect; }
+    // Point-biserial correlation of correctness with the rest score; 0 when
+    // either does not vary.
+    double discrimination() const;
+};
+
+class ItemStatistics {
+public:
+    struct Answer {
+        QuestionId question = 0;
+        // 'A'-'Z', or '-' when unanswered.
+        char choice = '-';
+        bool correct = false;
+    };
+
+    // Adds the answers of one student to one variant.
+    void addResponse(const Answer* answers, std::size_t count);
+    void merge(const ItemStatistics& other);
+
+    std::size_t responses() const { return responseCount; }
+    const std::unordered_map<QuestionId, ItemAccumulator>& items() const { return accumulators; }
+    const ItemAccumulator* find(QuestionId question) const;
+
+private:
+    std::unordered_map<QuestionId, ItemAccumulator> accumulators;
+    std::size_t responseCount = 0;
+};
+
+struct ItemAnalysis {
+    ItemStatistics statistics;
+    std::size_t rows = 0;
+    std::size_t malformed = 0;
+    // Line numbers of the first malformed rows.
+    std::vector<std::size_t> rejected;
+    double millis = 0;
+
+    // Lists at most `maxListed` of the least discriminating questions that
+    // have at least `minResponses` responses.
+    void dump(std::ostream& out, std::size_t maxListed = 20, std::uint64_t minResponses = 30) const;
+};
+
+// Reads per-question results as written by gradeResponses:
+//
+//   student,variant,position,question,answer,correct
+//
+// in a single pass. The rows of one response must be consecutive; a new
+// response starts wherever student or variant change. Rows are split into
+// responses on the reading thread and the responses are accumulated into
+// per-worker shards on the shared TaskScheduler, which are merged at the end.
+ItemAnalysis analyzeItems(std::istream& in);
+
+struct ItemTagOptions {
+    // Questions with fewer responses keep their tags.
+    std::uint64_t minResponses = 30;
+    // difficulty:easy above, difficulty:hard below, difficulty:medium between.
+    double easyAbove = 0.8;
+    double hardBelow = 0.3;
+    // discrimination:good from, discrimination:poor below, discrimination:fair between.
+    double goodFrom = 0.4;
+    double poorBelow = 0.2;
+};
+
+// Replaces the "difficulty:" and "discrimination:" tags of every question
+// with enough responses by ones derived from `statistics`, so that variant
+// specs can filter on them. Returns how many questions were retagged.
+std::size_t tagItemStatistics(QuestionDatabase& db, const ItemStatistics& statistics,
+                              const ItemTagOptions& options = ItemTagOptions());
@@ -0,0 +1,56 @@
+#include "loader.h"
+#include <chrono>
+#include "trace.h"
+
+BankLoader::BankLoader(const std::string& filePath, bool verbose)
+    : filePath(filePath), verbose(verbose), result(promise.get_future().share()) {}
+
+BankLoader::~BankLoader() {}
+
+void BankLoader::start(TopicCallback onTopic, FinishedCallback onFinished) {
+    task.run([this, onTopic, onFinished]() {
+        TraceScope trace("bank_loader", "io");
+        std::shared_ptr<QuestionDatabase> staging = std::make_shared<QuestionDatabase>();
+        std::exception_ptr error;
+        try {
+            staging->verbose = verbose;
+            QuestionDatabase::TopicCallback topicCallback;
+            if (onTopic) {
+                topicCallback = [&onTopic](const std::shared_ptr<Topic>& topic) {
+                    onTopic(topic->name);
+                };
+            }
+            // The parse runs in a group holding the token, so the groups it
+            // fans out into stop too; this task itself always finishes.
+            TaskGroup load(token);
+            load.run([&]() { staging->openBank(filePath, topicCallback); });
+            load.wait();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        // Callbacks run before the result is published, so once wait() returns
+        // the worker no longer touches anything the caller owns.
+        if (onFinished) {
+            onFinished();
+        }
+        if (error) {
+            promise.set_exception(error);
+        } else {
+            promise.set_value(staging);
+        }
+    });
+}
+
+void BankLoader::cancel() {
+    token->cancel();
+}
+
+bool BankLoader::isReady() const {
+    return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+std::shared_ptr<QuestionDatabase> BankLoader::wait() {
+    // Runs the load here if no worker has picked it up yet.
+    task.wait();
+    return result.get();
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include "quiz.h"
+#include "scheduler.h"
+
+// Opens a bank as a task on the shared scheduler into a staging database, so
+// the UI can come up before the bank is available. Segmented banks only read
+// their manifest here. Callbacks run on the task's thread and must not block
+// on wait().
+class BankLoader {
+public:
+    using TopicCallback = std::function<void(const std::string& topicName)>;
+    using FinishedCallback = std::function<void()>;
+
+    BankLoader(const std::string& filePath, bool verbose = false);
+    ~BankLoader();
+
+    BankLoader(const BankLoader&) = delete;
+    BankLoader& operator=(const BankLoader&) = delete;
+
+    void start(TopicCallback onTopic = nullptr, FinishedCallback onFinished = nullptr);
+    // Stops parsing at the next task boundary; onFinished still runs.
+    void cancel();
+    bool isReady() const;
+    // Blocks until loading finishes; rethrows any parse error, or
+    // OperationCancelled after cancel().
+    std::shared_ptr<QuestionDatabase> wait();
+
+private:
+    std::string filePath;
+    bool verbose;
+    std::shared_ptr<CancellationToken> token = std::make_shared<CancellationToken>();
+    std::promise<std::shared_ptr<QuestionDatabase>> promise;
+    std::shared_future<std::shared_ptr<QuestionDatabase>> result;
+    // Last, so it waits for the task before anything the task uses goes.
+    TaskGroup task;
+};
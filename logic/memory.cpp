@@ -0,0 +1,95 @@
+#include "memory.h"
+#include <iomanip>
+#include <sstream>
+
+MemoryStats& MemoryStats::instance() {
+    static MemoryStats stats;
+    return stats;
+}
+
+const char* MemoryStats::subsystemName(MemorySubsystem subsystem) {
+    switch (subsystem) {
+        case MemorySubsystem::Questions: return "questions";
+        case MemorySubsystem::Options: return "options";
+        case MemorySubsystem::Strings: return "strings";
+        case MemorySubsystem::Topics: return "topics";
+        case MemorySubsystem::TopicIndex: return "topic_index";
+        case MemorySubsystem::Render: return "render";
+        case MemorySubsystem::Import: return "import";
+        case MemorySubsystem::History: return "history";
+        case MemorySubsystem::Count: break;
+    }
+    return "unknown";
+}
+
+void MemoryStats::allocated(MemorySubsystem subsystem, std::size_t bytes) {
+    Counters& counter = counters[static_cast<int>(subsystem)];
+    std::uint64_t live = counter.live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    counter.allocations.fetch_add(1, std::memory_order_relaxed);
+    std::uint64_t peak = counter.peak.load(std::memory_order_relaxed);
+    while (live > peak && !counter.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void MemoryStats::released(MemorySubsystem subsystem, std::size_t bytes) {
+    counters[static_cast<int>(subsystem)].live.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+MemoryUsage MemoryStats::usage(MemorySubsystem subsystem) const {
+    const Counters& counter = counters[static_cast<int>(subsystem)];
+    MemoryUsage result;
+    result.liveBytes = counter.live.load(std::memory_order_relaxed);
+    result.peakBytes = counter.peak.load(std::memory_order_relaxed);
+    result.allocations = counter.allocations.load(std::memory_order_relaxed);
+    return result;
+}
+
+std::uint64_t MemoryStats::totalLiveBytes() const {
+    std::uint64_t total = 0;
+    for (const auto& counter : counters) {
+        total += counter.live.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+static std::string formatBytes(std::uint64_t bytes) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    if (bytes < 1024) {
+        out << bytes << " B";
+    } else if (bytes < 1024 * 1024) {
+        out << bytes / 1024.0 << " KB";
+    } else {
+        out << bytes / (1024.0 * 1024.0) << " MB";
+    }
+    return out.str();
+}
+
+void MemoryStats::dump(std::ostream& out) const {
+    out << std::left << std::setw(16) << "subsystem"
+        << std::right << std::setw(12) << "live"
+        << std::setw(12) << "peak"
+        << std::setw(14) << "allocations" << "\n";
+    for (int i = 0; i < static_cast<int>(MemorySubsystem::Count); ++i) {
+        MemoryUsage current = usage(static_cast<MemorySubsystem>(i));
+        out << std::left << std::setw(16) << subsystemName(static_cast<MemorySubsystem>(i))
+            << std::right << std::setw(12) << formatBytes(current.liveBytes)
+            << std::setw(12) << formatBytes(current.peakBytes)
+            << std::setw(14) << current.allocations << "\n";
+    }
+    out << std::left << std::setw(16) << "total" << std::right << std::setw(12) << formatBytes(totalLiveBytes()) << "\n";
+}
+
+std::string MemoryStats::summary() const {
+    std::string text = formatBytes(totalLiveBytes());
+    std::string parts;
+    for (int i = 0; i < static_cast<int>(MemorySubsystem::Count); ++i) {
+        MemoryUsage current = usage(static_cast<MemorySubsystem>(i));
+        if (current.liveBytes == 0) {
+            continue;
+        }
+        parts += std::string(parts.empty() ? "" : ", ") + subsystemName(static_cast<MemorySubsystem>(i)) + " " +
+                 formatBytes(current.liveBytes);
+    }
+    return parts.empty() ? text : text + " (" + parts + ")";
+}
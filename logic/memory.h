@@ -0,0 +1,144 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Subsystems whose heap use is counted. Keep subsystemName() in sync.
+enum class MemorySubsystem {
+    // Question objects with their shared_ptr control blocks.
+    Questions,
+    // Per-question option id vectors.
+    Options,
+    // Interned option texts (StringPool).
+    Strings,
+    Topics,
+    // Tag and topic bitmaps (TagIndex).
+    TopicIndex,
+    // Documents being rendered.
+    Render,
+    // Bank files being read and parsed.
+    Import,
+    // Undo/redo entries (EditHistory), as charged against its budget.
+    History,
+    Count
+};
+
+struct MemoryUsage {
+    std::uint64_t liveBytes = 0;
+    std::uint64_t peakBytes = 0;
+    std::uint64_t allocations = 0;
+};
+
+// Lock-free live/peak byte counters per subsystem, fed by CountingAllocator
+// and CountedBytes. Only what goes through them is counted: e.g. the text of
+// a question (a plain std::string member) is not.
+class MemoryStats {
+public:
+    static MemoryStats& instance();
+    static const char* subsystemName(MemorySubsystem subsystem);
+
+    void allocated(MemorySubsystem subsystem, std::size_t bytes);
+    void released(MemorySubsystem subsystem, std::size_t bytes);
+    MemoryUsage usage(MemorySubsystem subsystem) const;
+    std::uint64_t totalLiveBytes() const;
+
+    void dump(std::ostream& out) const;
+    // Live bytes on one line, e.g. "13.4 MB (questions 12.3 MB, options 1.1 MB)".
+    std::string summary() const;
+
+private:
+    struct Counters {
+        std::atomic<std::uint64_t> live{0};
+        std::atomic<std::uint64_t> peak{0};
+        std::atomic<std::uint64_t> allocations{0};
+    };
+
+    MemoryStats() = default;
+    Counters counters[static_cast<int>(MemorySubsystem::Count)];
+};
+
+// std::allocator that reports every block to MemoryStats under Subsystem.
+template <typename T, MemorySubsystem Subsystem>
+class CountingAllocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = CountingAllocator<U, Subsystem>;
+    };
+
+    CountingAllocator() noexcept = default;
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U, Subsystem>&) noexcept {}
+
+    T* allocate(std::size_t count) {
+        T* block = std::allocator<T>().allocate(count);
+        MemoryStats::instance().allocated(Subsystem, count * sizeof(T));
+        return block;
+    }
+
+    void deallocate(T* block, std::size_t count) noexcept {
+        MemoryStats::instance().released(Subsystem, count * sizeof(T));
+        std::allocator<T>().deallocate(block, count);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U, Subsystem>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const CountingAllocator<U, Subsystem>&) const noexcept { return false; }
+};
+
+template <typename T, MemorySubsystem Subsystem>
+using CountedVector = std::vector<T, CountingAllocator<T, Subsystem>>;
+
+template <MemorySubsystem Subsystem>
+using CountedString = std::basic_string<char, std::char_traits<char>, CountingAllocator<char, Subsystem>>;
+
+// make_shared whose single block (object and control block) is counted.
+template <MemorySubsystem Subsystem, typename T, typename... Args>
+std::shared_ptr<T> makeCounted(Args&&... args) {
+    return std::allocate_shared<T>(CountingAllocator<T, Subsystem>(), std::forward<Args>(args)...);
+}
+
+// A byte total that its owner measures itself (for structures that do not
+// take an allocator); set() reports the change. Copies count again, moves
+// hand the total over, and destruction releases it.
+template <MemorySubsystem Subsystem>
+class CountedBytes {
+public:
+    CountedBytes() = default;
+    CountedBytes(const CountedBytes& other) { set(other.bytes); }
+    CountedBytes(CountedBytes&& other) noexcept : bytes(other.bytes) { other.bytes = 0; }
+    CountedBytes& operator=(const CountedBytes& other) {
+        set(other.bytes);
+        return *this;
+    }
+    CountedBytes& operator=(CountedBytes&& other) noexcept {
+        if (this != &other) {
+            set(0);
+            bytes = other.bytes;
+            other.bytes = 0;
+        }
+        return *this;
+    }
+    ~CountedBytes() { set(0); }
+
+    std::size_t get() const { return bytes; }
+    void set(std::size_t value) {
+        if (value > bytes) {
+            MemoryStats::instance().allocated(Subsystem, value - bytes);
+        } else if (value < bytes) {
+            MemoryStats::instance().released(Subsystem, bytes - value);
+        }
+        bytes = value;
+    }
+
+private:
+    std::size_t bytes = 0;
+};
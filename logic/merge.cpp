@@ -0,0 +1,131 @@
+#include "merge.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <iomanip>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include "scheduler.h"
+#include "trace.h"
+
+static double millisSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::vector<std::uint64_t> hashQuestions(const std::vector<std::shared_ptr<Question>>& questions) {
+    std::vector<std::uint64_t> hashes(questions.size());
+    parallelFor(questions.size(), 4096, [&questions, &hashes](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            hashes[i] = questions[i]->contentHash();
+        }
+    });
+    return hashes;
+}
+
+// One input file, parsed and hashed by a task.
+struct ParsedBank {
+    QuestionDatabase db;
+    std::vector<std::uint64_t> hashes;
+    std::exception_ptr error;
+};
+
+MergeReport mergeBanks(QuestionDatabase& db, const std::vector<std::string>& paths) {
+    TraceScope trace("merge_banks", "io", static_cast<std::int64_t>(paths.size()));
+    MergeReport report;
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<ParsedBank> parsed(paths.size());
+    TaskGroup group;
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        group.run([&paths, &parsed, i]() {
+            ParsedBank& bank = parsed[i];
+            try {
+                // openBank would create a missing bank instead of failing.
+                if (!std::filesystem::exists(paths[i])) {
+                    throw std::runtime_error("file not found");
+                }
+                bank.db.openBank(paths[i]);
+                bank.db.loadAllSegments();
+                bank.hashes = hashQuestions(bank.db.questions);
+            } catch (...) {
+                bank.error = std::current_exception();
+            }
+        });
+    }
+    group.wait();
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        if (!parsed[i].error) {
+            continue;
+        }
+        try {
+            std::rethrow_exception(parsed[i].error);
+        } catch (const std::exception& e) {
+            throw std::runtime_error("Could not read " + paths[i] + ": " + e.what());
+        }
+    }
+    report.parseMillis = millisSince(start);
+
+    start = std::chrono::steady_clock::now();
+    std::unordered_multimap<std::uint64_t, const Question*> seen;
+    auto existing = db.getAllQuestions();
+    std::size_t incoming = 0;
+    for (const auto& bank : parsed) {
+        incoming += bank.hashes.size();
+    }
+    seen.reserve(existing.size() + incoming);
+    auto existingHashes = hashQuestions(existing);
+    for (std::size_t i = 0; i < existing.size(); ++i) {
+        seen.emplace(existingHashes[i], existing[i].get());
+    }
+    std::unordered_set<std::string> topicNames;
+    for (const auto& topic : db.topics) {
+        topicNames.insert(topic->name);
+    }
+
+    QuestionBatch batch;
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        MergedFile file;
+        file.path = paths[i];
+        const auto& bankQuestions = parsed[i].db.questions;
+        file.questions = bankQuestions.size();
+        for (std::size_t j = 0; j < bankQuestions.size(); ++j) {
+            const auto& question = bankQuestions[j];
+            auto range = seen.equal_range(parsed[i].hashes[j]);
+            bool duplicate = std::any_of(range.first, range.second, [&question](const auto& entry) {
+                return entry.second->sameContent(*question);
+            });
+            if (duplicate) {
+                ++file.duplicates;
+                continue;
+            }
+            seen.emplace(parsed[i].hashes[j], question.get());
+            if (topicNames.insert(question->topic->name).second) {
+                ++report.newTopics;
+            }
+            batch.added.push_back(question);
+        }
+        report.questionsRead += file.questions;
+        report.duplicates += file.duplicates;
+        report.files.push_back(file);
+    }
+    // One batch, so topics are unified and sorted once for all files.
+    db.applyBatch(batch);
+    report.added = batch.added.size();
+    report.mergeMillis = millisSince(start);
+    return report;
+}
+
+void MergeReport::dump(std::ostream& out) const {
+    out << "Merged " << files.size() << " files: " << questionsRead << " questions read, "
+        << duplicates << " duplicates dropped, " << added << " added, "
+        << newTopics << " new topics\n";
+    for (const auto& file : files) {
+        out << "  " << file.path << ": " << file.questions << " questions, "
+            << file.duplicates << " duplicates\n";
+    }
+    out << std::fixed << std::setprecision(1)
+        << "Parsed in " << parseMillis << " ms, merged in " << mergeMillis << " ms\n";
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "quiz.h"
+
+struct MergedFile {
+    std::string path;
+    std::size_t questions = 0;
+    std::size_t duplicates = 0;
+};
+
+struct MergeReport {
+    std::vector<MergedFile> files;
+    std::size_t questionsRead = 0;
+    std::size_t duplicates = 0;
+    std::size_t added = 0;
+    std::size_t newTopics = 0;
+    double parseMillis = 0;
+    double mergeMillis = 0;
+
+    void dump(std::ostream& out) const;
+};
+
+// Merges bank files (or segmented bank directories) into `db`. The files are
+// parsed as tasks on the shared scheduler, then combined in the order given:
+// a question whose text, type, options, answer and topic match one already
+// in the bank or in an earlier file is dropped. `db` is only changed once
+// every file parsed, so a bad file leaves it untouched.
+MergeReport mergeBanks(QuestionDatabase& db, const std::vector<std::string>& paths);
@@ -0,0 +1,322 @@
+#include "overlap.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include "bits.h"
+#include "scheduler.h"
+#include "trace.h"
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define OVERLAP_X86 1
+#endif
+
+// Popcount of a AND b over `words` words.
+using DenseKernel = std::uint64_t (*)(const std::uint64_t* a, const std::uint64_t* b, std::size_t words);
+
+static inline std::uint64_t andCountPortable(const std::uint64_t* a, const std::uint64_t* b, std::size_t words) {
+    std::uint64_t count = 0;
+    for (std::size_t k = 0; k < words; ++k) {
+        count += popCount(a[k] & b[k]);
+    }
+    return count;
+}
+
+#ifdef OVERLAP_X86
+// The portable body again, inlined where popCount becomes one instruction.
+__attribute__((target("popcnt"))) static std::uint64_t andCountPopcnt(const std::uint64_t* a, const std::uint64_t* b,
+                                                                      std::size_t words) {
+    return andCountPortable(a, b, words);
+}
+
+// Four words at a time: each nibble is counted with a vpshufb table lookup,
+// and vpsadbw sums the byte counts into 64-bit lanes.
+__attribute__((target("avx2,popcnt"))) static std::uint64_t andCountAvx2(const std::uint64_t* a, const std::uint64_t* b,
+                                                                         std::size_t words) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowNibbles = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+    std::size_t k = 0;
+    for (; k + 4 <= words; k += 4) {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k)),
+                                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k)));
+        __m256i low = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, lowNibbles));
+        __m256i high = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), lowNibbles));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256()));
+    }
+    std::uint64_t count = static_cast<std::uint64_t>(_mm256_extract_epi64(total, 0)) +
+                          static_cast<std::uint64_t>(_mm256_extract_epi64(total, 1)) +
+                          static_cast<std::uint64_t>(_mm256_extract_epi64(total, 2)) +
+                          static_cast<std::uint64_t>(_mm256_extract_epi64(total, 3));
+    return count + andCountPortable(a + k, b + k, words - k);
+}
+#endif
+
+struct DenseKernelChoice {
+    const char* name;
+    DenseKernel count;
+    std::uint64_t wordsPerStep;
+};
+
+static DenseKernelChoice selectKernel() {
+#ifdef OVERLAP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("popcnt")) {
+        if (__builtin_cpu_supports("avx2")) {
+            return {"avx2", andCountAvx2, 4};
+        }
+        return {"popcnt", andCountPopcnt, 1};
+    }
+#endif
+    return {"portable", andCountPortable, 1};
+}
+
+// Each variant's questions as sorted bit positions 0..questions-1, in id
+// order, which keeps a topic's questions (loaded together) in few words.
+static std::vector<std::vector<std::uint32_t>> bitPositions(const std::vector<std::vector<QuestionId>>& variants,
+                                                            std::size_t& questionCount) {
+    std::vector<QuestionId> distinct;
+    for (const auto& ids : variants) {
+        distinct.insert(distinct.end(), ids.begin(), ids.end());
+    }
+    std::sort(distinct.begin(), distinct.end());
+    distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+    questionCount = distinct.size();
+
+    std::vector<std::vector<std::uint32_t>> positions(variants.size());
+    for (std::size_t i = 0; i < variants.size(); ++i) {
+        auto& bits = positions[i];
+        for (QuestionId id : variants[i]) {
+            bits.push_back(static_cast<std::uint32_t>(std::lower_bound(distinct.begin(), distinct.end(), id) - distinct.begin()));
+        }
+        std::sort(bits.begin(), bits.end());
+        bits.erase(std::unique(bits.begin(), bits.end()), bits.end());
+    }
+    return positions;
+}
+
+// Running totals of one range of tiles.
+struct OverlapTally {
+    std::uint64_t sharedSum = 0;
+    double jaccardSum = 0;
+    std::uint32_t maxShared = 0;
+    double maxJaccard = 0;
+    double maxNeighbourJaccard = 0;
+    std::uint64_t flaggedPairs = 0;
+    std::vector<OverlapPair> flagged;
+};
+
+static bool moreSimilar(const OverlapPair& a, const OverlapPair& b) {
+    if (a.jaccard != b.jaccard) {
+        return a.jaccard > b.jaccard;
+    }
+    return a.first != b.first ? a.first < b.first : a.second < b.second;
+}
+
+// Keeps the `limit` most similar pairs, trimming only now and then.
+static void trimFlagged(std::vector<OverlapPair>& flagged, std::size_t limit) {
+    if (flagged.size() <= limit) {
+        return;
+    }
+    std::nth_element(flagged.begin(), flagged.begin() + limit, flagged.end(), moreSimilar);
+    flagged.resize(limit);
+}
+
+static void record(OverlapTally& tally, std::size_t i, std::size_t j, std::uint64_t shared, std::uint64_t sizeI,
+                   std::uint64_t sizeJ, const OverlapOptions& options) {
+    std::uint64_t united = sizeI + sizeJ - shared;
+    double jaccard = united ? static_cast<double>(shared) / static_cast<double>(united) : 0.0;
+    tally.sharedSum += shared;
+    tally.jaccardSum += jaccard;
+    tally.maxShared = std::max(tally.maxShared, static_cast<std::uint32_t>(shared));
+    tally.maxJaccard = std::max(tally.maxJaccard, jaccard);
+    if (j == i + 1) {
+        tally.maxNeighbourJaccard = std::max(tally.maxNeighbourJaccard, jaccard);
+    }
+    if (jaccard > options.threshold) {
+        tally.flaggedPairs++;
+        if (options.maxListed > 0) {
+            tally.flagged.push_back({static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(j),
+                                     static_cast<std::uint32_t>(shared), jaccard});
+            if (tally.flagged.size() >= 2 * options.maxListed + 1024) {
+                trimFlagged(tally.flagged, options.maxListed);
+            }
+        }
+    }
+}
+
+static void mergeTally(OverlapTally& total, OverlapTally& tally, std::size_t listLimit) {
+    trimFlagged(tally.flagged, listLimit);
+    total.sharedSum += tally.sharedSum;
+    total.jaccardSum += tally.jaccardSum;
+    total.maxShared = std::max(total.maxShared, tally.maxShared);
+    total.maxJaccard = std::max(total.maxJaccard, tally.maxJaccard);
+    total.maxNeighbourJaccard = std::max(total.maxNeighbourJaccard, tally.maxNeighbourJaccard);
+    total.flaggedPairs += tally.flaggedPairs;
+    total.flagged.insert(total.flagged.end(), tally.flagged.begin(), tally.flagged.end());
+}
+
+// Every pair through AND + popcount of two dense bitsets, in tiles of
+// `block` x `block` variants over the upper triangle. A block of bitsets is
+// kept to about 64 KB so that the two of a tile stay cached.
+static void countDense(const std::vector<std::vector<std::uint32_t>>& positions, std::size_t questionCount,
+                       DenseKernel kernel, const OverlapOptions& options, OverlapTally& total) {
+    std::size_t count = positions.size();
+    std::size_t words = std::max<std::size_t>(1, (questionCount + 63) / 64);
+    std::vector<std::uint64_t> bits(count * words, 0);
+    for (std::size_t i = 0; i < count; ++i) {
+        for (std::uint32_t position : positions[i]) {
+            bits[i * words + position / 64] |= std::uint64_t(1) << (position % 64);
+        }
+    }
+    std::size_t block = std::clamp<std::size_t>(65536 / (words * 8), 16, 256);
+    std::size_t blocks = (count + block - 1) / block;
+    std::vector<std::pair<std::size_t, std::size_t>> tiles;
+    for (std::size_t bi = 0; bi < blocks; ++bi) {
+        for (std::size_t bj = bi; bj < blocks; ++bj) {
+            tiles.emplace_back(bi * block, bj * block);
+        }
+    }
+    std::mutex totalMutex;
+    parallelFor(tiles.size(), 1, [&](std::size_t begin, std::size_t end) {
+        OverlapTally tally;
+        for (std::size_t t = begin; t < end; ++t) {
+            std::size_t rowEnd = std::min(count, tiles[t].first + block);
+            std::size_t columnEnd = std::min(count, tiles[t].second + block);
+            for (std::size_t i = tiles[t].first; i < rowEnd; ++i) {
+                const std::uint64_t* row = &bits[i * words];
+                for (std::size_t j = std::max(tiles[t].second, i + 1); j < columnEnd; ++j) {
+                    record(tally, i, j, kernel(row, &bits[j * words], words), positions[i].size(), positions[j].size(), options);
+                }
+            }
+        }
+        std::lock_guard<std::mutex> lock(totalMutex);
+        mergeTally(total, tally, options.maxListed);
+    });
+}
+
+// Only the pairs that share a question: each variant adds one to every
+// later variant listed under each of its questions. Pairs sharing nothing
+// add nothing to the sums, so the totals match the dense count.
+static void countInverted(const std::vector<std::vector<std::uint32_t>>& positions, std::size_t questionCount,
+                          const OverlapOptions& options, OverlapTally& total) {
+    std::size_t count = positions.size();
+    // Variants using each question, ascending: users[offsets[q], offsets[q + 1]).
+    std::vector<std::size_t> offsets(questionCount + 1, 0);
+    for (const auto& bits : positions) {
+        for (std::uint32_t position : bits) {
+            offsets[position + 1]++;
+        }
+    }
+    for (std::size_t q = 0; q < questionCount; ++q) {
+        offsets[q + 1] += offsets[q];
+    }
+    std::vector<std::uint32_t> users(offsets.back());
+    std::vector<std::size_t> next(offsets.begin(), offsets.end() - 1);
+    for (std::size_t i = 0; i < count; ++i) {
+        for (std::uint32_t position : positions[i]) {
+            users[next[position]++] = static_cast<std::uint32_t>(i);
+        }
+    }
+    std::mutex totalMutex;
+    parallelFor(count, 64, [&](std::size_t begin, std::size_t end) {
+        OverlapTally tally;
+        std::vector<std::uint32_t> shared(count, 0);
+        std::vector<std::uint32_t> touched;
+        for (std::size_t i = begin; i < end; ++i) {
+            for (std::uint32_t position : positions[i]) {
+                auto first = users.begin() + static_cast<std::ptrdiff_t>(offsets[position]);
+                auto last = users.begin() + static_cast<std::ptrdiff_t>(offsets[position + 1]);
+                for (auto it = std::upper_bound(first, last, static_cast<std::uint32_t>(i)); it != last; ++it) {
+                    if (shared[*it]++ == 0) {
+                        touched.push_back(*it);
+                    }
+                }
+            }
+            for (std::uint32_t j : touched) {
+                record(tally, i, j, shared[j], positions[i].size(), positions[j].size(), options);
+                shared[j] = 0;
+            }
+            touched.clear();
+        }
+        std::lock_guard<std::mutex> lock(totalMutex);
+        mergeTally(total, tally, options.maxListed);
+    });
+}
+
+OverlapReport analyzeOverlap(const std::vector<std::vector<QuestionId>>& variants, const OverlapOptions& options) {
+    TraceScope trace("overlap_analysis", "analysis", static_cast<std::int64_t>(variants.size()));
+    auto started = std::chrono::steady_clock::now();
+    static const DenseKernelChoice kernel = selectKernel();
+
+    OverlapReport report;
+    report.variants = variants.size();
+    report.pairs = variants.empty() ? 0 : static_cast<std::uint64_t>(variants.size()) * (variants.size() - 1) / 2;
+    report.threshold = options.threshold;
+    std::vector<std::vector<std::uint32_t>> positions = bitPositions(variants, report.questions);
+
+    // Rough costs of the two counts: dense visits every pair and all its
+    // words, inverted only the (variant, variant, question) triples sharing
+    // something. Small question sets with heavy reuse favour dense bitsets,
+    // large banks drawn from thinly favour the inverted lists.
+    std::vector<std::uint64_t> uses(report.questions, 0);
+    for (const auto& bits : positions) {
+        for (std::uint32_t position : bits) {
+            uses[position]++;
+        }
+    }
+    std::uint64_t sharedTriples = 0;
+    for (std::uint64_t users : uses) {
+        sharedTriples += users * (users - 1) / 2;
+    }
+    std::uint64_t words = (report.questions + 63) / 64;
+    std::uint64_t wordSteps = (words + kernel.wordsPerStep - 1) / kernel.wordsPerStep;
+    bool dense = report.pairs * (wordSteps + 8) <= 9 * sharedTriples;
+
+    OverlapTally total;
+    if (dense) {
+        report.kernel = std::string("dense/") + kernel.name;
+        countDense(positions, report.questions, kernel.count, options, total);
+    } else {
+        report.kernel = "inverted";
+        countInverted(positions, report.questions, options, total);
+    }
+
+    trimFlagged(total.flagged, options.maxListed);
+    std::sort(total.flagged.begin(), total.flagged.end(), moreSimilar);
+    report.maxShared = total.maxShared;
+    report.maxJaccard = total.maxJaccard;
+    report.meanShared = report.pairs ? static_cast<double>(total.sharedSum) / static_cast<double>(report.pairs) : 0.0;
+    report.meanJaccard = report.pairs ? total.jaccardSum / static_cast<double>(report.pairs) : 0.0;
+    report.maxNeighbourJaccard = total.maxNeighbourJaccard;
+    report.flaggedPairs = total.flaggedPairs;
+    report.flagged = std::move(total.flagged);
+    report.millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
+
+void OverlapReport::dump(std::ostream& out, const std::vector<std::string>& names) const {
+    auto label = [&names](std::uint32_t index) {
+        return index < names.size() ? names[index] : "#" + std::to_string(index);
+    };
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3)
+        << variants << " variants over " << questions << " questions, " << pairs << " pairs in "
+        << std::setprecision(1) << millis << " ms (" << kernel << ")\n" << std::setprecision(3)
+        << "shared questions: max " << maxShared << ", mean " << meanShared << "\n"
+        << "jaccard:          max " << maxJaccard << ", mean " << meanJaccard
+        << ", max between neighbours " << maxNeighbourJaccard << "\n"
+        << flaggedPairs << " pair(s) above " << threshold;
+    if (flagged.size() < flaggedPairs) {
+        out << ", the " << flagged.size() << " most similar";
+    }
+    out << (flagged.empty() ? "\n" : ":\n");
+    for (const auto& pair : flagged) {
+        out << "  " << label(pair.first) << " / " << label(pair.second) << ": " << pair.shared << " shared, jaccard "
+            << pair.jaccard << "\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
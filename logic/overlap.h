@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "quiz.h"
+
+struct OverlapPair {
+    // Positions of the two variants in the analysed list, first < second.
+    std::uint32_t first = 0;
+    std::uint32_t second = 0;
+    std::uint32_t shared = 0;
+    double jaccard = 0;
+};
+
+struct OverlapOptions {
+    // Pairs whose Jaccard similarity is above this are flagged.
+    double threshold = 0.5;
+    // All flagged pairs are counted; only this many of the most similar are listed.
+    std::size_t maxListed = 20;
+};
+
+struct OverlapReport {
+    std::size_t variants = 0;
+    std::uint64_t pairs = 0;
+    // Distinct questions over all variants.
+    std::size_t questions = 0;
+    std::uint32_t maxShared = 0;
+    double maxJaccard = 0;
+    double meanShared = 0;
+    double meanJaccard = 0;
+    // Over consecutive variants only, i.e. the ones handed to neighbours.
+    double maxNeighbourJaccard = 0;
+    std::uint64_t flaggedPairs = 0;
+    // Most similar first.
+    std::vector<OverlapPair> flagged;
+    double threshold = 0;
+    // How pairs were counted: "dense/" and the popcount kernel, or "inverted".
+    std::string kernel;
+    double millis = 0;
+
+    // Pairs are labelled names[i] where given, "#i" otherwise.
+    void dump(std::ostream& out, const std::vector<std::string>& names = {}) const;
+};
+
+// Compares every pair of variants (given as their question ids) by the
+// number of questions they share and their Jaccard similarity. Each variant
+// becomes a bitset over the distinct questions; pairs are counted with
+// AND + popcount (AVX2 or POPCNT where the CPU has them) in tiles of
+// variants small enough to stay in cache, and the tiles run on the shared
+// TaskScheduler. When the variants are drawn thinly from many questions, so
+// that most pairs share nothing, an inverted question -> variants count is
+// cheaper and used instead; the results are the same.
+OverlapReport analyzeOverlap(const std::vector<std::vector<QuestionId>>& variants,
+                             const OverlapOptions& options = OverlapOptions());
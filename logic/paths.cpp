@@ -0,0 +1,34 @@
+#include "paths.h"
+#include <cstdlib>
+#include <filesystem>
+
+static std::filesystem::path envPath(const char* name) {
+    const char* value = std::getenv(name);
+    return (value && *value) ? std::filesystem::path(value) : std::filesystem::path();
+}
+
+std::string appDataDirectory() {
+    std::filesystem::path base;
+#if defined(_WIN32)
+    base = envPath("APPDATA");
+#elif defined(__APPLE__)
+    base = envPath("HOME") / "Library" / "Application Support";
+#else
+    base = envPath("XDG_DATA_HOME");
+    if (base.empty()) {
+        base = envPath("HOME") / ".local" / "share";
+    }
+#endif
+    std::filesystem::path dir = base / "Madiwka" / "MadExam";
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    return dir.string();
+}
+
+std::string defaultBankPath() {
+    return (std::filesystem::path(appDataDirectory()) / "db.txt").string();
+}
+
+std::string defaultArchivePath() {
+    return (std::filesystem::path(appDataDirectory()) / "variants.archive").string();
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <string>
+
+// Qt-free equivalent of QStandardPaths::AppDataLocation for the
+// "Madiwka/MadExam" organization/application pair. Creates the directory.
+std::string appDataDirectory();
+std::string defaultBankPath();
+std::string defaultArchivePath();
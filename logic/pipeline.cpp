@@ -0,0 +1,205 @@
+#include "pipeline.h"
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include "sampler.h"
+#include "scheduler.h"
+#include "trace.h"
+
+static std::uint64_t nanosBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+struct RenderedVariant {
+    std::size_t index = 0;
+    std::shared_ptr<QuizVariant> variant;
+    std::string html;
+};
+
+// Shared by all tasks of one stage.
+struct StageTally {
+    std::atomic<std::size_t> items{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> busyNanos{0};
+    std::atomic<std::uint64_t> waitNanos{0};
+};
+
+PipelineReport runVariantPipeline(QuestionDatabase& db, const std::vector<QuestionQuota>& quotas, const RngService& rng,
+                                  std::size_t count, const std::function<std::string(std::size_t)>& pathFor,
+                                  const PipelineOptions& options,
+                                  const std::function<void(const QuizVariant&, const std::string&)>& onWritten) {
+    TraceScope trace("variant_pipeline", "generate", static_cast<std::int64_t>(count));
+    using Clock = std::chrono::steady_clock;
+    auto started = Clock::now();
+    unsigned threads = TaskScheduler::instance().concurrency();
+    std::size_t capacity = std::max<std::size_t>(2, options.queueCapacity);
+    // Variants sampled but not yet written. Without a cap, one slow variant
+    // would let the writer's reorder buffer grow without bound.
+    const std::size_t window = 2 * capacity + threads;
+
+    // Selecting touches lazily loaded state, so it happens here, once.
+    std::vector<std::vector<std::shared_ptr<Question>>> pools;
+    std::unique_ptr<ExposureSampler> exposureSampler;
+    if (options.weighted) {
+        exposureSampler = std::make_unique<ExposureSampler>(db);
+    } else {
+        pools = db.preparePools(quotas);
+    }
+
+    // Never more than `window` variants are queued, so pushes cannot block.
+    BoundedQueue<RenderedVariant> rendered(window);
+    // Documents already written hand their buffers back for later renders.
+    BoundedQueue<std::string> spareBuffers(window);
+    StageTally tallies[3];
+    std::atomic<std::size_t> inFlight{0};
+    std::size_t peakInFlight = 0;
+    std::mutex usageMutex;
+
+    auto sample = [&](std::size_t index) {
+        std::string name = "Вариант " + std::to_string(index + 1);
+        std::shared_ptr<QuizVariant> variant = exposureSampler
+            ? db.generateVariant(name, quotas, options.shuffle, rng, index + 1, exposureSampler.get())
+            : db.generateVariant(name, quotas, pools, options.shuffle, rng, index + 1);
+        if (options.recordUsage) {
+            std::lock_guard<std::mutex> lock(usageMutex);
+            db.recordUsage(*variant);
+        }
+        return variant;
+    };
+
+    auto render = [&](std::size_t index, std::shared_ptr<QuizVariant> variant, Clock::time_point queuedAt) {
+        StageTally& tally = tallies[1];
+        auto busyStart = Clock::now();
+        DocumentWriter writer(options.document);
+        RenderedVariant output;
+        output.index = index;
+        spareBuffers.tryPop(output.html);
+        output.html.assign(writer.renderHtml(*variant));
+        output.variant = std::move(variant);
+        std::size_t bytes = output.html.size();
+        rendered.push(std::move(output));
+        tally.items++;
+        tally.bytes += bytes;
+        tally.busyNanos += nanosBetween(busyStart, Clock::now());
+        tally.waitNanos += nanosBetween(queuedAt, busyStart);
+    };
+
+    PipelineReport report;
+    StageTally& tally = tallies[2];
+    DocumentWriter fileWriter(options.document);
+    std::map<std::size_t, RenderedVariant> early;
+    std::size_t nextToSample = 0;
+    std::size_t nextToWrite = 0;
+    // Declared last, so its tasks are done before anything they use is gone.
+    TaskGroup group(options.cancel);
+
+    // Each variant is a sample task that queues its render task; the
+    // calling thread is the writer and runs tasks itself while it waits.
+    // Renders finish out of order; early arrivals wait here.
+    auto spawn = [&]() {
+        while (nextToSample < count && nextToSample < nextToWrite + window && !group.cancelled()) {
+            std::size_t index = nextToSample++;
+            peakInFlight = std::max(peakInFlight, ++inFlight);
+            auto queuedAt = Clock::now();
+            if (exposureSampler) {
+                // Each weighted draw depends on the usage recorded before it.
+                std::shared_ptr<QuizVariant> variant = sample(index);
+                tallies[0].items++;
+                tallies[0].busyNanos += nanosBetween(queuedAt, Clock::now());
+                group.run([&render, index, variant]() { render(index, variant, Clock::now()); });
+                continue;
+            }
+            group.run([&, index, queuedAt]() {
+                auto busyStart = Clock::now();
+                std::shared_ptr<QuizVariant> variant = sample(index);
+                auto sampledAt = Clock::now();
+                tallies[0].items++;
+                tallies[0].busyNanos += nanosBetween(busyStart, sampledAt);
+                tallies[0].waitNanos += nanosBetween(queuedAt, busyStart);
+                group.run([&render, index, variant, sampledAt]() { render(index, variant, sampledAt); });
+            });
+        }
+    };
+
+    RenderedVariant item;
+    while (nextToWrite < count) {
+        spawn();
+        auto waitStart = Clock::now();
+        auto ready = early.find(nextToWrite);
+        if (ready != early.end()) {
+            item = std::move(ready->second);
+            early.erase(ready);
+        } else {
+            bool popped = group.waitUntil([&rendered, &item]() { return rendered.tryPop(item); });
+            tally.waitNanos += nanosBetween(waitStart, Clock::now());
+            if (!popped) {
+                break;
+            }
+            if (item.index != nextToWrite) {
+                early.emplace(item.index, std::move(item));
+                continue;
+            }
+        }
+        auto busyStart = Clock::now();
+        std::string path = pathFor(item.index);
+        bool written = false;
+        try {
+            written = fileWriter.writeOutput(std::filesystem::path(path), item.html);
+        } catch (const std::filesystem::filesystem_error&) {
+        }
+        if (written) {
+            if (onWritten) {
+                onWritten(*item.variant, path);
+            }
+        } else {
+            report.failedPaths.push_back(path);
+        }
+        tally.items++;
+        tally.bytes += item.html.size();
+        spareBuffers.tryPush(item.html);
+        item = RenderedVariant();
+        --inFlight;
+        ++nextToWrite;
+        tally.busyNanos += nanosBetween(busyStart, Clock::now());
+    }
+    try {
+        group.wait();
+    } catch (const OperationCancelled&) {
+        report.cancelled = true;
+    }
+
+    const char* names[3] = {"sample", "render", "write"};
+    unsigned workerCounts[3] = {exposureSampler ? 1u : threads, threads, 1};
+    for (int s = 0; s < 3; ++s) {
+        PipelineStageReport& stage = report.stages[s];
+        stage.name = names[s];
+        stage.workers = workerCounts[s];
+        stage.items = tallies[s].items;
+        stage.bytes = tallies[s].bytes;
+        stage.busyMillis = tallies[s].busyNanos / 1e6;
+        stage.waitMillis = tallies[s].waitNanos / 1e6;
+    }
+    report.variants = nextToWrite;
+    report.peakInFlight = peakInFlight;
+    report.wallMillis = nanosBetween(started, Clock::now()) / 1e6;
+    return report;
+}
+
+void PipelineReport::dump(std::ostream& out) const {
+    out << std::fixed << std::setprecision(1)
+        << variants << " variants in " << wallMillis << " ms, at most " << peakInFlight << " in flight\n"
+        << std::left << std::setw(8) << "stage" << std::right << std::setw(8) << "workers" << std::setw(10) << "items"
+        << std::setw(12) << "busy ms" << std::setw(12) << "wait ms" << std::setw(12) << "items/s" << std::setw(10) << "MB" << "\n";
+    for (const auto& stage : stages) {
+        // What the stage could sustain if its workers never waited.
+        double rate = stage.busyMillis > 0 ? stage.items * 1000.0 / (stage.busyMillis / stage.workers) : 0.0;
+        out << std::left << std::setw(8) << stage.name << std::right << std::setw(8) << stage.workers
+            << std::setw(10) << stage.items << std::setw(12) << stage.busyMillis << std::setw(12) << stage.waitMillis
+            << std::setw(12) << rate << std::setw(10) << stage.bytes / 1e6 << "\n";
+    }
+    for (const auto& path : failedPaths) {
+        out << "Failed to write " << path << "\n";
+    }
+}
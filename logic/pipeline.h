@@ -0,0 +1,178 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "docwriter.h"
+#include "quiz.h"
+#include "scheduler.h"
+
+// Bounded multi-producer multi-consumer ring (Vyukov's design): every cell
+// carries a sequence number, so producers and consumers only contend on one
+// compare-and-swap each. The blocking push()/pop() spin, then yield, then
+// sleep while the queue is full or empty; a full queue is what holds back a
+// stage that runs ahead of the next one.
+template <typename T>
+class BoundedQueue {
+public:
+    // The capacity is rounded up to a power of two.
+    explicit BoundedQueue(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        mask = size - 1;
+        cells = std::make_unique<Cell[]>(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool tryPush(T& value) {
+        std::size_t position = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value) {
+        std::size_t position = head.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+            if (difference == 0) {
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // False if the queue was closed before there was room.
+    bool push(T value) {
+        for (int attempt = 0; !tryPush(value); ++attempt) {
+            if (closed.load(std::memory_order_acquire)) {
+                return false;
+            }
+            backoff(attempt);
+        }
+        return true;
+    }
+
+    // False once the queue is closed and empty.
+    bool pop(T& value) {
+        for (int attempt = 0; !tryPop(value); ++attempt) {
+            if (closed.load(std::memory_order_acquire)) {
+                // Everything pushed before close() is visible now.
+                return tryPop(value);
+            }
+            backoff(attempt);
+        }
+        return true;
+    }
+
+    void close() { closed.store(true, std::memory_order_release); }
+
+    static void backoff(int attempt) {
+        if (attempt < 64) {
+            return;
+        }
+        if (attempt < 128) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    // Producers and consumers each own a cache line.
+    alignas(64) std::atomic<std::size_t> tail{0};
+    alignas(64) std::atomic<std::size_t> head{0};
+    alignas(64) std::atomic<bool> closed{false};
+    std::unique_ptr<Cell[]> cells;
+    std::size_t mask = 0;
+};
+
+struct PipelineOptions {
+    // Sizes the window of variants in flight: twice this, plus one per thread.
+    std::size_t queueCapacity = 16;
+    bool shuffle = false;
+    // Favour rarely used questions (see ExposureSampler). Each draw then
+    // depends on the usage recorded before it, so the writer samples them in
+    // order and only rendering runs in parallel.
+    bool weighted = false;
+    bool recordUsage = true;
+    DocumentOptions document;
+    // Stops the run after the variant being written; see PipelineReport.
+    std::shared_ptr<CancellationToken> cancel;
+};
+
+struct PipelineStageReport {
+    const char* name = "";
+    unsigned workers = 0;
+    std::size_t items = 0;
+    std::uint64_t bytes = 0;
+    double busyMillis = 0;
+    // Blocked on an empty input queue or a full output queue.
+    double waitMillis = 0;
+};
+
+struct PipelineReport {
+    PipelineStageReport stages[3];
+    std::size_t variants = 0;
+    // Most variants alive at once; bounded by the queues, not the batch size.
+    std::size_t peakInFlight = 0;
+    double wallMillis = 0;
+    std::vector<std::string> failedPaths;
+    // Set when the token was cancelled; `variants` were written before that.
+    bool cancelled = false;
+
+    void dump(std::ostream& out) const;
+};
+
+// Samples, renders and writes `count` variants as a three-stage pipeline on
+// the shared TaskScheduler: each variant is a sample task that queues its
+// render task, and rendered variants reach the writer through a bounded
+// queue. The calling thread is the writer, running tasks while it waits: it
+// writes variants in order, calling onWritten for each one that was
+// written. Variant i is named "Вариант i+1", drawn from stream i+1 exactly as
+// generateVariant() would, and written to pathFor(i). At most a fixed window
+// of variants is alive at a time, however large `count` is.
+//
+// Sampling errors (e.g. a bad tag filter) are rethrown; write failures are
+// listed in the report.
+PipelineReport runVariantPipeline(QuestionDatabase& db, const std::vector<QuestionQuota>& quotas, const RngService& rng,
+                                  std::size_t count, const std::function<std::string(std::size_t)>& pathFor,
+                                  const PipelineOptions& options = PipelineOptions(),
+                                  const std::function<void(const QuizVariant&, const std::string&)>& onWritten = nullptr);
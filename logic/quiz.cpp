@@ -2,18 +2,235 @@
 #include <fstream>
 #include <algorithm>
 #include "docwriter.h"
-#include <random>
+#include "bankformat.h"
+#include "stats.h"
+#include "trace.h"
+#include "sampler.h"
+#include "scheduler.h"
+#include <charconv>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <limits>
+#include <filesystem>
+#include <unordered_map>
+#include <string_view>
+#include <unordered_set>
+#include <sstream>
+static std::uint32_t slotIndexOf(QuestionId id) {
+    return static_cast<std::uint32_t>(id);
+}
+
+static std::uint32_t generationOf(QuestionId id) {
+    return static_cast<std::uint32_t>(id >> 32);
+}
+
+QuestionDatabase::Slot* QuestionDatabase::liveSlot(QuestionId id) {
+    std::uint32_t index = slotIndexOf(id);
+    if (index == 0 || index >= slots.size()) {
+        return nullptr;
+    }
+    Slot& slot = slots[index];
+    return slot.occupied && slot.generation == generationOf(id) ? &slot : nullptr;
+}
+
+const QuestionDatabase::Slot* QuestionDatabase::liveSlot(QuestionId id) const {
+    return const_cast<QuestionDatabase*>(this)->liveSlot(id);
+}
+
+void QuestionDatabase::assignSlot(Question& question, bool restoring) {
+    // Keep ids from the bank file unless the slot is taken, e.g. when a second
+    // bank is loaded on top of the first, or its generation was retired. A
+    // restored question may also take back the generation it was removed
+    // from, as long as the slot has not issued the next one since.
+    std::uint32_t index = slotIndexOf(question.id);
+    bool keep = index != 0 && index < kMaxSlots &&
+        (index >= slots.size() ||
+         (!slots[index].occupied && (generationOf(question.id) >= slots[index].generation ||
+                                     (restoring && generationOf(question.id) + 1 == slots[index].generation))));
+    if (keep) {
+        if (index >= slots.size()) {
+            slots.resize(static_cast<std::size_t>(index) + 1);
+        }
+        slots[index].generation = generationOf(question.id);
+    } else {
+        index = 0;
+        while (!freeSlots.empty() && index == 0) {
+            // A kept id may have claimed a free slot in the meantime.
+            if (!slots[freeSlots.back()].occupied) {
+                index = freeSlots.back();
+            }
+            freeSlots.pop_back();
+        }
+        if (index == 0) {
+            if (slots.size() > UINT32_MAX) {
+                throw std::length_error("Too many questions");
+            }
+            index = static_cast<std::uint32_t>(slots.size());
+            slots.emplace_back();
+        }
+        question.id = (static_cast<QuestionId>(slots[index].generation) << 32) | index;
+    }
+    slots[index].occupied = true;
+    slots[index].denseIndex = static_cast<std::uint32_t>(questions.size());
+}
+
 void QuestionDatabase::addQuestion(std::shared_ptr<Question> question) {
+    ensureTopicLoaded(question->topic->name);
+    markDirty(question->topic);
+    insertQuestion(question);
+    markUnsaved(question->id);
+}
+
+void QuestionDatabase::insertQuestion(std::shared_ptr<Question> question, bool restoring) {
+    assignSlot(*question, restoring);
+    questionTags.add(*question);
     questions.push_back(question);
 }
+
+void QuestionDatabase::compactFrom(std::size_t firstRemoved) {
+    std::size_t out = firstRemoved;
+    for (std::size_t in = firstRemoved; in < questions.size(); ++in) {
+        if (!questions[in]) {
+            continue;
+        }
+        slots[slotIndexOf(questions[in]->id)].denseIndex = static_cast<std::uint32_t>(out);
+        if (out != in) {
+            questions[out] = std::move(questions[in]);
+        }
+        ++out;
+    }
+    questions.resize(out);
+}
+
+std::size_t QuestionDatabase::removeMany(const std::vector<QuestionId>& ids) {
+    // Ids may belong to segments that have not been read yet.
+    if (!unloadedTopics.empty()) {
+        for (QuestionId id : ids) {
+            if (!liveSlot(id)) {
+                loadAllSegments();
+                break;
+            }
+        }
+    }
+    std::size_t firstRemoved = questions.size();
+    std::size_t removed = 0;
+    for (QuestionId id : ids) {
+        Slot* slot = liveSlot(id);
+        if (!slot) {
+            continue;
+        }
+        auto& question = questions[slot->denseIndex];
+        markDirty(question->topic);
+        questionTags.remove(*question);
+        question.reset();
+        firstRemoved = std::min<std::size_t>(firstRemoved, slot->denseIndex);
+        slot->occupied = false;
+        // A slot whose generation would wrap is retired instead of reused.
+        if (++slot->generation != 0) {
+            freeSlots.push_back(slotIndexOf(id));
+        }
+        markUnsaved(id);
+        ++removed;
+    }
+    compactFrom(firstRemoved);
+    return removed;
+}
+
 void QuestionDatabase::removeQuestion(const std::shared_ptr<Question>& question) {
-    auto it = std::remove(questions.begin(), questions.end(), question);
-    if (it != questions.end()) {
-        questions.erase(it, questions.end());
+    if (findQuestionById(question->id) == question) {
+        removeMany({question->id});
+    }
+}
+
+std::shared_ptr<Question> QuestionDatabase::findQuestionById(QuestionId id) const {
+    const Slot* slot = liveSlot(id);
+    if (!slot && !unloadedTopics.empty()) {
+        loadAllSegments();
+        slot = liveSlot(id);
+    }
+    return slot ? questions[slot->denseIndex] : nullptr;
+}
+
+void QuestionDatabase::removeTopic(const std::shared_ptr<Topic>& topic) {
+    ensureTopicLoaded(topic->name);
+    markDirty(topic);
+    std::vector<QuestionId> ids;
+    for (const auto& question : questions) {
+        if (question->topic->name == topic->name) {
+            ids.push_back(question->id);
+        }
+    }
+    removeMany(ids);
+    topics.erase(std::remove(topics.begin(), topics.end(), topic), topics.end());
+}
+
+bool QuestionDatabase::replaceQuestion(const std::shared_ptr<Question>& oldQuestion, const std::shared_ptr<Question>& newQuestion) {
+    // The question may move to a topic whose segment is still on disk.
+    ensureTopicLoaded(newQuestion->topic->name);
+    Slot* slot = liveSlot(oldQuestion->id);
+    if (!slot || questions[slot->denseIndex] != oldQuestion) {
+        return false;
+    }
+    // The edited question keeps its id so archived variants still find it.
+    newQuestion->id = oldQuestion->id;
+    newQuestion->usageCount = oldQuestion->usageCount;
+    markDirty(oldQuestion->topic);
+    markDirty(newQuestion->topic);
+    markUnsaved(newQuestion->id);
+    questionTags.remove(*oldQuestion);
+    questionTags.add(*newQuestion);
+    questions[slot->denseIndex] = newQuestion;
+    return true;
+}
+
+void QuestionDatabase::applyBatch(const QuestionBatch& batch) {
+    for (const auto& edit : batch.edited) {
+        auto current = findQuestionById(edit.first);
+        if (current) {
+            replaceQuestion(current, edit.second);
+        }
+    }
+    removeMany(batch.removed);
+    if (batch.added.empty() && batch.restored.empty()) {
+        return;
+    }
+    std::unordered_map<std::string, std::shared_ptr<Topic>> topicsByName;
+    for (const auto& topic : topics) {
+        topicsByName.emplace(topic->name, topic);
+    }
+    bool newTopics = false;
+    auto unifyTopic = [&](Question& question) {
+        auto it = topicsByName.find(question.topic->name);
+        if (it != topicsByName.end()) {
+            question.topic = it->second;
+        } else {
+            topicsByName.emplace(question.topic->name, question.topic);
+            topics.push_back(question.topic);
+            newTopics = true;
+        }
+    };
+    questions.reserve(questions.size() + batch.restored.size() + batch.added.size());
+    for (const auto& question : batch.restored) {
+        unifyTopic(*question);
+        ensureTopicLoaded(question->topic->name);
+        markDirty(question->topic);
+        insertQuestion(question, true);
+        markUnsaved(question->id);
+    }
+    for (const auto& question : batch.added) {
+        unifyTopic(*question);
+        addQuestion(question);
+    }
+    if (newTopics) {
+        std::sort(topics.begin(), topics.end(),
+            [](const std::shared_ptr<Topic>& a, const std::shared_ptr<Topic>& b) {
+                return a->name < b->name;
+            });
     }
 }
 std::vector<std::shared_ptr<Question>> QuestionDatabase::getQuestionsByTopic(const std::shared_ptr<Topic>& topic) const {
+    ensureTopicLoaded(topic->name);
     std::vector<std::shared_ptr<Question>> result;
     for (const auto& question : questions) {
         if (question->topic->name == topic->name) {  
@@ -23,48 +240,144 @@ std::vector<std::shared_ptr<Question>> QuestionDatabase::getQuestionsByTopic(con
     return result;
 }
 
+std::vector<std::shared_ptr<Question>> QuestionDatabase::selectQuestions(const QuestionQuota& quota) const {
+    // Topic-only quotas keep bank order so seeds from before tags still
+    // reproduce the same variants.
+    if (quota.topic) {
+        ensureTopicLoaded(quota.topic->name);
+    } else {
+        loadAllSegments();
+    }
+    if (quota.tagFilter.empty()) {
+        if (quota.topic) {
+            return getQuestionsByTopic(quota.topic);
+        }
+        if (bankSegments.empty()) {
+            return questions;
+        }
+        // Segments load in the order topics are touched; sort so that the
+        // result does not depend on that.
+        auto result = questions;
+        std::stable_sort(result.begin(), result.end(),
+            [](const std::shared_ptr<Question>& a, const std::shared_ptr<Question>& b) {
+                return a->topic->name < b->topic->name;
+            });
+        return result;
+    }
+    RoaringBitmap noQuestions;
+    const RoaringBitmap* within = nullptr;
+    if (quota.topic) {
+        within = questionTags.topicMembers(quota.topic->name);
+        if (!within) {
+            within = &noQuestions;
+        }
+    }
+    RoaringBitmap matches = questionTags.evaluate(quota.tagFilter, within);
+    std::vector<std::shared_ptr<Question>> result;
+    result.reserve(matches.cardinality());
+    for (std::uint32_t slot : matches.toVector()) {
+        result.push_back(questions[slots[slot].denseIndex]);
+    }
+    return result;
+}
+
 std::vector<std::shared_ptr<Question>> QuestionDatabase::getAllQuestions() const {
+    loadAllSegments();
     return questions;
 }
 
 void QuestionDatabase::updateQuestion(const std::shared_ptr<Question>& oldQuestion, const std::shared_ptr<Question>& newQuestion){
-    auto it = std::find(questions.begin(), questions.end(), oldQuestion);
-    if (it != questions.end()) {
-        *it = newQuestion;
-    }
+    replaceQuestion(oldQuestion, newQuestion);
 }
 std::shared_ptr<Question> QuestionDatabase::getQuestionByIndex(int index) const{
+    loadAllSegments();
     if (index < 0 || index >= static_cast<int>(questions.size())) {
         throw std::out_of_range("Index out of range");
     }
     return questions[index];
 }
 int QuestionDatabase::getQuestionCount() const {
-    return static_cast<int>(questions.size());
+    std::size_t count = questions.size();
+    for (const auto& name : unloadedTopics) {
+        count += bankSegments.at(name).questionCount;
+    }
+    return static_cast<int>(count);
+}
+
+std::size_t QuestionDatabase::topicQuestionCount(const std::shared_ptr<Topic>& topic) const {
+    if (unloadedTopics.count(topic->name)) {
+        return bankSegments.at(topic->name).questionCount;
+    }
+    return getQuestionsByTopic(topic).size();
 }
 
 
 
+static const char* kBankMagic = "MADEXAM-BANK ";
+static const int kBankVersion = 3;
+
 void QuestionDatabase::writeQuestionsToFile(const std::string& filePath) const {
+    loadAllSegments();
+    TraceScope trace("save_db", "io");
+    ScopedStageTimer timer(PerfStage::SaveBank);
     std::ofstream outFile(filePath);
     if (!outFile) {
         throw std::runtime_error("Could not open file for writing: " + filePath);
     }
-    for (const auto& question : questions) {
-        outFile << question->questionText << "\n"
+    writeBank(outFile, questions);
+    timer.addBytes(static_cast<std::uint64_t>(outFile.tellp()));
+    outFile.close();
+}
+
+void QuestionDatabase::writeBank(std::ostream& outFile, const std::vector<std::shared_ptr<Question>>& bankQuestions) const {
+    // Slots past the last live question were used by deleted ones; keeping
+    // the count stops their ids from being handed out again after a reload.
+    outFile << kBankMagic << kBankVersion << " slots=" << slots.size() << "\n";
+
+    // Format 3 writes each distinct option text once, numbered in order of
+    // first use; questions then refer to options by that number.
+    std::unordered_map<StringId, std::uint32_t> fileIndex;
+    std::vector<StringId> poolOrder;
+    for (const auto& question : bankQuestions) {
+        if (question->options) {
+            for (StringId id : question->options->ids()) {
+                if (fileIndex.emplace(id, static_cast<std::uint32_t>(poolOrder.size())).second) {
+                    poolOrder.push_back(id);
+                }
+            }
+        }
+    }
+    const StringPool& pool = StringPool::global();
+    outFile << poolOrder.size() << "\n";
+    for (StringId id : poolOrder) {
+        outFile << escapeField(pool.get(id)) << "\n";
+    }
+
+    for (const auto& question : bankQuestions) {
+        outFile << escapeField(question->questionText) << "\n"
                 << question->questionType << "\n"
                 << (question->options ? std::to_string(question->options->size()) : "0") << "\n";
-        if (question->options) {
-            for (const auto& option : *question->options) {
-                outFile << option << "\n";
+        if (question->options && !question->options->empty()) {
+            const auto& ids = question->options->ids();
+            for (std::size_t i = 0; i < ids.size(); ++i) {
+                outFile << (i > 0 ? " " : "") << fileIndex[ids[i]];
             }
+            outFile << "\n";
         }
         outFile << question->correctOptionIndex << "\n"
-                << question->topic->name << "\n";
+                << escapeField(question->topic->name) << "\n";
+        // Attribute lines: "key=value", preceded by their count.
+        outFile << 2 + question->tags.size() << "\n"
+                << "id=" << question->id << "\n"
+                << "usage=" << question->usageCount << "\n";
+        for (const auto& tag : question->tags) {
+            outFile << "tag=" << escapeField(tag) << "\n";
+        }
     }
-    outFile.close();
 }
-std::vector<std::shared_ptr<Question>> QuestionDatabase::readQuestionsFromFile(const std::string& filePath){
+std::vector<std::shared_ptr<Question>> QuestionDatabase::readQuestionsFromFile(const std::string& filePath, const TopicCallback& onNewTopic){
+    // Read on top of another bank, the questions are changes to that one.
+    bool first = openedPath.empty();
     std::ifstream inFile(filePath);
     if (!inFile) {
         std::ofstream outFile(filePath);
@@ -72,74 +385,787 @@ std::vector<std::shared_ptr<Question>> QuestionDatabase::readQuestionsFromFile(c
             throw std::runtime_error("Could not create file: " + filePath);
         }
         outFile.close();
+        if (first) {
+            openedPath = filePath;
+        }
         return std::vector<std::shared_ptr<Question>>();
     }
-    std::vector<std::shared_ptr<Question>> loadedQuestions;
-    std::string line;
-    while (std::getline(inFile, line)) {
-        std::string questionText = line;
-        int questionType;
-        std::cout << "Reading question: " << questionText << std::endl;
-        std::getline(inFile, line);
-        questionType = std::stoi(line);
-        std::cout << "Question type: " << questionType << std::endl;
-        std::optional<std::vector<std::string>> options;
-        std::getline(inFile, line);
-        std::cout << "Number of options: " << line << std::endl;
-        int optionCount = std::stoi(line);
+    TraceScope trace("load_db", "io");
+    ScopedStageTimer timer(PerfStage::ParseBank);
+    std::error_code sizeError;
+    auto fileSize = std::filesystem::file_size(filePath, sizeError);
+    if (!sizeError) {
+        timer.addBytes(fileSize);
+    }
+    auto loadedQuestions = parseBank(inFile, onNewTopic);
+    inFile.close();
+    for (const auto& loadedQuestion : loadedQuestions) {
+        addQuestion(loadedQuestion);
+    }
+    if (first) {
+        openedPath = filePath;
+    }
+    topics = generateTopicsFromQuestions();
+    return loadedQuestions;
+}
+
+// The lines of an in-memory bank, split the way std::getline splits them.
+struct LineCursor {
+    const char* position;
+    const char* end;
+
+    bool next(std::string_view& line) {
+        if (position == end) {
+            return false;
+        }
+        const char* newline = static_cast<const char*>(std::memchr(position, '\n', static_cast<std::size_t>(end - position)));
+        const char* lineEnd = newline ? newline : end;
+        line = std::string_view(position, static_cast<std::size_t>(lineEnd - position));
+        position = newline ? newline + 1 : end;
+        return true;
+    }
+
+    std::string_view rawField() {
+        std::string_view line;
+        if (!next(line)) {
+            throw std::runtime_error("Unexpected end of question bank file");
+        }
+        return line;
+    }
+
+    // The next line, as readField() reads it.
+    std::string field(int version) {
+        std::string text(rawField());
+        return version >= 2 ? unescapeField(text) : text;
+    }
+};
+
+// The count at the start of a line, without copying it (stoi semantics for
+// the well-formed case).
+static int countField(std::string_view line) {
+    std::size_t start = line.find_first_not_of(" \t");
+    if (start == std::string_view::npos) {
+        throw std::invalid_argument("stoi");
+    }
+    int value = 0;
+    auto parsed = std::from_chars(line.data() + start, line.data() + line.size(), value);
+    if (parsed.ec != std::errc()) {
+        throw std::invalid_argument("stoi");
+    }
+    return value;
+}
+
+// One run of whole records, parsed by a task. Its topics stay local to the
+// run until parseBank resolves them against the bank's.
+struct ParsedChunk {
+    const char* begin;
+    const char* end;
+    CountedVector<std::shared_ptr<Question>, MemorySubsystem::Import> questions;
+    CountedVector<std::uint32_t, MemorySubsystem::Import> topicOfQuestion;
+    std::vector<std::shared_ptr<Topic>> localTopics;
+    std::atomic<bool> done{false};
+
+    ParsedChunk(const char* first, const char* last) : begin(first), end(last) {}
+};
+
+// Steps over one record after its text line, reading only the counts that
+// decide how many lines it spans.
+static void skipRecord(LineCursor& cursor, int version) {
+    cursor.rawField();
+    int optionCount = countField(cursor.rawField());
+    int optionLines = version >= 3 ? (optionCount > 0 ? 1 : 0) : std::max(optionCount, 0);
+    for (int i = 0; i < optionLines; ++i) {
+        cursor.rawField();
+    }
+    cursor.rawField();
+    cursor.rawField();
+    if (version >= 2) {
+        int attributeCount = countField(cursor.rawField());
+        for (int i = 0; i < attributeCount; ++i) {
+            cursor.rawField();
+        }
+    }
+}
+
+static void parseChunk(ParsedChunk& chunk, int version, const std::vector<StringId>& filePool, bool verbose) {
+    LineCursor cursor{chunk.begin, chunk.end};
+    std::unordered_map<std::string_view, std::uint32_t> localIndex;
+    std::string_view line;
+    while (cursor.next(line)) {
+        std::string questionText(line);
+        if (version >= 2) {
+            questionText = unescapeField(questionText);
+        }
+        if (verbose) std::cout << "Reading question: " << questionText << std::endl;
+        int questionType = std::stoi(cursor.field(1));
+        if (verbose) std::cout << "Question type: " << questionType << std::endl;
+        std::string countText = cursor.field(1);
+        if (verbose) std::cout << "Number of options: " << countText << std::endl;
+        int optionCount = std::stoi(countText);
+        std::optional<OptionList> options;
         if (optionCount > 0) {
-            options = std::vector<std::string>();
-            for (int i = 0; i < optionCount; ++i) {
-                std::getline(inFile, line);
-                options->push_back(line);  
+            options = OptionList();
+            options->reserve(optionCount);
+            if (version >= 3) {
+                std::istringstream indices(cursor.field(1));
+                std::size_t index;
+                for (int i = 0; i < optionCount; ++i) {
+                    if (!(indices >> index) || index >= filePool.size()) {
+                        throw std::runtime_error("Invalid option reference in question bank file");
+                    }
+                    options->pushId(filePool[index]);
+                }
+            } else {
+                for (int i = 0; i < optionCount; ++i) {
+                    options->push_back(cursor.field(version));
+                }
             }
+        }
+        int correctOptionIndex = std::stoi(cursor.field(1));
+        if (verbose) std::cout << "Correct option index: " << correctOptionIndex << std::endl;
+        std::string topicName = cursor.field(version);
+        auto known = localIndex.find(topicName);
+        std::uint32_t topicIndex;
+        if (known != localIndex.end()) {
+            topicIndex = known->second;
         } else {
-            options = std::nullopt;
-        }
-        std::getline(inFile, line);
-        int correctOptionIndex = std::stoi(line);
-        std::cout << "Correct option index: " << correctOptionIndex << std::endl;
-        std::getline(inFile, line);
-        std::shared_ptr<Topic> topic;
-        auto it = std::find_if(topics.begin(), topics.end(), [&line](const std::shared_ptr<Topic>& t) {
-            return t->name == line;
+            topicIndex = static_cast<std::uint32_t>(chunk.localTopics.size());
+            chunk.localTopics.push_back(makeCounted<MemorySubsystem::Topics, Topic>(topicName));
+            localIndex.emplace(chunk.localTopics.back()->name, topicIndex);
+        }
+
+        auto question = makeCounted<MemorySubsystem::Questions, Question>(questionText, questionType, std::nullopt, correctOptionIndex, chunk.localTopics[topicIndex]);
+        question->options = std::move(options);
+        if (version >= 2) {
+            int attributeCount = std::stoi(cursor.field(1));
+            for (int i = 0; i < attributeCount; ++i) {
+                std::string attribute = cursor.field(version);
+                auto eq = attribute.find('=');
+                std::string key = attribute.substr(0, eq);
+                std::string value = eq == std::string::npos ? "" : attribute.substr(eq + 1);
+                if (key == "id") {
+                    question->id = std::stoull(value);
+                } else if (key == "usage") {
+                    question->usageCount = static_cast<std::uint32_t>(std::stoul(value));
+                } else if (key == "tag") {
+                    question->tags.push_back(value);
+                }
+            }
+        }
+        chunk.questions.push_back(question);
+        chunk.topicOfQuestion.push_back(topicIndex);
+    }
+}
+
+std::vector<std::shared_ptr<Question>> QuestionDatabase::parseBank(std::istream& inFile, const TopicCallback& onNewTopic) {
+    // Format 1 has no header: the first line is already a question.
+    int version = 1;
+    std::size_t headerSlots = 0;
+    std::string line;
+    std::size_t magicLength = std::char_traits<char>::length(kBankMagic);
+    if (std::getline(inFile, line) && line.compare(0, magicLength, kBankMagic) == 0) {
+        std::istringstream header(line.substr(magicLength));
+        if (!(header >> version) || version < 2 || version > kBankVersion) {
+            throw std::runtime_error("Unsupported question bank format: " + line);
+        }
+        std::string entry;
+        while (header >> entry) {
+            if (entry.rfind("slots=", 0) == 0) {
+                auto parsed = std::from_chars(entry.data() + 6, entry.data() + entry.size(), headerSlots);
+                if (parsed.ec != std::errc() || parsed.ptr != entry.data() + entry.size()) {
+                    throw std::runtime_error("Unsupported question bank format: " + line);
+                }
+            }
+        }
+    } else {
+        inFile.clear();
+        inFile.seekg(0);
+    }
+
+    // Maps the file's option numbers to global pool ids.
+    std::vector<StringId> filePool;
+    if (version >= 3) {
+        std::size_t poolSize = std::stoull(readField(inFile, 1));
+        filePool.reserve(poolSize);
+        StringPool& pool = StringPool::global();
+        for (std::size_t i = 0; i < poolSize; ++i) {
+            filePool.push_back(pool.intern(readField(inFile, version)));
+        }
+    }
+
+    // The records after the header are cut into runs by a quick pass over
+    // the counts that decide how many lines each spans, and the runs are
+    // parsed as tasks.
+    CountedVector<char, MemorySubsystem::Import> data;
+    std::streampos here = inFile.tellg();
+    if (here != std::streampos(-1) && inFile.seekg(0, std::ios::end)) {
+        std::streampos total = inFile.tellg();
+        inFile.seekg(here);
+        if (total > here) {
+            data.reserve(static_cast<std::size_t>(total - here));
+        }
+    }
+    inFile.clear();
+    char block[65536];
+    for (std::streamsize got; (got = inFile.rdbuf()->sgetn(block, sizeof(block))) > 0;) {
+        data.insert(data.end(), block, block + got);
+    }
+    LineCursor cursor{data.data(), data.data() + data.size()};
+    std::deque<ParsedChunk> chunks;
+    // Verbose output stays in file order.
+    const std::size_t recordsPerChunk = verbose ? std::numeric_limits<std::size_t>::max() : 2048;
+    std::size_t records = 0;
+    const char* chunkBegin = cursor.position;
+    std::string_view record;
+    while (true) {
+        const char* recordBegin = cursor.position;
+        if (!cursor.next(record)) {
+            break;
+        }
+        if (records == recordsPerChunk) {
+            chunks.emplace_back(chunkBegin, recordBegin);
+            chunkBegin = recordBegin;
+            records = 0;
+        }
+        skipRecord(cursor, version);
+        ++records;
+    }
+    if (records > 0) {
+        chunks.emplace_back(chunkBegin, cursor.position);
+    }
+
+    TaskGroup group;
+    for (auto& chunk : chunks) {
+        group.run([&chunk, &filePool, version, this]() {
+            parseChunk(chunk, version, filePool, verbose);
+            chunk.done.store(true, std::memory_order_release);
         });
+    }
+    // Topics are resolved in file order as soon as each run is parsed, so
+    // onNewTopic still reports them while later runs are being read.
+    std::unordered_map<std::string, std::shared_ptr<Topic>> topicsByName;
+    for (const auto& topic : topics) {
+        topicsByName.emplace(topic->name, topic);
+    }
+    std::vector<std::shared_ptr<Question>> loadedQuestions;
+    for (auto& chunk : chunks) {
+        if (!group.waitUntil([&chunk]() { return chunk.done.load(std::memory_order_acquire); })) {
+            break;
+        }
+        for (auto& local : chunk.localTopics) {
+            auto it = topicsByName.find(local->name);
+            if (it != topicsByName.end()) {
+                if (verbose) std::cout << "Using existing topic: " << local->name << std::endl;
+                local = it->second;
+            } else {
+                if (verbose) std::cout << "Creating new topic: " << local->name << std::endl;
+                topicsByName.emplace(local->name, local);
+                topics.push_back(local);
+                if (onNewTopic) {
+                    onNewTopic(local);
+                }
+            }
+        }
+        for (std::size_t i = 0; i < chunk.questions.size(); ++i) {
+            chunk.questions[i]->topic = chunk.localTopics[chunk.topicOfQuestion[i]];
+        }
+        loadedQuestions.insert(loadedQuestions.end(), std::make_move_iterator(chunk.questions.begin()),
+                               std::make_move_iterator(chunk.questions.end()));
+    }
+    group.wait();
+    // A slot count or id far beyond what the number of questions explains
+    // comes from a damaged or foreign file: the table is not grown for it,
+    // and such questions get fresh ids when inserted.
+    slots.resize(std::max(slots.size(), std::min(headerSlots, plausibleSlotCount(loadedQuestions.size()))));
+    std::size_t idLimit = std::min(kMaxSlots, 2 * std::max(slots.size(), loadedQuestions.size()));
+    for (const auto& question : loadedQuestions) {
+        if (slotIndexOf(question->id) >= idLimit) {
+            question->id = 0;
+        }
+    }
+    return loadedQuestions;
+}
 
-        if (it != topics.end()) {
-            std::cout << "Using existing topic: " << line << std::endl;
-            topic = *it; 
+void QuestionDatabase::markDirty(const std::shared_ptr<Topic>& topic) {
+    if (!segmentDirectory.empty()) {
+        dirtyTopics.insert(topic->name);
+    }
+}
+
+void QuestionDatabase::markUnsaved(QuestionId id) {
+    // Nothing is unsaved before a bank is open, e.g. while one is read.
+    if (!openedPath.empty()) {
+        unsavedIds.insert(id);
+    }
+}
+
+void QuestionDatabase::ensureTopicLoaded(const std::string& topicName) const {
+    if (!unloadedTopics.empty() && unloadedTopics.count(topicName)) {
+        const_cast<QuestionDatabase*>(this)->loadSegment(topicName);
+    }
+}
+
+void QuestionDatabase::loadAllSegments() const {
+    // In manifest order, so `questions` ends up the same however it is reached.
+    for (const auto& entry : bankSegments) {
+        ensureTopicLoaded(entry.first);
+    }
+}
+
+void QuestionDatabase::loadSegment(const std::string& topicName) {
+    const SegmentInfo& info = bankSegments.at(topicName);
+    TraceScope trace("load_segment", "io");
+    ScopedStageTimer timer(PerfStage::ParseBank, info.bytes);
+    std::istringstream in(SegmentManifest::readSegment(segmentDirectory, info));
+    auto loadedQuestions = parseBank(in, nullptr);
+    // Only marked loaded once parsed, so a damaged segment is never saved over.
+    unloadedTopics.erase(topicName);
+    for (const auto& loadedQuestion : loadedQuestions) {
+        insertQuestion(loadedQuestion);
+    }
+    ++segmentReadCount;
+}
+
+bool QuestionDatabase::isSegmentedPath(const std::string& path) {
+    return !path.empty() && (path.back() == '/' || std::filesystem::is_directory(path));
+}
+
+static std::string directoryKey(std::string path) {
+    while (path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+    return std::filesystem::weakly_canonical(path).string();
+}
+
+std::vector<std::shared_ptr<Question>> QuestionDatabase::openBank(const std::string& path, const TopicCallback& onNewTopic) {
+    if (!isSegmentedPath(path)) {
+        return readQuestionsFromFile(path, onNewTopic);
+    }
+    if (!questions.empty() || !bankSegments.empty()) {
+        // Another bank is already open: read this one in full and append it.
+        QuestionDatabase staging;
+        staging.verbose = verbose;
+        staging.openBank(path, onNewTopic);
+        staging.loadAllSegments();
+        mergeDatabase(staging);
+        return staging.questions;
+    }
+    if (!SegmentManifest::exists(path)) {
+        std::filesystem::create_directories(path);
+        segmentDirectory = path;
+        openedPath = path;
+        return std::vector<std::shared_ptr<Question>>();
+    }
+    TraceScope trace("load_db", "io");
+    SegmentManifest manifest = SegmentManifest::read(path);
+    segmentDirectory = path;
+    openedPath = path;
+    nextSegment = manifest.nextSegment;
+    slots.resize(std::max(slots.size(), manifest.slotCount));
+    for (const auto& info : manifest.segments) {
+        bankSegments[info.topicName] = info;
+        unloadedTopics.insert(info.topicName);
+        auto topic = makeCounted<MemorySubsystem::Topics, Topic>(info.topicName);
+        topics.push_back(topic);
+        if (onNewTopic) {
+            onNewTopic(topic);
+        }
+    }
+    topics = generateTopicsFromQuestions();
+    return std::vector<std::shared_ptr<Question>>();
+}
+
+void QuestionDatabase::saveBank(const std::string& path) {
+    if (isSegmentedPath(path)) {
+        writeSegmentedBank(path);
+    } else {
+        writeQuestionsToFile(path);
+    }
+    if (!openedPath.empty() && directoryKey(path) == directoryKey(openedPath)) {
+        unsavedIds.clear();
+    }
+}
+
+void QuestionDatabase::writeSegmentedBank(const std::string& directory) {
+    bool incremental = !segmentDirectory.empty() && directoryKey(directory) == directoryKey(segmentDirectory);
+    if (!incremental) {
+        loadAllSegments();
+    }
+    TraceScope trace("save_db", "io");
+    ScopedStageTimer timer(PerfStage::SaveBank);
+    std::filesystem::create_directories(directory);
+
+    // What `directory` holds now; when writing somewhere new, any bank
+    // already there is replaced.
+    std::map<std::string, SegmentInfo> previous;
+    SegmentManifest manifest;
+    if (incremental) {
+        previous = bankSegments;
+        manifest.nextSegment = nextSegment;
+    } else if (SegmentManifest::exists(directory)) {
+        SegmentManifest existing = SegmentManifest::read(directory);
+        for (const auto& info : existing.segments) {
+            previous[info.topicName] = info;
+        }
+        manifest.nextSegment = existing.nextSegment;
+    }
+
+    std::map<std::string, std::vector<std::shared_ptr<Question>>> rewritten;
+    if (incremental) {
+        for (const auto& name : dirtyTopics) {
+            rewritten[name];
+        }
+    }
+    for (const auto& question : questions) {
+        if (!incremental || dirtyTopics.count(question->topic->name)) {
+            rewritten[question->topic->name].push_back(question);
+        }
+    }
+
+    std::map<std::string, SegmentInfo> current;
+    std::vector<std::string> obsoleteFiles;
+    for (const auto& entry : previous) {
+        if (incremental && !rewritten.count(entry.first)) {
+            current.insert(entry);
         } else {
-            std::cout << "Creating new topic: " << line << std::endl;
-            topic = std::make_shared<Topic>(line);
-            topics.push_back(topic);
+            obsoleteFiles.push_back(entry.second.fileName);
         }
+    }
+    // File names are handed out in topic order, then the segments are
+    // serialized and written as tasks.
+    std::vector<std::pair<const std::vector<std::shared_ptr<Question>>*, SegmentInfo>> segments;
+    for (const auto& entry : rewritten) {
+        // A topic left without questions loses its segment.
+        if (entry.second.empty()) {
+            continue;
+        }
+        SegmentInfo info;
+        info.topicName = entry.first;
+        info.fileName = manifest.allocateFileName();
+        info.questionCount = static_cast<std::uint32_t>(entry.second.size());
+        segments.emplace_back(&entry.second, info);
+    }
+    TaskGroup group;
+    for (auto& segment : segments) {
+        group.run([this, &segment, &directory]() {
+            std::ostringstream out;
+            writeBank(out, *segment.first);
+            std::string data = out.str();
+            SegmentInfo& info = segment.second;
+            info.bytes = data.size();
+            info.checksum = SegmentManifest::checksum(data);
+            SegmentManifest::writeFileAtomically((std::filesystem::path(directory) / info.fileName).string(), data);
+        });
+    }
+    group.wait();
+    for (const auto& segment : segments) {
+        timer.addBytes(segment.second.bytes);
+        current[segment.second.topicName] = segment.second;
+    }
 
-        auto question = std::make_shared<Question>(questionText, questionType, options, correctOptionIndex, topic);
-        loadedQuestions.push_back(question);
+    manifest.slotCount = slots.size();
+    for (const auto& entry : current) {
+        manifest.segments.push_back(entry.second);
     }
-    inFile.close();
-    for (const auto& loadedQuestion : loadedQuestions) {
-        auto it = std::find(questions.begin(), questions.end(), loadedQuestion);
-        if (it == questions.end()) {
-            questions.push_back(loadedQuestion);
+    manifest.write(directory);
+    // Old files go only after the new manifest is in place.
+    for (const auto& fileName : obsoleteFiles) {
+        std::error_code ignored;
+        std::filesystem::remove(std::filesystem::path(directory) / fileName, ignored);
+    }
+
+    segmentDirectory = directory;
+    bankSegments = std::move(current);
+    nextSegment = manifest.nextSegment;
+    dirtyTopics.clear();
+}
+
+void QuestionDatabase::diffQuestions(const std::vector<std::shared_ptr<Question>>& current, const std::vector<std::shared_ptr<Question>>& fresh, QuestionBatch& batch) {
+    std::unordered_map<QuestionId, std::shared_ptr<Question>> byId;
+    std::unordered_multimap<std::uint64_t, std::shared_ptr<Question>> byContent;
+    for (const auto& question : current) {
+        byId.emplace(question->id, question);
+    }
+    bool withoutIds = std::any_of(fresh.begin(), fresh.end(), [](const std::shared_ptr<Question>& question) {
+        return question->id == 0;
+    });
+    if (withoutIds) {
+        for (const auto& question : current) {
+            byContent.emplace(question->contentHash(), question);
+        }
+    }
+    std::unordered_set<QuestionId> matched;
+    for (const auto& question : fresh) {
+        std::shared_ptr<Question> existing;
+        if (question->id != 0) {
+            auto it = byId.find(question->id);
+            if (it != byId.end()) {
+                existing = it->second;
+            }
         } else {
-            std::cout << "Question already exists in the database: " << loadedQuestion->questionText << std::endl;
+            auto range = byContent.equal_range(question->contentHash());
+            for (auto it = range.first; it != range.second && !existing; ++it) {
+                if (!matched.count(it->second->id) && it->second->sameContent(*question)) {
+                    existing = it->second;
+                }
+            }
+        }
+        if (!existing || !matched.insert(existing->id).second) {
+            batch.added.push_back(question);
+        } else if (!existing->sameContent(*question) || existing->tags != question->tags) {
+            batch.edited.emplace_back(existing->id, question);
+        } else {
+            existing->usageCount = std::max(existing->usageCount, question->usageCount);
         }
     }
-    topics = generateTopicsFromQuestions();
-    return loadedQuestions;
+    for (const auto& question : current) {
+        if (!matched.count(question->id)) {
+            batch.removed.push_back(question->id);
+        }
+    }
+}
+
+BankChanges QuestionDatabase::reloadChanged(const std::string& path) {
+    TraceScope trace("reload_bank", "io");
+    BankChanges changes;
+    QuestionDatabase staging;
+    std::vector<std::shared_ptr<Question>> current;
+    std::vector<std::shared_ptr<Question>> fresh;
+    bool segmented = isSegmentedPath(path);
+    SegmentManifest manifest;
+    std::map<std::string, SegmentInfo> freshSegments;
+    std::unordered_set<std::string> reloadedTopics;
+
+    // Everything is read before the database changes, so a half-written bank
+    // leaves it as it was; the next change notification retries.
+    if (!segmented) {
+        std::ifstream inFile(path);
+        if (!inFile) {
+            return changes;
+        }
+        fresh = staging.parseBank(inFile, nullptr);
+        loadAllSegments();
+        for (const auto& question : questions) {
+            if (!unsavedIds.count(question->id)) {
+                current.push_back(question);
+            }
+        }
+    } else {
+        if (!SegmentManifest::exists(path)) {
+            return changes;
+        }
+        manifest = SegmentManifest::read(path);
+        // Segment headers carry the whole bank's slot count, but each only
+        // holds one topic's questions.
+        staging.slots.resize(std::max(staging.slots.size(), manifest.slotCount));
+        for (const auto& info : manifest.segments) {
+            freshSegments[info.topicName] = info;
+        }
+        std::unordered_set<std::string> topicNames;
+        for (const auto& topic : topics) {
+            topicNames.insert(topic->name);
+        }
+        for (const auto& entry : freshSegments) {
+            auto old = bankSegments.find(entry.first);
+            if (old != bankSegments.end() && old->second.fileName == entry.second.fileName &&
+                old->second.checksum == entry.second.checksum) {
+                continue;
+            }
+            // Unread segments just take the new manifest entry.
+            if (unloadedTopics.count(entry.first) || (old == bankSegments.end() && !topicNames.count(entry.first))) {
+                continue;
+            }
+            std::istringstream in(SegmentManifest::readSegment(path, entry.second));
+            auto parsed = staging.parseBank(in, nullptr);
+            fresh.insert(fresh.end(), parsed.begin(), parsed.end());
+            reloadedTopics.insert(entry.first);
+            ++changes.segmentsRead;
+        }
+        for (const auto& entry : bankSegments) {
+            if (!freshSegments.count(entry.first) && !unloadedTopics.count(entry.first)) {
+                reloadedTopics.insert(entry.first);
+            }
+        }
+        for (const auto& question : questions) {
+            if (reloadedTopics.count(question->topic->name) && !unsavedIds.count(question->id)) {
+                current.push_back(question);
+            }
+        }
+    }
+    // Questions changed here keep their local state; only a larger usage
+    // count on disk is taken over.
+    if (!unsavedIds.empty()) {
+        auto unsaved = [this](const std::shared_ptr<Question>& question) {
+            return unsavedIds.count(question->id) != 0;
+        };
+        for (const auto& question : fresh) {
+            const Slot* slot = unsaved(question) ? liveSlot(question->id) : nullptr;
+            if (slot) {
+                auto& local = questions[slot->denseIndex];
+                local->usageCount = std::max(local->usageCount, question->usageCount);
+            }
+        }
+        fresh.erase(std::remove_if(fresh.begin(), fresh.end(), unsaved), fresh.end());
+    }
+
+    QuestionBatch batch;
+    diffQuestions(current, fresh, batch);
+    std::vector<std::string> topicsBefore;
+    for (const auto& topic : topics) {
+        topicsBefore.push_back(topic->name);
+    }
+    // Edits do not go through applyBatch's topic unification.
+    std::unordered_map<std::string, std::shared_ptr<Topic>> topicsByName;
+    for (const auto& topic : topics) {
+        topicsByName.emplace(topic->name, topic);
+    }
+    std::vector<std::uint32_t> editedUsage;
+    for (auto& edit : batch.edited) {
+        auto it = topicsByName.find(edit.second->topic->name);
+        if (it != topicsByName.end()) {
+            edit.second->topic = it->second;
+        } else {
+            topicsByName.emplace(edit.second->topic->name, edit.second->topic);
+            topics.push_back(edit.second->topic);
+        }
+        editedUsage.push_back(edit.second->usageCount);
+    }
+    slots.resize(std::max({slots.size(), staging.slots.size(), manifest.slotCount}));
+    // What the reload applies matches the disk, so it neither dirties
+    // topics nor counts as unsaved.
+    std::unordered_set<std::string> dirtyBefore = dirtyTopics;
+    applyBatch(batch);
+    dirtyTopics = std::move(dirtyBefore);
+    for (std::size_t i = 0; i < batch.edited.size(); ++i) {
+        // applyBatch carried the in-memory count over.
+        auto& edited = batch.edited[i].second;
+        edited->usageCount = std::max(edited->usageCount, editedUsage[i]);
+        unsavedIds.erase(batch.edited[i].first);
+    }
+    for (const auto& question : batch.added) {
+        unsavedIds.erase(question->id);
+    }
+    for (QuestionId id : batch.removed) {
+        unsavedIds.erase(id);
+    }
+
+    // Regenerating drops topics without questions, so only do it when the
+    // reload changed something.
+    bool regenerateTopics = !batch.added.empty() || !batch.edited.empty() || !batch.removed.empty();
+    if (segmented) {
+        for (const auto& entry : bankSegments) {
+            if (!freshSegments.count(entry.first)) {
+                unloadedTopics.erase(entry.first);
+                regenerateTopics = true;
+            }
+        }
+        for (const auto& entry : freshSegments) {
+            if (!bankSegments.count(entry.first) && !topicsByName.count(entry.first)) {
+                unloadedTopics.insert(entry.first);
+                topics.push_back(makeCounted<MemorySubsystem::Topics, Topic>(entry.first));
+                regenerateTopics = true;
+            }
+        }
+        bankSegments = std::move(freshSegments);
+        nextSegment = std::max(nextSegment, manifest.nextSegment);
+    }
+    if (regenerateTopics) {
+        topics = generateTopicsFromQuestions();
+    }
+    std::vector<std::string> topicsAfter;
+    for (const auto& topic : topics) {
+        topicsAfter.push_back(topic->name);
+    }
+    changes.topicsChanged = topicsBefore != topicsAfter;
+
+    for (const auto& question : batch.added) {
+        changes.added.push_back(question->id);
+    }
+    for (const auto& edit : batch.edited) {
+        changes.edited.push_back(edit.first);
+    }
+    changes.removed = std::move(batch.removed);
+    return changes;
+}
+
+void QuestionDatabase::mergeDatabase(const QuestionDatabase& other) {
+    // An empty database takes over a lazily opened bank as is; otherwise
+    // the other bank has to be read in full.
+    bool adopt = questions.empty() && segmentDirectory.empty() && bankSegments.empty();
+    if (adopt) {
+        segmentDirectory = other.segmentDirectory;
+        bankSegments = other.bankSegments;
+        unloadedTopics = other.unloadedTopics;
+        nextSegment = other.nextSegment;
+        segmentReadCount = other.segmentReadCount;
+    } else {
+        other.loadAllSegments();
+    }
+    // Topics without questions would be missed by applyBatch.
+    std::unordered_set<std::string> topicNames;
+    for (const auto& topic : topics) {
+        topicNames.insert(topic->name);
+    }
+    for (const auto& topic : other.topics) {
+        if (topicNames.insert(topic->name).second) {
+            topics.push_back(topic);
+        }
+    }
+    if (slots.size() < other.slots.size()) {
+        slots.resize(other.slots.size());
+    }
+    QuestionBatch batch;
+    batch.added = other.questions;
+    applyBatch(batch);
+    if (adopt) {
+        dirtyTopics = other.dirtyTopics;
+        if (openedPath.empty()) {
+            openedPath = other.openedPath;
+            unsavedIds = other.unsavedIds;
+        }
+    }
+    std::sort(topics.begin(), topics.end(),
+        [](const std::shared_ptr<Topic>& a, const std::shared_ptr<Topic>& b) {
+            return a->name < b->name;
+        });
 }
 
 std::vector<std::shared_ptr<Topic>> QuestionDatabase::generateTopicsFromQuestions() const {
+    TraceScope trace("topic_regen");
+    ScopedStageTimer timer(PerfStage::TopicRegen);
     std::vector<std::shared_ptr<Topic>> generatedTopics;
-    for (const auto& question : questions) {
-        auto it = std::find_if(generatedTopics.begin(), generatedTopics.end(), 
-            [&question](const std::shared_ptr<Topic>& topic) {
-                return topic->name == question->topic->name;
-            });
-
-        if (it == generatedTopics.end()) {
-            generatedTopics.push_back(question->topic);
+    for (const auto& topic : topics) {
+        if (unloadedTopics.count(topic->name)) {
+            generatedTopics.push_back(topic);
+        }
+    }
+    // Each range lists its topics in first-seen order; merging the lists in
+    // range order keeps the first topic object seen for every name.
+    const std::size_t grain = 16384;
+    std::vector<std::vector<std::shared_ptr<Topic>>> found((questions.size() + grain - 1) / grain);
+    parallelFor(found.size(), 1, [this, &found, grain](std::size_t first, std::size_t last) {
+        for (std::size_t range = first; range < last; ++range) {
+            std::unordered_set<std::string_view> seen;
+            const Topic* previous = nullptr;
+            std::size_t end = std::min(questions.size(), (range + 1) * grain);
+            for (std::size_t i = range * grain; i < end; ++i) {
+                const auto& topic = questions[i]->topic;
+                if (topic.get() != previous && seen.insert(topic->name).second) {
+                    found[range].push_back(topic);
+                }
+                previous = topic.get();
+            }
+        }
+    });
+    std::unordered_set<std::string_view> names;
+    for (const auto& topic : generatedTopics) {
+        names.insert(topic->name);
+    }
+    for (const auto& list : found) {
+        for (const auto& topic : list) {
+            if (names.insert(topic->name).second) {
+                generatedTopics.push_back(topic);
+            }
         }
     }
     
@@ -156,23 +1182,135 @@ std::vector<std::shared_ptr<Topic>> QuestionDatabase::generateTopicsFromQuestion
     return generatedTopics;
 }
 
+// Partial Fisher-Yates over a pool that stays untouched: the few positions
+// swapped so far live in a map, which gives exactly the draws that swapping
+// the pool itself would.
+static void drawFromPool(const std::vector<std::shared_ptr<Question>>& pool, int requested, Rng& stream, std::vector<std::shared_ptr<Question>>& out) {
+    std::size_t count = std::min(static_cast<std::size_t>(std::max(requested, 0)), pool.size());
+    std::unordered_map<std::size_t, std::size_t> displaced;
+    auto at = [&displaced](std::size_t position) {
+        auto it = displaced.find(position);
+        return it == displaced.end() ? position : it->second;
+    };
+    for (std::size_t j = 0; j < count; ++j) {
+        std::size_t r = j + stream.below(pool.size() - j);
+        std::size_t picked = at(r);
+        displaced[r] = at(j);
+        out.push_back(pool[picked]);
+    }
+}
+
+std::vector<std::vector<std::shared_ptr<Question>>> QuestionDatabase::preparePools(const std::vector<QuestionQuota>& quotas) const {
+    std::vector<std::vector<std::shared_ptr<Question>>> pools;
+    pools.reserve(quotas.size());
+    for (const auto& quota : quotas) {
+        pools.push_back(selectQuestions(quota));
+    }
+    return pools;
+}
+
+std::shared_ptr<QuizVariant> QuestionDatabase::generateVariant(const std::string& name, const std::vector<QuestionQuota>& quotas, const std::vector<std::vector<std::shared_ptr<Question>>>& pools, bool shuffle, const RngService& rng, std::uint64_t streamIndex) const {
+    TraceScope trace("sample", "generate", static_cast<std::int64_t>(streamIndex));
+    ScopedStageTimer timer(PerfStage::Sampling);
+    Rng stream = rng.stream(streamIndex);
+    auto quizVariant = std::make_shared<QuizVariant>(name);
+    quizVariant->seed = rng.masterSeed();
+    quizVariant->stream = streamIndex;
+    for (std::size_t i = 0; i < quotas.size() && i < pools.size(); ++i) {
+        drawFromPool(pools[i], quotas[i].count, stream, quizVariant->questions);
+    }
+    if (shuffle) {
+        quizVariant->shuffleQuestions(stream);
+    }
+    return quizVariant;
+}
+
+std::shared_ptr<QuizVariant> QuestionDatabase::generateVariant(const std::string& name, const std::vector<QuestionQuota>& quotas, bool shuffle, const RngService& rng, std::uint64_t streamIndex, ExposureSampler* weighted) const {
+    TraceScope trace("sample", "generate", static_cast<std::int64_t>(streamIndex));
+    ScopedStageTimer timer(PerfStage::Sampling);
+    Rng stream = rng.stream(streamIndex);
+    auto quizVariant = std::make_shared<QuizVariant>(name);
+    quizVariant->seed = rng.masterSeed();
+    quizVariant->stream = streamIndex;
+    for (const auto& quota : quotas) {
+        if (weighted) {
+            weighted->draw(quota, stream, quizVariant->questions);
+            continue;
+        }
+        drawFromPool(selectQuestions(quota), quota.count, stream, quizVariant->questions);
+    }
+    if (shuffle) {
+        quizVariant->shuffleQuestions(stream);
+    }
+    return quizVariant;
+}
+
+void QuestionDatabase::recordUsage(const QuizVariant& quizVariant) {
+    for (const auto& question : quizVariant.questions) {
+        markDirty(question->topic);
+        ++question->usageCount;
+    }
+}
+
 void QuestionDatabase::writeExamToDoc(const std::string& filePath, const std::shared_ptr<QuizVariant>& quizVariant) const {
-    DocumentWriter docWriter;
+    writeExamToDoc(filePath, quizVariant, DocumentOptions());
+}
+
+void QuestionDatabase::writeExamToDoc(const std::string& filePath, const std::shared_ptr<QuizVariant>& quizVariant, const DocumentOptions& options) const {
+    DocumentWriter docWriter(options);
     if (!docWriter.createDocument(filePath, quizVariant)) {
         throw std::runtime_error("Failed to create document: " + filePath);
     }
 }
 
 
+static void hashBytes(std::uint64_t& hash, const void* data, std::size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+static void hashText(std::uint64_t& hash, const std::string& text) {
+    // The length keeps ("ab", "c") apart from ("a", "bc").
+    std::uint64_t size = text.size();
+    hashBytes(hash, &size, sizeof(size));
+    hashBytes(hash, text.data(), text.size());
+}
+
+// Option texts are interned, so equal options have equal ids and the ids can
+// be hashed and compared instead of the texts.
+std::uint64_t Question::contentHash() const {
+    std::uint64_t hash = 1469598103934665603ULL;
+    hashText(hash, questionText);
+    hashText(hash, topic->name);
+    hashBytes(hash, &questionType, sizeof(questionType));
+    hashBytes(hash, &correctOptionIndex, sizeof(correctOptionIndex));
+    std::int64_t optionCount = options ? static_cast<std::int64_t>(options->size()) : -1;
+    hashBytes(hash, &optionCount, sizeof(optionCount));
+    if (options) {
+        const auto& ids = options->ids();
+        hashBytes(hash, ids.data(), ids.size() * sizeof(StringId));
+    }
+    return hash;
+}
+
+bool Question::sameContent(const Question& other) const {
+    if (questionText != other.questionText || topic->name != other.topic->name ||
+        questionType != other.questionType || correctOptionIndex != other.correctOptionIndex ||
+        options.has_value() != other.options.has_value()) {
+        return false;
+    }
+    return !options || options->ids() == other.options->ids();
+}
+
 void QuizVariant::addQuestion(std::shared_ptr<Question> question) {
     questions.push_back(question);
 }
 
 void QuestionDatabase::editQuestion(const std::shared_ptr<Question>& oldQuestion, const std::shared_ptr<Question>& newQuestion) {
-    auto it = std::find(questions.begin(), questions.end(), oldQuestion);
-    if (it != questions.end()) {
-        *it = newQuestion;
-    } else {
+    if (!replaceQuestion(oldQuestion, newQuestion)) {
         throw std::runtime_error("Question not found in the variant");
     }
 }
@@ -188,6 +1326,10 @@ std::vector<std::shared_ptr<Question>> QuizVariant::getQuestions() const {
     return questions;
 }
 
-void QuizVariant::shuffleQuestions() {
-    std::shuffle(questions.begin(), questions.end(), std::mt19937(std::random_device{}()));
+void QuizVariant::shuffleQuestions(Rng& rng) {
+    // Hand-rolled Fisher-Yates: std::shuffle's sequence varies between
+    // standard libraries, which would break seed reproducibility.
+    for (std::size_t i = questions.size(); i > 1; --i) {
+        std::swap(questions[i - 1], questions[rng.below(i)]);
+    }
 }
\ No newline at end of file
@@ -3,6 +3,16 @@
 #include <vector>
 #include <memory>
 #include <optional>
+#include <functional>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <unordered_set>
+#include "rng.h"
+#include "segments.h"
+#include "tags.h"
+#include "strings.h"
 
 class Topic{
     public:
@@ -11,48 +21,195 @@ class Topic{
         Topic(const std::string& topicName) : name(topicName) {}
 };
 
+// Stable across saves and edits; 0 means "not yet assigned". The low 32 bits
+// index a slot in QuestionDatabase and the high 32 bits are that slot's
+// generation, so the id of a removed question never matches a later one.
+using QuestionId = std::uint64_t;
+
 class Question {
     public:
+        QuestionId id = 0;
+        // How many generated variants have included this question.
+        std::uint32_t usageCount = 0;
         std::string questionText;
         int questionType;
-        std::optional<std::vector<std::string>> options;
+        std::optional<OptionList> options;
         int correctOptionIndex;
         std::shared_ptr<Topic> topic;
+        // Free-form labels such as "difficulty:hard"; see TagIndex for filtering.
+        std::vector<std::string> tags;
 
         Question(const std::string& text, int type, const std::optional<std::vector<std::string>>& opts, int correctIndex, std::shared_ptr<Topic> topicPtr)
-            : questionText(text), questionType(type), options(opts), correctOptionIndex(correctIndex), topic(topicPtr) {}
+            : questionText(text), questionType(type), correctOptionIndex(correctIndex), topic(topicPtr) {
+            if (opts) {
+                options = OptionList(*opts);
+            }
+        }
+
+        // Over text, type, options, answer and topic name; the id, usage
+        // count and tags are not part of a question's content.
+        std::uint64_t contentHash() const;
+        bool sameContent(const Question& other) const;
 };
 class QuizVariant {
     public:
         std::string variantName;
         std::vector<std::shared_ptr<Question>> questions;
+        // Master seed and stream index the variant was sampled with, if any.
+        std::optional<std::uint64_t> seed;
+        std::uint64_t stream = 0;
 
         QuizVariant(const std::string& name) : variantName(name) {}
 
         void addQuestion(std::shared_ptr<Question> question);
         void removeQuestion(const std::shared_ptr<Question>& question);
         std::vector<std::shared_ptr<Question>> getQuestions() const;
-        void shuffleQuestions();
+        void shuffleQuestions(Rng& rng);
+};
+// One line of a variant spec: `count` questions from `topic` (any topic when
+// null) that also match `tagFilter` (see TagIndex::evaluate).
+struct QuestionQuota {
+    std::shared_ptr<Topic> topic;
+    int count;
+    std::string tagFilter;
+
+    QuestionQuota(std::shared_ptr<Topic> topicPtr, int questionCount, const std::string& filter = "")
+        : topic(topicPtr), count(questionCount), tagFilter(filter) {}
 };
+
+// Mutations applied together by QuestionDatabase::applyBatch.
+struct QuestionBatch {
+    std::vector<std::shared_ptr<Question>> added;
+    // Replacement for the question with the given id.
+    std::vector<std::pair<QuestionId, std::shared_ptr<Question>>> edited;
+    std::vector<QuestionId> removed;
+    // Questions removed earlier and now put back, e.g. by undo. They get
+    // their old id again unless its slot was reused in the meantime.
+    std::vector<std::shared_ptr<Question>> restored;
+};
+
+// What QuestionDatabase::reloadChanged applied, by question id.
+struct BankChanges {
+    std::vector<QuestionId> added;
+    std::vector<QuestionId> edited;
+    std::vector<QuestionId> removed;
+    bool topicsChanged = false;
+    std::size_t segmentsRead = 0;
+
+    bool empty() const { return added.empty() && edited.empty() && removed.empty() && !topicsChanged; }
+};
+
+class ExposureSampler;
+struct DocumentOptions;
+
 class QuestionDatabase{
     public:
         std::vector<std::shared_ptr<Question>> questions;
         std::vector<std::shared_ptr<Topic>> topics;
+        bool verbose = false;
 
+        using TopicCallback = std::function<void(const std::shared_ptr<Topic>&)>;
 
         void addQuestion(std::shared_ptr<Question> question);
         void editQuestion(const std::shared_ptr<Question>& oldQuestion, const std::shared_ptr<Question>& newQuestion);
         std::vector<std::shared_ptr<Question>> getQuestionsByTopic(const std::shared_ptr<Topic>& topic) const;
-        std::vector<std::shared_ptr<Question>> readQuestionsFromFile(const std::string& filePath);
+        std::vector<std::shared_ptr<Question>> readQuestionsFromFile(const std::string& filePath, const TopicCallback& onNewTopic = nullptr);
         void writeQuestionsToFile(const std::string& filePath) const;
+        // Banks may be a single file or a segmented directory (one file per
+        // topic, see SegmentManifest). A directory, or a path ending in '/',
+        // is segmented; its segments are only read when a topic is touched.
+        static bool isSegmentedPath(const std::string& path);
+        std::vector<std::shared_ptr<Question>> openBank(const std::string& path, const TopicCallback& onNewTopic = nullptr);
+        // Saving to the directory the bank was opened from rewrites only the
+        // segments of topics changed since.
+        void saveBank(const std::string& path);
+        // Brings the database in line with the bank at `path` after it changed
+        // on disk, touching only what differs. Of a segmented bank only the
+        // loaded segments whose checksum changed are read. Questions are
+        // matched by id, or by content for format-1 files. Questions added,
+        // edited or removed here since the bank was opened or last saved to
+        // its own path keep their local state, and every question keeps the
+        // larger of its two usage counts.
+        BankChanges reloadChanged(const std::string& path);
+        void writeSegmentedBank(const std::string& directory);
+        // Lazy segment loading is not thread-safe: load everything before
+        // sharing the database between threads.
+        void ensureTopicLoaded(const std::string& topicName) const;
+        void loadAllSegments() const;
+        // Uses the manifest count while the topic's segment is still unread.
+        std::size_t topicQuestionCount(const std::shared_ptr<Topic>& topic) const;
+        std::size_t segmentsRead() const { return segmentReadCount; }
         std::vector<std::shared_ptr<Question>> getAllQuestions() const;
         void removeQuestion(const std::shared_ptr<Question>& question);
+        // Removes the topic together with all of its questions.
+        void removeTopic(const std::shared_ptr<Topic>& topic);
+        // Removes every listed question in one compacting pass over
+        // `questions`; unknown ids are skipped. Returns how many were removed.
+        std::size_t removeMany(const std::vector<QuestionId>& ids);
+        // Applies edits, then removals, then restorations and additions
+        // (whose topics are unified by name), compacting `questions` once.
+        void applyBatch(const QuestionBatch& batch);
+        std::shared_ptr<Question> findQuestionById(QuestionId id) const;
+        // Candidates for one quota, ordered by id when a tag filter is given.
+        std::vector<std::shared_ptr<Question>> selectQuestions(const QuestionQuota& quota) const;
+        const TagIndex& tagIndex() const { loadAllSegments(); return questionTags; }
         void updateQuestion(const std::shared_ptr<Question>& oldQuestion, const std::shared_ptr<Question>& newQuestion);
         std::shared_ptr<Question> getQuestionByIndex(int index) const;
         int getQuestionCount() const;
+        // Appends another database's questions, unifying topics by name.
+        void mergeDatabase(const QuestionDatabase& other);
+        // Samples a variant from stream `streamIndex` of `rng`; the same bank,
+        // spec, seed and index always yield the same variant. With a sampler,
+        // draws favour questions with low usage counts.
+        std::shared_ptr<QuizVariant> generateVariant(const std::string& name, const std::vector<QuestionQuota>& quotas, bool shuffle, const RngService& rng, std::uint64_t streamIndex, ExposureSampler* weighted = nullptr) const;
+        // Candidate pools for each quota, so that many variants can be drawn
+        // from one spec without selecting again.
+        std::vector<std::vector<std::shared_ptr<Question>>> preparePools(const std::vector<QuestionQuota>& quotas) const;
+        // Draws exactly as the overload above (without a sampler) would.
+        std::shared_ptr<QuizVariant> generateVariant(const std::string& name, const std::vector<QuestionQuota>& quotas, const std::vector<std::vector<std::shared_ptr<Question>>>& pools, bool shuffle, const RngService& rng, std::uint64_t streamIndex) const;
+        // Bumps the usage counter of every question in the variant.
+        void recordUsage(const QuizVariant& quizVariant);
         void writeExamToDoc(const std::string& filePath, const std::shared_ptr<QuizVariant>& QuizVariant) const;
+        void writeExamToDoc(const std::string& filePath, const std::shared_ptr<QuizVariant>& quizVariant, const DocumentOptions& options) const;
     private:
         std::vector<std::shared_ptr<Topic>> generateTopicsFromQuestions() const;
 
+        // Slot map over `questions`: a slot records where its question sits.
+        struct Slot {
+            std::uint32_t generation = 0;
+            std::uint32_t denseIndex = 0;
+            bool occupied = false;
+        };
+
+        Slot* liveSlot(QuestionId id);
+        const Slot* liveSlot(QuestionId id) const;
+        void assignSlot(Question& question, bool restoring = false);
+        bool replaceQuestion(const std::shared_ptr<Question>& oldQuestion, const std::shared_ptr<Question>& newQuestion);
+        void compactFrom(std::size_t firstRemoved);
+        void insertQuestion(std::shared_ptr<Question> question, bool restoring = false);
+        void markDirty(const std::shared_ptr<Topic>& topic);
+        void markUnsaved(QuestionId id);
+        void loadSegment(const std::string& topicName);
+        static void diffQuestions(const std::vector<std::shared_ptr<Question>>& current, const std::vector<std::shared_ptr<Question>>& fresh, QuestionBatch& batch);
+        void writeBank(std::ostream& outFile, const std::vector<std::shared_ptr<Question>>& bankQuestions) const;
+        std::vector<std::shared_ptr<Question>> parseBank(std::istream& inFile, const TopicCallback& onNewTopic);
+
+        std::vector<Slot> slots = std::vector<Slot>(1);
+        // The bank opened first, and the ids of questions added, edited or
+        // removed since it was read or last saved to the same path.
+        std::string openedPath;
+        std::unordered_set<QuestionId> unsavedIds;
+        // Slots freed in this session; their generation is already bumped.
+        std::vector<std::uint32_t> freeSlots;
+        TagIndex questionTags;
+
+        // Segmented banks only. `bankSegments` mirrors the manifest on disk.
+        std::string segmentDirectory;
+        std::map<std::string, SegmentInfo> bankSegments;
+        std::unordered_set<std::string> unloadedTopics;
+        std::unordered_set<std::string> dirtyTopics;
+        std::uint32_t nextSegment = 1;
+        std::size_t segmentReadCount = 0;
+
 };
 
@@ -0,0 +1,62 @@
+#include "rng.h"
+#include <random>
+
+std::uint64_t RngService::splitMix64(std::uint64_t& x) {
+    std::uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+Rng::Rng(std::uint64_t seed) {
+    for (auto& word : state) {
+        word = RngService::splitMix64(seed);
+    }
+}
+
+// Full 128-bit product of a and b, as high and low halves.
+static void multiply128(std::uint64_t a, std::uint64_t b, std::uint64_t& high, std::uint64_t& low) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    high = static_cast<std::uint64_t>(product >> 64);
+    low = static_cast<std::uint64_t>(product);
+#else
+    std::uint64_t aLow = a & 0xffffffffULL, aHigh = a >> 32;
+    std::uint64_t bLow = b & 0xffffffffULL, bHigh = b >> 32;
+    std::uint64_t lowLow = aLow * bLow;
+    std::uint64_t highLow = aHigh * bLow;
+    std::uint64_t lowHigh = aLow * bHigh;
+    std::uint64_t middle = (lowLow >> 32) + (highLow & 0xffffffffULL) + (lowHigh & 0xffffffffULL);
+    high = aHigh * bHigh + (highLow >> 32) + (lowHigh >> 32) + (middle >> 32);
+    low = (middle << 32) | (lowLow & 0xffffffffULL);
+#endif
+}
+
+std::uint64_t Rng::below(std::uint64_t bound) {
+    if (bound == 0) {
+        return 0;
+    }
+    // Lemire's multiply-shift with rejection of the biased low range; the
+    // same on every compiler, so seeds reproduce everywhere.
+    std::uint64_t high;
+    std::uint64_t low;
+    multiply128((*this)(), bound, high, low);
+    if (low < bound) {
+        std::uint64_t threshold = -bound % bound;
+        while (low < threshold) {
+            multiply128((*this)(), bound, high, low);
+        }
+    }
+    return high;
+}
+
+std::uint64_t RngService::randomSeed() {
+    std::random_device device;
+    return (static_cast<std::uint64_t>(device()) << 32) ^ device();
+}
+
+Rng RngService::stream(std::uint64_t streamIndex) const {
+    std::uint64_t mix = streamIndex;
+    std::uint64_t streamSeed = seed ^ splitMix64(mix);
+    return Rng(splitMix64(streamSeed));
+}
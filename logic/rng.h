@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+
+// xoshiro256** generator: 32 bytes of state, no syscalls, and a sequence that
+// is identical on every platform. Satisfies UniformRandomBitGenerator.
+class Rng {
+public:
+    using result_type = std::uint64_t;
+
+    explicit Rng(std::uint64_t seed);
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()() {
+        const std::uint64_t result = rotl(state[1] * 5, 7) * 9;
+        const std::uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    // Unbiased integer in [0, bound). Unlike std::uniform_int_distribution the
+    // result does not depend on the standard library implementation.
+    std::uint64_t below(std::uint64_t bound);
+    // Uniform double in [0, 1) with 53 random bits.
+    double uniform() { return static_cast<double>((*this)() >> 11) * (1.0 / 9007199254740992.0); }
+
+private:
+    static std::uint64_t rotl(std::uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+    std::uint64_t state[4];
+};
+
+// Hands out independent per-variant streams derived from one master seed, so
+// any variant can be regenerated from (master seed, stream index) alone.
+class RngService {
+public:
+    explicit RngService(std::uint64_t masterSeed) : seed(masterSeed) {}
+
+    // A fresh master seed from the OS; the only place random_device is used.
+    static std::uint64_t randomSeed();
+    static std::uint64_t splitMix64(std::uint64_t& x);
+
+    std::uint64_t masterSeed() const { return seed; }
+    Rng stream(std::uint64_t streamIndex) const;
+
+private:
+    std::uint64_t seed;
+};
@@ -0,0 +1,123 @@
+#include "sampler.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+void AliasTable::build(const std::vector<double>& weights) {
+    std::size_t n = weights.size();
+    probability.assign(n, 0.0);
+    alias.assign(n, 0);
+    if (n == 0) {
+        return;
+    }
+    double total = 0;
+    for (double w : weights) {
+        total += w;
+    }
+
+    std::vector<double> scaled(n);
+    std::vector<std::uint32_t> small;
+    std::vector<std::uint32_t> large;
+    for (std::size_t i = 0; i < n; ++i) {
+        scaled[i] = weights[i] * static_cast<double>(n) / total;
+        (scaled[i] < 1.0 ? small : large).push_back(static_cast<std::uint32_t>(i));
+    }
+    while (!small.empty() && !large.empty()) {
+        std::uint32_t less = small.back();
+        small.pop_back();
+        std::uint32_t more = large.back();
+        probability[less] = scaled[less];
+        alias[less] = more;
+        scaled[more] = (scaled[more] + scaled[less]) - 1.0;
+        if (scaled[more] < 1.0) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+    // Whatever is left is 1 up to rounding error.
+    for (std::uint32_t i : large) {
+        probability[i] = 1.0;
+    }
+    for (std::uint32_t i : small) {
+        probability[i] = 1.0;
+    }
+}
+
+std::size_t AliasTable::sample(Rng& rng) const {
+    std::size_t column = rng.below(probability.size());
+    return rng.uniform() < probability[column] ? column : alias[column];
+}
+
+double ExposureSampler::weightFor(std::uint32_t usage, std::uint32_t minUsage) {
+    return 1.0 / (1.0 + static_cast<double>(usage > minUsage ? usage - minUsage : 0));
+}
+
+ExposureSampler::PoolTable& ExposureSampler::tableFor(const QuestionQuota& quota) {
+    std::string key = (quota.topic ? quota.topic->name : std::string()) + '\x1f' + quota.tagFilter;
+    auto it = tables.find(key);
+    if (it == tables.end()) {
+        it = tables.emplace(key, PoolTable()).first;
+        it->second.pool = db.selectQuestions(quota);
+        rebuild(it->second);
+    }
+    return it->second;
+}
+
+void ExposureSampler::rebuild(PoolTable& table) {
+    table.minUsage = table.pool.empty() ? 0 : table.pool.front()->usageCount;
+    for (const auto& question : table.pool) {
+        table.minUsage = std::min(table.minUsage, question->usageCount);
+    }
+    table.builtWeights.resize(table.pool.size());
+    for (std::size_t i = 0; i < table.pool.size(); ++i) {
+        table.builtWeights[i] = weightFor(table.pool[i]->usageCount, table.minUsage);
+    }
+    table.table.build(table.builtWeights);
+    table.draws = 0;
+    table.rejections = 0;
+    ++rebuilds;
+}
+
+void ExposureSampler::draw(const QuestionQuota& quota, Rng& rng, std::vector<std::shared_ptr<Question>>& out) {
+    PoolTable& table = tableFor(quota);
+    std::size_t n = table.pool.size();
+    std::size_t count = std::min(static_cast<std::size_t>(std::max(quota.count, 0)), n);
+    if (count == 0) {
+        return;
+    }
+
+    // Once a third of the draws are rejected the table has drifted too far.
+    if (table.draws > 32 && table.rejections * 3 > table.draws) {
+        rebuild(table);
+    }
+
+    if (count * 2 > n) {
+        // Dense picks: weighted sampling without replacement via
+        // Efraimidis-Spirakis keys u^(1/w); cheaper than rejecting repeats.
+        std::vector<std::pair<double, std::size_t>> keys(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            double weight = weightFor(table.pool[i]->usageCount, table.minUsage);
+            keys[i] = {std::log(1.0 - rng.uniform()) / weight, i};
+        }
+        std::partial_sort(keys.begin(), keys.begin() + count, keys.end(),
+            [](const auto& a, const auto& b) { return a.first > b.first; });
+        for (std::size_t i = 0; i < count; ++i) {
+            out.push_back(table.pool[keys[i].second]);
+        }
+        return;
+    }
+
+    std::unordered_set<std::size_t> chosen;
+    while (chosen.size() < count) {
+        std::size_t index = table.table.sample(rng);
+        ++table.draws;
+        double current = weightFor(table.pool[index]->usageCount, table.minUsage);
+        if (rng.uniform() * table.builtWeights[index] >= current) {
+            ++table.rejections;
+            continue;
+        }
+        if (chosen.insert(index).second) {
+            out.push_back(table.pool[index]);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "quiz.h"
+
+// Walker/Vose alias table: O(n) build, O(1) draw.
+class AliasTable {
+public:
+    void build(const std::vector<double>& weights);
+    std::size_t sample(Rng& rng) const;
+    std::size_t size() const { return probability.size(); }
+
+private:
+    std::vector<double> probability;
+    std::vector<std::uint32_t> alias;
+};
+
+// Draws questions with weight 1 / (1 + usage - minUsage), so under-exposed
+// questions come up more often. Usage only grows, so weights only shrink:
+// a table built from older counts is corrected exactly by accepting each draw
+// with probability currentWeight / builtWeight, and is rebuilt once too many
+// draws get rejected. Seeds reproduce a weighted batch only when the usage
+// counters are the same as they were originally.
+class ExposureSampler {
+public:
+    explicit ExposureSampler(const QuestionDatabase& db) : db(db) {}
+
+    // Appends up to `quota.count` distinct matching questions to `out`.
+    void draw(const QuestionQuota& quota, Rng& rng, std::vector<std::shared_ptr<Question>>& out);
+    std::size_t rebuildCount() const { return rebuilds; }
+
+    static double weightFor(std::uint32_t usage, std::uint32_t minUsage);
+
+private:
+    struct PoolTable {
+        std::vector<std::shared_ptr<Question>> pool;
+        std::vector<double> builtWeights;
+        std::uint32_t minUsage = 0;
+        AliasTable table;
+        std::size_t draws = 0;
+        std::size_t rejections = 0;
+    };
+
+    PoolTable& tableFor(const QuestionQuota& quota);
+    void rebuild(PoolTable& table);
+
+    const QuestionDatabase& db;
+    std::unordered_map<std::string, PoolTable> tables;
+    std::size_t rebuilds = 0;
+};
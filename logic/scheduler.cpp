@@ -0,0 +1,258 @@
+#include "scheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include "trace.h"
+
+// The pool and worker the current thread belongs to, and the group of the
+// task it is running, if any.
+static thread_local TaskScheduler* currentScheduler = nullptr;
+static thread_local std::size_t currentWorker = 0;
+static thread_local TaskGroup* currentGroup = nullptr;
+
+static void backoff(int attempt) {
+    if (attempt < 64) {
+        return;
+    }
+    if (attempt < 128) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+// Removes the first task of `group` (any task when null), scanning from the
+// back for the owner of a deque and from the front for everyone else.
+bool TaskScheduler::takeFrom(std::deque<Task>& tasks, const TaskGroup* group, bool fromBack, Task& task) {
+    if (tasks.empty()) {
+        return false;
+    }
+    if (!group) {
+        if (fromBack) {
+            task = std::move(tasks.back());
+            tasks.pop_back();
+        } else {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        return true;
+    }
+    auto matches = [group](const Task& candidate) { return candidate.group == group; };
+    if (fromBack) {
+        auto it = std::find_if(tasks.rbegin(), tasks.rend(), matches);
+        if (it == tasks.rend()) {
+            return false;
+        }
+        task = std::move(*it);
+        tasks.erase(std::next(it).base());
+    } else {
+        auto it = std::find_if(tasks.begin(), tasks.end(), matches);
+        if (it == tasks.end()) {
+            return false;
+        }
+        task = std::move(*it);
+        tasks.erase(it);
+    }
+    return true;
+}
+
+TaskScheduler& TaskScheduler::instance() {
+    static TaskScheduler scheduler([]() {
+        unsigned cores = std::thread::hardware_concurrency();
+        return cores > 1 ? cores - 1 : 1;
+    }());
+    return scheduler;
+}
+
+TaskScheduler::TaskScheduler(unsigned workerCount) {
+    workerCount = std::max(1u, workerCount);
+    for (unsigned i = 0; i < workerCount; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    // Started only once every deque exists, since workers steal from all.
+    for (unsigned i = 0; i < workerCount; ++i) {
+        workers[i]->thread = std::thread([this, i]() { workerLoop(i); });
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+void TaskScheduler::submit(Task task) {
+    if (currentScheduler == this) {
+        Worker& own = *workers[currentWorker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.tasks.push_back(std::move(task));
+    } else {
+        std::lock_guard<std::mutex> lock(injectedMutex);
+        injected.push_back(std::move(task));
+    }
+    queued.fetch_add(1, std::memory_order_release);
+    {
+        // Pairs with the predicate check in workerLoop, so no wake-up is lost.
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_one();
+}
+
+bool TaskScheduler::takeTask(Task& task, const TaskGroup* group) {
+    if (queued.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    bool taken = false;
+    if (currentScheduler == this) {
+        Worker& own = *workers[currentWorker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        taken = takeFrom(own.tasks, group, true, task);
+    }
+    if (!taken) {
+        std::lock_guard<std::mutex> lock(injectedMutex);
+        taken = takeFrom(injected, group, false, task);
+    }
+    std::size_t first = nextVictim.fetch_add(1, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < workers.size() && !taken; ++i) {
+        Worker& victim = *workers[(first + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        taken = takeFrom(victim.tasks, group, false, task);
+    }
+    if (taken) {
+        queued.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return taken;
+}
+
+void TaskScheduler::execute(Task& task) {
+    TaskGroup* group = task.group;
+    if (!group->cancelled()) {
+        TaskGroup* outer = currentGroup;
+        currentGroup = group;
+        try {
+            task.body();
+        } catch (...) {
+            group->fail(std::current_exception());
+        }
+        currentGroup = outer;
+    }
+    // Release what the task captured before the group can be seen finished.
+    task.body = nullptr;
+    group->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void TaskScheduler::workerLoop(std::size_t index) {
+    currentScheduler = this;
+    currentWorker = index;
+    Tracer::instance().setThreadName("task-worker-" + std::to_string(index));
+    while (true) {
+        Task task;
+        if (takeTask(task, nullptr)) {
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this]() { return stopping || queued.load(std::memory_order_acquire) > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+TaskGroup::TaskGroup(std::shared_ptr<CancellationToken> cancellation, TaskScheduler& scheduler)
+    : scheduler(scheduler), token(std::move(cancellation)) {
+    if (!token && currentGroup) {
+        token = currentGroup->token;
+    }
+}
+
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+void TaskGroup::run(std::function<void()> task) {
+    pending.fetch_add(1, std::memory_order_relaxed);
+    scheduler.submit({std::move(task), this});
+}
+
+bool TaskGroup::runPending() {
+    TaskScheduler::Task task;
+    if (!scheduler.takeTask(task, this)) {
+        return false;
+    }
+    scheduler.execute(task);
+    return true;
+}
+
+bool TaskGroup::waitUntil(const std::function<bool()>& ready) {
+    for (int attempt = 0;; ++attempt) {
+        if (ready()) {
+            return true;
+        }
+        if (cancelled()) {
+            return false;
+        }
+        if (runPending()) {
+            attempt = 0;
+        } else {
+            backoff(attempt);
+        }
+    }
+}
+
+void TaskGroup::wait() {
+    for (int attempt = 0; pending.load(std::memory_order_acquire) > 0;) {
+        if (runPending()) {
+            attempt = 0;
+        } else {
+            backoff(attempt++);
+        }
+    }
+    std::exception_ptr thrown;
+    {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        std::swap(thrown, error);
+    }
+    if (thrown) {
+        std::rethrow_exception(thrown);
+    }
+    if (token && token->cancelled()) {
+        throw OperationCancelled();
+    }
+}
+
+void TaskGroup::fail(std::exception_ptr exception) {
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if (!error) {
+        error = exception;
+    }
+    failed = true;
+}
+
+void parallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)>& body) {
+    grain = std::max<std::size_t>(1, grain);
+    // A few ranges per thread, so uneven ranges still balance out.
+    std::size_t ranges = std::min((count + grain - 1) / grain,
+                                  static_cast<std::size_t>(TaskScheduler::instance().concurrency()) * 4);
+    if (ranges <= 1) {
+        if (count > 0) {
+            body(0, count);
+        }
+        return;
+    }
+    TaskGroup group;
+    std::size_t step = (count + ranges - 1) / ranges;
+    for (std::size_t begin = 0; begin < count; begin += step) {
+        std::size_t end = std::min(count, begin + step);
+        group.run([&body, begin, end]() { body(begin, end); });
+    }
+    group.wait();
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Set from any thread (e.g. a Cancel button) to stop the work it was handed
+// to. Tasks that have not started are skipped; long tasks poll cancelled().
+class CancellationToken {
+public:
+    void cancel() { flag.store(true, std::memory_order_relaxed); }
+    bool cancelled() const { return flag.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> flag{false};
+};
+
+// Thrown by TaskGroup::wait() when its token was cancelled.
+class OperationCancelled : public std::runtime_error {
+public:
+    OperationCancelled() : std::runtime_error("Operation cancelled") {}
+};
+
+class TaskGroup;
+
+// Process-wide pool that every parallel routine in logic/ runs its tasks on,
+// so overlapping operations share the cores instead of each starting
+// threads. Each worker has its own deque: it pushes and pops at the back,
+// and idle workers steal from the front of the others'. Threads outside the
+// pool submit through a shared queue.
+class TaskScheduler {
+public:
+    // One worker per core but one: the thread waiting on a group runs tasks
+    // too, which makes up the last core.
+    static TaskScheduler& instance();
+
+    explicit TaskScheduler(unsigned workerCount);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    unsigned workerCount() const { return static_cast<unsigned>(workers.size()); }
+    // Threads that run tasks at once, counting one waiting caller.
+    unsigned concurrency() const { return workerCount() + 1; }
+
+private:
+    friend class TaskGroup;
+
+    struct Task {
+        std::function<void()> body;
+        TaskGroup* group = nullptr;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    static bool takeFrom(std::deque<Task>& tasks, const TaskGroup* group, bool fromBack, Task& task);
+    void submit(Task task);
+    // Takes a queued task, only one of `group` when it is given.
+    bool takeTask(Task& task, const TaskGroup* group);
+    void execute(Task& task);
+    void workerLoop(std::size_t index);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex injectedMutex;
+    std::deque<Task> injected;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<std::size_t> queued{0};
+    std::atomic<std::size_t> nextVictim{0};
+    std::atomic<bool> stopping{false};
+};
+
+// Fork-join scope: run() queues tasks and wait() returns once all of them
+// finished, running this group's queued tasks on the calling thread in the
+// meantime, so nested groups never leave a thread idle or deadlock.
+//
+// The first exception a task throws cancels the rest and is rethrown by
+// wait(). A group started from inside a task shares that task's token, so
+// cancelling an operation also stops the groups it fans out into.
+class TaskGroup {
+public:
+    explicit TaskGroup(std::shared_ptr<CancellationToken> token = nullptr,
+                       TaskScheduler& scheduler = TaskScheduler::instance());
+    // Waits for outstanding tasks; their exceptions are dropped.
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void run(std::function<void()> task);
+    // Throws OperationCancelled if the token was cancelled.
+    void wait();
+    // Runs one queued task of this group here; false if none is queued.
+    bool runPending();
+    // Runs this group's tasks here until ready() returns true (it is not
+    // called again after that) or the group is cancelled; returns which.
+    bool waitUntil(const std::function<bool()>& ready);
+    bool cancelled() const { return failed.load(std::memory_order_relaxed) || (token && token->cancelled()); }
+    const std::shared_ptr<CancellationToken>& cancellationToken() const { return token; }
+
+private:
+    friend class TaskScheduler;
+
+    void fail(std::exception_ptr exception);
+
+    TaskScheduler& scheduler;
+    std::shared_ptr<CancellationToken> token;
+    std::atomic<std::size_t> pending{0};
+    std::atomic<bool> failed{false};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+};
+
+// Calls body(begin, end) over [0, count) in ranges of at least `grain`
+// items, as tasks of one group, and waits for them.
+void parallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)>& body);
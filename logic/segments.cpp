@@ -0,0 +1,112 @@
+#include "segments.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include "bankformat.h"
+
+static const char* kManifestName = "manifest.txt";
+static const char* kManifestMagic = "MADEXAM-SEGMENTS 1";
+
+static std::string pathIn(const std::string& directory, const std::string& fileName) {
+    return (std::filesystem::path(directory) / fileName).string();
+}
+
+bool SegmentManifest::exists(const std::string& directory) {
+    return std::filesystem::exists(pathIn(directory, kManifestName));
+}
+
+SegmentManifest SegmentManifest::read(const std::string& directory) {
+    std::ifstream in(pathIn(directory, kManifestName));
+    if (!in) {
+        throw std::runtime_error("Could not open segment manifest in: " + directory);
+    }
+    SegmentManifest manifest;
+    std::string line;
+    if (!std::getline(in, line) || line.rfind(kManifestMagic, 0) != 0) {
+        throw std::runtime_error("Not a segment manifest: " + pathIn(directory, kManifestName));
+    }
+    std::istringstream header(line.substr(std::char_traits<char>::length(kManifestMagic)));
+    std::string entry;
+    while (header >> entry) {
+        if (entry.rfind("slots=", 0) == 0) {
+            manifest.slotCount = std::stoull(entry.substr(6));
+        } else if (entry.rfind("next=", 0) == 0) {
+            manifest.nextSegment = static_cast<std::uint32_t>(std::stoul(entry.substr(5)));
+        }
+    }
+    // Each segment takes two lines: "file count bytes checksum", then the topic.
+    while (std::getline(in, line)) {
+        SegmentInfo info;
+        std::istringstream fields(line);
+        if (!(fields >> info.fileName >> info.questionCount >> info.bytes >> std::hex >> info.checksum)) {
+            throw std::runtime_error("Malformed segment manifest line: " + line);
+        }
+        info.topicName = readField(in, 2);
+        manifest.segments.push_back(info);
+    }
+    std::size_t questionTotal = 0;
+    for (const auto& info : manifest.segments) {
+        questionTotal += info.questionCount;
+    }
+    // Every question holds a slot, and slot 0 is never used.
+    if (manifest.slotCount != 0 && manifest.slotCount <= questionTotal) {
+        throw std::runtime_error("Segment manifest has fewer slots than questions: " + pathIn(directory, kManifestName));
+    }
+    manifest.slotCount = std::min(manifest.slotCount, plausibleSlotCount(questionTotal));
+    return manifest;
+}
+
+void SegmentManifest::write(const std::string& directory) const {
+    std::ostringstream out;
+    out << kManifestMagic << " slots=" << slotCount << " next=" << nextSegment << "\n";
+    for (const auto& info : segments) {
+        out << info.fileName << " " << info.questionCount << " " << info.bytes << " "
+            << std::hex << std::setw(16) << std::setfill('0') << info.checksum << std::dec << "\n"
+            << escapeField(info.topicName) << "\n";
+    }
+    writeFileAtomically(pathIn(directory, kManifestName), out.str());
+}
+
+std::string SegmentManifest::allocateFileName() {
+    return "segment-" + std::to_string(nextSegment++) + ".bank";
+}
+
+std::string SegmentManifest::readSegment(const std::string& directory, const SegmentInfo& info) {
+    std::string path = pathIn(directory, info.fileName);
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Missing bank segment: " + path);
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() != info.bytes || checksum(data) != info.checksum) {
+        throw std::runtime_error("Checksum mismatch in bank segment: " + path);
+    }
+    return data;
+}
+
+void SegmentManifest::writeFileAtomically(const std::string& path, const std::string& data) {
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out || !out.write(data.data(), static_cast<std::streamsize>(data.size())) || !out.flush()) {
+            throw std::runtime_error("Could not write file: " + temporary);
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        throw std::runtime_error("Could not replace file: " + path + " (" + error.message() + ")");
+    }
+}
+
+std::uint64_t SegmentManifest::checksum(const std::string& data) {
+    std::uint64_t hash = 1469598103934665603ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SegmentInfo {
+    std::string topicName;
+    std::string fileName;
+    std::uint32_t questionCount = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t checksum = 0;
+};
+
+// Index of a segmented bank directory. Each topic's questions live in their
+// own bank file; manifest.txt lists the files with their sizes and FNV-1a
+// checksums. Rewritten segments always get a fresh file name and the manifest
+// is replaced last, so an interrupted save leaves the previous bank intact.
+class SegmentManifest {
+public:
+    std::vector<SegmentInfo> segments;
+    std::size_t slotCount = 0;
+    std::uint32_t nextSegment = 1;
+
+    static bool exists(const std::string& directory);
+    // Throws std::runtime_error if the manifest is missing or malformed.
+    static SegmentManifest read(const std::string& directory);
+    void write(const std::string& directory) const;
+
+    std::string allocateFileName();
+    // Reads a segment file and verifies it against its manifest entry.
+    static std::string readSegment(const std::string& directory, const SegmentInfo& info);
+    static void writeFileAtomically(const std::string& path, const std::string& data);
+    static std::uint64_t checksum(const std::string& data);
+};
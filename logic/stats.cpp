@@ -0,0 +1,149 @@
+#include "stats.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include "bits.h"
+
+int StageCounters::bucketFor(std::uint64_t nanos) {
+    if (nanos < kSubBuckets) {
+        return static_cast<int>(nanos);
+    }
+    int log2 = highestBit(nanos);
+    int sub = static_cast<int>((nanos >> (log2 - 2)) & (kSubBuckets - 1));
+    return log2 * kSubBuckets + sub;
+}
+
+std::uint64_t StageCounters::bucketUpperBound(int bucket) {
+    int log2 = bucket / kSubBuckets;
+    int sub = bucket % kSubBuckets;
+    if (log2 < 2) {
+        return static_cast<std::uint64_t>(bucket) + 1;
+    }
+    std::uint64_t base = 1ULL << log2;
+    std::uint64_t step = base / kSubBuckets;
+    return base + step * (sub + 1);
+}
+
+void StageCounters::record(std::uint64_t nanos, std::uint64_t byteCount) {
+    calls.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(byteCount, std::memory_order_relaxed);
+    totalNanos.fetch_add(nanos, std::memory_order_relaxed);
+    histogram[bucketFor(nanos)].fetch_add(1, std::memory_order_relaxed);
+
+    std::uint64_t prev = maxNanos.load(std::memory_order_relaxed);
+    while (nanos > prev && !maxNanos.compare_exchange_weak(prev, nanos, std::memory_order_relaxed)) {
+    }
+}
+
+std::uint64_t StageCounters::percentile(double p) const {
+    std::uint64_t total = 0;
+    for (const auto& bucket : histogram) {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+    std::uint64_t rank = static_cast<std::uint64_t>(p * static_cast<double>(total - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        seen += histogram[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(bucketUpperBound(i), maxNanos.load(std::memory_order_relaxed));
+        }
+    }
+    return maxNanos.load(std::memory_order_relaxed);
+}
+
+void StageCounters::reset() {
+    calls.store(0, std::memory_order_relaxed);
+    bytes.store(0, std::memory_order_relaxed);
+    totalNanos.store(0, std::memory_order_relaxed);
+    maxNanos.store(0, std::memory_order_relaxed);
+    for (auto& bucket : histogram) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+PerfStats& PerfStats::instance() {
+    static PerfStats stats;
+    return stats;
+}
+
+const char* PerfStats::stageName(PerfStage stage) {
+    switch (stage) {
+        case PerfStage::ParseBank: return "parse_bank";
+        case PerfStage::TopicRegen: return "topic_regen";
+        case PerfStage::Sampling: return "sampling";
+        case PerfStage::Render: return "render";
+        case PerfStage::WriteDocument: return "write_document";
+        case PerfStage::Compress: return "compress";
+        case PerfStage::SaveBank: return "save_bank";
+        case PerfStage::FirstFrame: return "first_frame";
+        case PerfStage::Count: break;
+    }
+    return "unknown";
+}
+
+static std::string formatNanos(std::uint64_t nanos) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    if (nanos < 1000) {
+        out << nanos << "ns";
+    } else if (nanos < 1000000) {
+        out << nanos / 1e3 << "us";
+    } else if (nanos < 1000000000) {
+        out << nanos / 1e6 << "ms";
+    } else {
+        out << nanos / 1e9 << "s";
+    }
+    return out.str();
+}
+
+void PerfStats::dump(std::ostream& out) const {
+    out << std::left << std::setw(16) << "stage"
+        << std::right << std::setw(10) << "calls"
+        << std::setw(14) << "bytes"
+        << std::setw(11) << "total"
+        << std::setw(11) << "mean"
+        << std::setw(11) << "p50"
+        << std::setw(11) << "p99"
+        << std::setw(11) << "max" << "\n";
+    for (int i = 0; i < static_cast<int>(PerfStage::Count); ++i) {
+        const StageCounters& counters = stages[i];
+        std::uint64_t calls = counters.calls.load(std::memory_order_relaxed);
+        std::uint64_t total = counters.totalNanos.load(std::memory_order_relaxed);
+        out << std::left << std::setw(16) << stageName(static_cast<PerfStage>(i))
+            << std::right << std::setw(10) << calls
+            << std::setw(14) << counters.bytes.load(std::memory_order_relaxed)
+            << std::setw(11) << formatNanos(total)
+            << std::setw(11) << formatNanos(calls ? total / calls : 0)
+            << std::setw(11) << formatNanos(counters.percentile(0.50))
+            << std::setw(11) << formatNanos(counters.percentile(0.99))
+            << std::setw(11) << formatNanos(counters.maxNanos.load(std::memory_order_relaxed)) << "\n";
+    }
+}
+
+std::chrono::steady_clock::time_point PerfStats::processStartTime() {
+    static const auto start = std::chrono::steady_clock::now();
+    return start;
+}
+
+double PerfStats::recordSince(PerfStage stage, std::chrono::steady_clock::time_point since) {
+    auto elapsed = std::chrono::steady_clock::now() - since;
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    this->stage(stage).record(static_cast<std::uint64_t>(nanos), 0);
+    return nanos / 1e6;
+}
+
+void PerfStats::reset() {
+    for (auto& counters : stages) {
+        counters.reset();
+    }
+}
+
+ScopedStageTimer::~ScopedStageTimer() {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    PerfStats::instance().stage(stage).record(static_cast<std::uint64_t>(nanos), bytes);
+}
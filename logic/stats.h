@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Hot stages that are instrumented. Keep stageName() in sync.
+enum class PerfStage {
+    ParseBank,
+    TopicRegen,
+    Sampling,
+    Render,
+    WriteDocument,
+    Compress,
+    SaveBank,
+    FirstFrame,
+    Count
+};
+
+// Lock-free counters for one stage. Latencies go into a log-linear histogram
+// (4 sub-buckets per power of two), so percentiles are accurate to ~19%.
+class StageCounters {
+public:
+    static constexpr int kSubBuckets = 4;
+    static constexpr int kBuckets = 64 * kSubBuckets;
+
+    std::atomic<std::uint64_t> calls{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> totalNanos{0};
+    std::atomic<std::uint64_t> maxNanos{0};
+    std::atomic<std::uint64_t> histogram[kBuckets] = {};
+
+    void record(std::uint64_t nanos, std::uint64_t byteCount);
+    std::uint64_t percentile(double p) const;
+    void reset();
+
+    static int bucketFor(std::uint64_t nanos);
+    static std::uint64_t bucketUpperBound(int bucket);
+};
+
+class PerfStats {
+public:
+    static PerfStats& instance();
+    static const char* stageName(PerfStage stage);
+
+    StageCounters& stage(PerfStage stage) { return stages[static_cast<int>(stage)]; }
+    void dump(std::ostream& out) const;
+    void reset();
+
+    // The first call pins the reference point; main() calls it on entry.
+    static std::chrono::steady_clock::time_point processStartTime();
+    // Records the time elapsed since `since` as one sample; returns it in ms.
+    double recordSince(PerfStage stage, std::chrono::steady_clock::time_point since);
+
+private:
+    PerfStats() = default;
+    StageCounters stages[static_cast<int>(PerfStage::Count)];
+};
+
+// Times the enclosing scope with a monotonic clock and records it on exit.
+class ScopedStageTimer {
+public:
+    explicit ScopedStageTimer(PerfStage stage, std::uint64_t bytes = 0)
+        : stage(stage), bytes(bytes), start(std::chrono::steady_clock::now()) {}
+    ~ScopedStageTimer();
+
+    ScopedStageTimer(const ScopedStageTimer&) = delete;
+    ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+    void addBytes(std::uint64_t count) { bytes += count; }
+
+private:
+    PerfStage stage;
+    std::uint64_t bytes;
+    std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,105 @@
+#include "strings.h"
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+StringPool& StringPool::global() {
+    // The pool reports to MemoryStats until it is destroyed, so the stats
+    // must be constructed first.
+    MemoryStats::instance();
+    static StringPool pool;
+    return pool;
+}
+
+StringPool::~StringPool() {
+    for (auto& chunk : chunks) {
+        delete[] chunk.load(std::memory_order_relaxed);
+    }
+}
+
+std::string_view StringPool::store(std::string_view text) {
+    if (text.empty()) {
+        return std::string_view();
+    }
+    char* destination;
+    if (text.size() > kBlockSize / 4) {
+        largeTexts.emplace_back(new char[text.size()]);
+        destination = largeTexts.back().get();
+        largeBytes += text.size();
+    } else {
+        if (blockUsed + text.size() > kBlockSize) {
+            blocks.emplace_back(new char[kBlockSize]);
+            blockUsed = 0;
+        }
+        destination = blocks.back().get() + blockUsed;
+        blockUsed += text.size();
+    }
+    std::memcpy(destination, text.data(), text.size());
+    return std::string_view(destination, text.size());
+}
+
+void StringPool::growTable() {
+    table.assign(table.empty() ? 1024 : table.size() * 2, kEmptySlot);
+    std::size_t mask = table.size() - 1;
+    for (std::size_t id = 0; id < hashes.size(); ++id) {
+        std::size_t slot = hashes[id] & mask;
+        while (table[slot] != kEmptySlot) {
+            slot = (slot + 1) & mask;
+        }
+        table[slot] = static_cast<StringId>(id);
+    }
+}
+
+StringId StringPool::intern(std::string_view text) {
+    std::uint64_t hash = std::hash<std::string_view>()(text);
+    std::lock_guard<std::mutex> lock(internMutex);
+    std::size_t used = count.load(std::memory_order_relaxed);
+    if ((used + 1) * 2 > table.size()) {
+        growTable();
+    }
+    std::size_t mask = table.size() - 1;
+    std::size_t slot = hash & mask;
+    for (; table[slot] != kEmptySlot; slot = (slot + 1) & mask) {
+        StringId id = table[slot];
+        if (hashes[id] == hash && get(id) == text) {
+            return id;
+        }
+    }
+
+    std::size_t chunk = used >> kChunkBits;
+    if (chunk >= kMaxChunks) {
+        throw std::length_error("String pool is full");
+    }
+    std::string_view* entries = chunks[chunk].load(std::memory_order_relaxed);
+    if (!entries) {
+        entries = new std::string_view[kChunkSize];
+        chunks[chunk].store(entries, std::memory_order_release);
+    }
+    entries[used & (kChunkSize - 1)] = store(text);
+    hashes.push_back(hash);
+    table[slot] = static_cast<StringId>(used);
+    count.store(used + 1, std::memory_order_release);
+    counted.set(footprint());
+    return static_cast<StringId>(used);
+}
+
+std::size_t StringPool::memoryBytes() const {
+    std::lock_guard<std::mutex> lock(internMutex);
+    return footprint();
+}
+
+std::size_t StringPool::footprint() const {
+    std::size_t used = count.load(std::memory_order_relaxed);
+    std::size_t chunkCount = (used + kChunkSize - 1) >> kChunkBits;
+    return chunkCount * kChunkSize * sizeof(std::string_view)
+        + blocks.size() * kBlockSize + largeBytes
+        + hashes.capacity() * sizeof(std::uint64_t)
+        + table.capacity() * sizeof(StringId);
+}
+
+OptionList::OptionList(const std::vector<std::string>& texts) {
+    stringIds.reserve(texts.size());
+    for (const auto& text : texts) {
+        push_back(text);
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "memory.h"
+
+using StringId = std::uint32_t;
+
+// Process-wide interned strings. Text lives in append-only arena blocks and
+// the id -> view table grows in fixed-size chunks that never move, so get()
+// takes no lock; intern() is serialised by a mutex.
+class StringPool {
+public:
+    static StringPool& global();
+
+    StringId intern(std::string_view text);
+    std::string_view get(StringId id) const {
+        return chunks[id >> kChunkBits].load(std::memory_order_acquire)[id & (kChunkSize - 1)];
+    }
+    std::size_t size() const { return count.load(std::memory_order_acquire); }
+    std::size_t memoryBytes() const;
+
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+private:
+    static constexpr unsigned kChunkBits = 12;
+    static constexpr std::size_t kChunkSize = std::size_t(1) << kChunkBits;
+    static constexpr std::size_t kMaxChunks = std::size_t(1) << 16;
+    static constexpr std::size_t kBlockSize = 64 * 1024;
+    static constexpr StringId kEmptySlot = ~StringId(0);
+
+    StringPool() = default;
+    ~StringPool();
+
+    std::string_view store(std::string_view text);
+    void growTable();
+    std::size_t footprint() const;
+
+    std::atomic<std::string_view*> chunks[kMaxChunks] = {};
+    std::atomic<std::size_t> count{0};
+
+    // Everything below is guarded by internMutex.
+    mutable std::mutex internMutex;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::size_t blockUsed = kBlockSize;
+    std::vector<std::unique_ptr<char[]>> largeTexts;
+    std::size_t largeBytes = 0;
+    std::vector<std::uint64_t> hashes;
+    // Open-addressing table of ids, probed linearly; kept at most half full.
+    std::vector<StringId> table;
+    CountedBytes<MemorySubsystem::Strings> counted;
+};
+
+// Option texts of one question, held as pool ids. Reads behave like a
+// container of std::string_view; equality compares ids only.
+class OptionList {
+public:
+    using IdVector = CountedVector<StringId, MemorySubsystem::Options>;
+
+    class const_iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = std::string_view;
+
+        explicit const_iterator(IdVector::const_iterator it) : it(it) {}
+        std::string_view operator*() const { return StringPool::global().get(*it); }
+        const_iterator& operator++() { ++it; return *this; }
+        const_iterator operator++(int) { const_iterator previous = *this; ++it; return previous; }
+        difference_type operator-(const const_iterator& other) const { return it - other.it; }
+        bool operator==(const const_iterator& other) const { return it == other.it; }
+        bool operator!=(const const_iterator& other) const { return it != other.it; }
+
+    private:
+        IdVector::const_iterator it;
+    };
+
+    OptionList() = default;
+    OptionList(const std::vector<std::string>& texts);
+
+    std::size_t size() const { return stringIds.size(); }
+    bool empty() const { return stringIds.empty(); }
+    std::string_view operator[](std::size_t index) const { return StringPool::global().get(stringIds[index]); }
+    std::string_view at(std::size_t index) const { return StringPool::global().get(stringIds.at(index)); }
+    StringId idAt(std::size_t index) const { return stringIds[index]; }
+    const IdVector& ids() const { return stringIds; }
+    const_iterator begin() const { return const_iterator(stringIds.begin()); }
+    const_iterator end() const { return const_iterator(stringIds.end()); }
+
+    void push_back(std::string_view text) { stringIds.push_back(StringPool::global().intern(text)); }
+    void pushId(StringId id) { stringIds.push_back(id); }
+    void reserve(std::size_t capacity) { stringIds.reserve(capacity); }
+
+    bool operator==(const OptionList& other) const { return stringIds == other.stringIds; }
+    bool operator!=(const OptionList& other) const { return stringIds != other.stringIds; }
+
+private:
+    IdVector stringIds;
+};
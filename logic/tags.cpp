@@ -0,0 +1,169 @@
+#include "tags.h"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+#include "quiz.h"
+
+static const char* kHasOptionsTag = "has_options";
+
+std::uint32_t TagIndex::positionOf(const Question& question) {
+    // The low half of an id is its slot, which is unique among live questions.
+    return static_cast<std::uint32_t>(question.id);
+}
+
+std::vector<std::string> TagIndex::tagsOf(const Question& question) const {
+    std::vector<std::string> tags = question.tags;
+    if (question.options && !question.options->empty()) {
+        tags.push_back(kHasOptionsTag);
+    }
+    return tags;
+}
+
+// The counted total follows every change, so it always equals memoryBytes().
+void TagIndex::add(const Question& question) {
+    std::uint32_t position = positionOf(question);
+    std::size_t bytes = counted.get();
+    auto addTo = [&bytes, position](RoaringBitmap& bitmap) {
+        bytes -= bitmap.memoryBytes();
+        bitmap.add(position);
+        bytes += bitmap.memoryBytes();
+    };
+    auto addToKey = [&bytes, &addTo](std::unordered_map<std::string, RoaringBitmap>& bitmaps, const std::string& key) {
+        auto entry = bitmaps.try_emplace(key);
+        if (entry.second) {
+            bytes += entry.first->first.capacity();
+        }
+        addTo(entry.first->second);
+    };
+    addTo(all);
+    for (const auto& tag : tagsOf(question)) {
+        addToKey(byTag, tag);
+    }
+    if (question.topic) {
+        addToKey(byTopic, question.topic->name);
+    }
+    counted.set(bytes);
+}
+
+void TagIndex::remove(const Question& question) {
+    std::uint32_t position = positionOf(question);
+    std::size_t bytes = counted.get();
+    auto removeFromKey = [&bytes, position](std::unordered_map<std::string, RoaringBitmap>& bitmaps, const std::string& key) {
+        auto it = bitmaps.find(key);
+        if (it == bitmaps.end()) {
+            return;
+        }
+        bytes -= it->second.memoryBytes();
+        it->second.remove(position);
+        if (it->second.empty()) {
+            bytes -= it->first.capacity();
+            bitmaps.erase(it);
+        } else {
+            bytes += it->second.memoryBytes();
+        }
+    };
+    bytes -= all.memoryBytes();
+    all.remove(position);
+    bytes += all.memoryBytes();
+    for (const auto& tag : tagsOf(question)) {
+        removeFromKey(byTag, tag);
+    }
+    if (question.topic) {
+        removeFromKey(byTopic, question.topic->name);
+    }
+    counted.set(bytes);
+}
+
+RoaringBitmap TagIndex::evaluate(const std::string& filter, const RoaringBitmap* within) const {
+    std::istringstream clauses(filter);
+    std::string clause;
+    RoaringBitmap result = within ? *within & all : all;
+    while (clauses >> clause) {
+        RoaringBitmap matches;
+        std::size_t begin = 0;
+        while (begin <= clause.size()) {
+            std::size_t end = clause.find('|', begin);
+            if (end == std::string::npos) {
+                end = clause.size();
+            }
+            std::string term = clause.substr(begin, end - begin);
+            bool negated = !term.empty() && term[0] == '!';
+            if (negated) {
+                term.erase(0, 1);
+            }
+            if (term.empty()) {
+                throw std::invalid_argument("Invalid tag filter: " + filter);
+            }
+            auto it = byTag.find(term);
+            if (negated) {
+                matches = matches | (it != byTag.end() ? all.andNot(it->second) : all);
+            } else if (it != byTag.end()) {
+                matches = matches | it->second;
+            }
+            begin = end + 1;
+        }
+        result = result & matches;
+    }
+    return result;
+}
+
+const RoaringBitmap* TagIndex::topicMembers(const std::string& topicName) const {
+    auto it = byTopic.find(topicName);
+    return it != byTopic.end() ? &it->second : nullptr;
+}
+
+std::vector<std::string> TagIndex::tagNames() const {
+    std::vector<std::string> names;
+    names.reserve(byTag.size());
+    for (const auto& entry : byTag) {
+        names.push_back(entry.first);
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+std::uint64_t TagIndex::questionCount(const std::string& tag) const {
+    auto it = byTag.find(tag);
+    return it != byTag.end() ? it->second.cardinality() : 0;
+}
+
+std::size_t TagIndex::memoryBytes() const {
+    std::size_t bytes = all.memoryBytes();
+    for (const auto& entry : byTag) {
+        bytes += entry.first.capacity() + entry.second.memoryBytes();
+    }
+    for (const auto& entry : byTopic) {
+        bytes += entry.first.capacity() + entry.second.memoryBytes();
+    }
+    return bytes;
+}
+
+std::vector<std::string> TagIndex::parseTagList(const std::string& text) {
+    std::vector<std::string> tags;
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        std::string tag;
+        bool pendingSpace = false;
+        for (char c : item) {
+            // '|' and a leading '!' would be read as filter syntax.
+            if (std::isspace(static_cast<unsigned char>(c)) || c == '|') {
+                pendingSpace = !tag.empty();
+                continue;
+            }
+            if (c == '!' && tag.empty()) {
+                continue;
+            }
+            if (pendingSpace && c != ':' && tag.back() != ':') {
+                tag += '_';
+            }
+            pendingSpace = false;
+            tag += c;
+        }
+        if (!tag.empty() && std::find(tags.begin(), tags.end(), tag) == tags.end()) {
+            tags.push_back(tag);
+        }
+    }
+    return tags;
+}
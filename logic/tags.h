@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "bitmap.h"
+#include "memory.h"
+
+class Question;
+
+// Bitmap index from tags and topics to question ids. Besides the free-form
+// tags it indexes the pseudo-tag "has_options".
+class TagIndex {
+public:
+    void add(const Question& question);
+    void remove(const Question& question);
+
+    // Filters are in conjunctive normal form: whitespace-separated clauses are
+    // AND'ed, '|'-separated alternatives within a clause are OR'ed and a '!'
+    // prefix negates a tag, e.g. "difficulty:hard|difficulty:medium !author:bob".
+    // Only questions in `within` (all when null) are considered. Throws
+    // std::invalid_argument on malformed filters.
+    RoaringBitmap evaluate(const std::string& filter, const RoaringBitmap* within = nullptr) const;
+    // Null when the topic has no questions.
+    const RoaringBitmap* topicMembers(const std::string& topicName) const;
+    std::vector<std::string> tagNames() const;
+    std::uint64_t questionCount(const std::string& tag) const;
+    std::size_t memoryBytes() const;
+
+    // Splits comma-separated user input into tags; whitespace inside a tag
+    // becomes '_' so that every tag can be used in a filter.
+    static std::vector<std::string> parseTagList(const std::string& text);
+
+private:
+    static std::uint32_t positionOf(const Question& question);
+    std::vector<std::string> tagsOf(const Question& question) const;
+
+    RoaringBitmap all;
+    std::unordered_map<std::string, RoaringBitmap> byTag;
+    std::unordered_map<std::string, RoaringBitmap> byTopic;
+    CountedBytes<MemorySubsystem::TopicIndex> counted;
+};
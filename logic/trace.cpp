@@ -0,0 +1,104 @@
+#include "trace.h"
+#include <fstream>
+#include <iomanip>
+
+Tracer::Tracer() : epoch(std::chrono::steady_clock::now()) {}
+
+Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::enable() {
+    active.store(true, std::memory_order_relaxed);
+}
+
+Tracer::ThreadBuffer& Tracer::localBuffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        auto created = std::make_shared<ThreadBuffer>();
+        created->events.reserve(4096);
+        std::lock_guard<std::mutex> lock(registryMutex);
+        created->tid = static_cast<std::uint32_t>(buffers.size() + 1);
+        buffers.push_back(created);
+        buffer = created.get();
+    }
+    return *buffer;
+}
+
+void Tracer::record(const char* name, const char* category, std::int64_t arg,
+                    std::chrono::steady_clock::time_point start,
+                    std::chrono::steady_clock::time_point end) {
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+    localBuffer().events.push_back(Event{
+        name,
+        category,
+        arg,
+        duration_cast<nanoseconds>(start - epoch).count(),
+        duration_cast<nanoseconds>(end - start).count()
+    });
+}
+
+void Tracer::setThreadName(const std::string& name) {
+    localBuffer().threadName = name;
+}
+
+static void writeJsonString(std::ostream& out, const std::string& str) {
+    out << '"';
+    for (char c : str) {
+        switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                        << static_cast<int>(c) << std::dec << std::setfill(' ');
+                } else {
+                    out << c;
+                }
+        }
+    }
+    out << '"';
+}
+
+bool Tracer::writeChromeJson(const std::string& filePath) const {
+    std::ofstream out(filePath, std::ios::binary);
+    if (!out) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    out << std::fixed << std::setprecision(3);
+    for (const auto& buffer : buffers) {
+        std::string threadName = buffer->threadName.empty()
+            ? "thread " + std::to_string(buffer->tid)
+            : buffer->threadName;
+        if (!first) out << ",\n";
+        first = false;
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":";
+        writeJsonString(out, threadName);
+        out << "}}";
+
+        for (const auto& event : buffer->events) {
+            out << ",\n{\"name\":";
+            writeJsonString(out, event.name);
+            out << ",\"cat\":";
+            writeJsonString(out, event.category);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"ts\":" << event.startNanos / 1000.0
+                << ",\"dur\":" << event.durationNanos / 1000.0;
+            if (event.arg >= 0) {
+                out << ",\"args\":{\"index\":" << event.arg << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timeline recorder that writes Chrome/Perfetto trace JSON. Each thread
+// appends to its own buffer; the registry lock is only taken the first time
+// a thread records an event.
+class Tracer {
+public:
+    static Tracer& instance();
+
+    void enable();
+    bool enabled() const { return active.load(std::memory_order_relaxed); }
+
+    void record(const char* name, const char* category, std::int64_t arg,
+                std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::time_point end);
+    void setThreadName(const std::string& name);
+    // Call once worker threads are idle, e.g. from an exit handler.
+    bool writeChromeJson(const std::string& filePath) const;
+
+private:
+    struct Event {
+        const char* name;
+        const char* category;
+        std::int64_t arg;
+        std::int64_t startNanos;
+        std::int64_t durationNanos;
+    };
+
+    struct ThreadBuffer {
+        std::uint32_t tid;
+        std::string threadName;
+        std::vector<Event> events;
+    };
+
+    Tracer();
+    ThreadBuffer& localBuffer();
+
+    std::atomic<bool> active{false};
+    std::chrono::steady_clock::time_point epoch;
+    mutable std::mutex registryMutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+};
+
+// Records a complete ("X") event covering the enclosing scope. Costs one
+// relaxed load when tracing is disabled.
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, const char* category = "madexam", std::int64_t arg = -1)
+        : name(name), category(category), arg(arg), active(Tracer::instance().enabled()) {
+        if (active) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    ~TraceScope() {
+        if (active) {
+            Tracer::instance().record(name, category, arg, start, std::chrono::steady_clock::now());
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    const char* category;
+    std::int64_t arg;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+};
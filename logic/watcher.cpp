@@ -0,0 +1,136 @@
+#include "watcher.h"
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+#include "quiz.h"
+#include "trace.h"
+
+// Quiet period after the last event before a burst counts as finished.
+static const int kSettleMillis = 150;
+static const int kPollMillis = 500;
+
+BankWatcher::BankWatcher(const std::string& path) : bankPath(path) {
+    if (QuestionDatabase::isSegmentedPath(path)) {
+        // Segmented saves replace the manifest last.
+        watchDirectory = path;
+        watchName = "manifest.txt";
+    } else {
+        std::filesystem::path file(path);
+        watchDirectory = file.has_parent_path() ? file.parent_path().string() : ".";
+        watchName = file.filename().string();
+    }
+}
+
+BankWatcher::~BankWatcher() {
+    stop();
+}
+
+void BankWatcher::start(ChangeCallback onChange) {
+    callback = onChange;
+    int inotifyFd = -1;
+#ifdef __linux__
+    if (pipe(wakeFds) != 0) {
+        throw std::runtime_error("Could not create the bank watcher's wake-up pipe");
+    }
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0 ||
+        inotify_add_watch(inotifyFd, watchDirectory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) < 0) {
+        if (inotifyFd >= 0) {
+            close(inotifyFd);
+        }
+        close(wakeFds[0]);
+        close(wakeFds[1]);
+        wakeFds[0] = wakeFds[1] = -1;
+        throw std::runtime_error("Could not watch directory: " + watchDirectory);
+    }
+#endif
+    worker = std::thread([this, inotifyFd]() { run(inotifyFd); });
+}
+
+void BankWatcher::stop() {
+    if (!worker.joinable()) {
+        return;
+    }
+#ifdef __linux__
+    stopping = true;
+    char wake = 0;
+    while (write(wakeFds[1], &wake, 1) < 0 && errno == EINTR) {
+    }
+    worker.join();
+    close(wakeFds[0]);
+    close(wakeFds[1]);
+    wakeFds[0] = wakeFds[1] = -1;
+#else
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    worker.join();
+#endif
+}
+
+void BankWatcher::notify() {
+    pending = true;
+    if (callback) {
+        callback();
+    }
+}
+
+void BankWatcher::run(int inotifyFd) {
+    Tracer::instance().setThreadName("bank-watcher");
+#ifdef __linux__
+    pollfd fds[2] = {{wakeFds[0], POLLIN, 0}, {inotifyFd, POLLIN, 0}};
+    bool changed = false;
+    while (!stopping) {
+        int ready = poll(fds, 2, changed ? kSettleMillis : -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (ready == 0) {
+            changed = false;
+            notify();
+            continue;
+        }
+        if (fds[0].revents) {
+            break;
+        }
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+            for (char* p = buffer; p < buffer + length;) {
+                auto* event = reinterpret_cast<inotify_event*>(p);
+                if (event->len > 0 && watchName == event->name) {
+                    changed = true;
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+    }
+    close(inotifyFd);
+#else
+    (void)inotifyFd;
+    std::filesystem::path watched = std::filesystem::path(watchDirectory) / watchName;
+    std::error_code error;
+    auto last = std::filesystem::last_write_time(watched, error);
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    while (!wakeUp.wait_for(lock, std::chrono::milliseconds(kPollMillis), [this]() { return stopping.load(); })) {
+        auto now = std::filesystem::last_write_time(watched, error);
+        if (!error && now != last) {
+            last = now;
+            lock.unlock();
+            notify();
+            lock.lock();
+        }
+    }
+#endif
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Watches a bank file or segmented bank directory for changes made by other
+// processes. On Linux this uses inotify on the containing directory, so
+// editors that save by renaming a new file into place are seen too;
+// elsewhere the modification time is polled. Bursts of events are coalesced
+// into one notification, which arrives on the watcher thread.
+class BankWatcher {
+public:
+    using ChangeCallback = std::function<void()>;
+
+    explicit BankWatcher(const std::string& path);
+    ~BankWatcher();
+
+    BankWatcher(const BankWatcher&) = delete;
+    BankWatcher& operator=(const BankWatcher&) = delete;
+
+    // Throws std::runtime_error if the path cannot be watched.
+    void start(ChangeCallback onChange = nullptr);
+    void stop();
+    // True once after each notification; lets a command loop poll instead of
+    // using a callback.
+    bool takePendingChange() { return pending.exchange(false); }
+    const std::string& path() const { return bankPath; }
+
+private:
+    void run(int inotifyFd);
+    void notify();
+
+    std::string bankPath;
+    // The directory and file name the events are filtered on.
+    std::string watchDirectory;
+    std::string watchName;
+    ChangeCallback callback;
+    std::atomic<bool> pending{false};
+    std::atomic<bool> stopping{false};
+    // Wakes the worker on stop(): a pipe it polls with inotify on Linux, a
+    // condition variable it waits on between polls elsewhere.
+    int wakeFds[2] = {-1, -1};
+    std::mutex wakeMutex;
+    std::condition_variable wakeUp;
+    std::thread worker;
+};
@@ -1,66 +1,83 @@
 #include <QApplication>
-#include <QStandardPaths>
-#include <QDir>
+#include <QTimer>
 #include <string>
-#include <fstream>
+#include <cstdlib>
+#include <iostream>
 #include "MainWindow.h"
 #include "logic/quiz.h"
-#include "cli.h"
+#include "startup.h"
+#include "logic/stats.h"
+#include "logic/loader.h"
+
+// Budget from process start to the first painted window or CLI prompt.
+static constexpr double kFirstFrameTargetMs = 200.0;
 
 int main(int argc, char *argv[]) {
-    QCoreApplication::setOrganizationName("Madiwka");
-    QCoreApplication::setApplicationName("MadExam");
-    bool useGui = true;
-    bool verbose = false;
-    for (int i = 1; i < argc; ++i) {
-        std::string arg = argv[i];
-        if (arg == "nogui" || arg == "--nogui" || arg == "-nogui") {
-            useGui = false;
-            break;
-        } else if (arg == "verbose" || arg == "--verbose" || arg == "-verbose") {
-            verbose = true;
-        }
+    PerfStats::processStartTime();
+    AppOptions options = parseAppOptions(argc, argv);
+    installExitReporters(options);
+
+    // Decide the mode before touching Qt so --nogui skips its initialization.
+    if (!options.socketPath.empty()) {
+        return runDaemon(options);
+    }
+    if (!options.useGui) {
+        return runHeadless(options);
     }
 
-    QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
-    QDir().mkpath(dataDir); 
-    QString dbFilePath = dataDir + "/db.txt";
-    std::string dbPath = dbFilePath.toStdString();
+    QCoreApplication::setOrganizationName("Madiwka");
+    QCoreApplication::setApplicationName("MadExam");
+    bool verbose = options.verbose;
+    std::string dbPath = options.bankPath;
 
     std::shared_ptr<QuestionDatabase> db = std::make_shared<QuestionDatabase>();
+    db->verbose = verbose;
+
+    // The bank is parsed on a worker thread while the window comes up.
+    std::cout << "Reading DB from: " << dbPath << std::endl;
+    auto loader = std::make_shared<BankLoader>(dbPath, verbose);
+
+    QApplication app(argc, argv);
+    MainWindow w(db);
+    w.setArchive(openArchive(options));
+    w.show();
+    QTimer::singleShot(0, [verbose]() {
+        double ms = PerfStats::instance().recordSince(PerfStage::FirstFrame, PerfStats::processStartTime());
+        if (verbose || ms > kFirstFrameTargetMs) {
+            std::cerr << "Time to first frame: " << ms << " ms (target " << kFirstFrameTargetMs << " ms)" << std::endl;
+        }
+    });
 
+    w.beginLoading(*loader);
+    BankLoader* bankLoader = loader.get();
+    loader->start(
+        [&w](const std::string& topicName) {
+            QString name = QString::fromStdString(topicName);
+            QMetaObject::invokeMethod(&w, [&w, name]() { w.addLoadingTopic(name); }, Qt::QueuedConnection);
+        },
+        [&w, bankLoader]() {
+            QMetaObject::invokeMethod(&w, [&w, bankLoader]() { w.finishLoading(*bankLoader); }, Qt::QueuedConnection);
+        });
     try {
-        db->readQuestionsFromFile(dbPath);
-        std::cout << "Reading DB from: "<<dbPath;
+        w.watchBank(std::make_shared<BankWatcher>(dbPath));
     } catch (const std::exception& e) {
-        std::cerr << "Failed to read question DB: " << e.what() << std::endl;
+        if (verbose)
+            std::cerr << "Not watching the question DB for changes: " << e.what() << std::endl;
     }
+    int result = app.exec();
 
-    if (useGui) {
-        QApplication app(argc, argv);
-        MainWindow w(db);
-        w.show();
-        int result = app.exec();
-
-        try {
-            db->writeQuestionsToFile(dbPath);
-        } catch (const std::exception& e) {
-            if (verbose)
-                std::cerr << "Failed to save question DB: " << e.what() << std::endl;
-        }
-
+    // Closing the window before the load finished must not overwrite the
+    // bank with a partial one.
+    if (!w.finishLoading(*loader)) {
         return result;
-    } else {
-        CLI cli(db);
-        cli.run();
-
-        try {
-            db->writeQuestionsToFile(dbPath);
-        } catch (const std::exception& e) {
-            if (verbose)
-                std::cerr << "Failed to save question DB: " << e.what() << std::endl;
-        }
+    }
 
-        return 0;
+    try {
+        db->saveBank(dbPath);
+    } catch (const std::exception& e) {
+        if (verbose)
+            std::cerr << "Failed to save question DB: " << e.what() << std::endl;
     }
-}
\ No newline at end of file
+
+    return result;
+}
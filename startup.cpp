@@ -0,0 +1,159 @@
+#include "startup.h"
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include "cli.h"
+#include "logic/archive.h"
+#ifdef MADEXAM_HAVE_DAEMON
+#include "logic/daemon.h"
+#endif
+#include "logic/loader.h"
+#include "logic/memory.h"
+#include "logic/paths.h"
+#include "logic/stats.h"
+#include "logic/trace.h"
+#include "logic/watcher.h"
+
+AppOptions parseAppOptions(int argc, char* argv[]) {
+    AppOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "nogui" || arg == "--nogui" || arg == "-nogui") {
+            options.useGui = false;
+        } else if (arg == "verbose" || arg == "--verbose" || arg == "-verbose") {
+            options.verbose = true;
+        } else if (arg == "stats" || arg == "--stats" || arg == "-stats") {
+            options.stats = true;
+        } else if ((arg == "--trace" || arg == "-trace") && i + 1 < argc) {
+            options.tracePath = argv[++i];
+        } else if ((arg == "--db" || arg == "-db") && i + 1 < argc) {
+            options.bankPath = argv[++i];
+        } else if ((arg == "--archive" || arg == "-archive") && i + 1 < argc) {
+            options.archivePath = argv[++i];
+        } else if ((arg == "--serve" || arg == "-serve") && i + 1 < argc) {
+            options.socketPath = argv[++i];
+        }
+    }
+    if (options.bankPath.empty()) {
+        options.bankPath = defaultBankPath();
+    }
+    if (options.archivePath.empty()) {
+        options.archivePath = defaultArchivePath();
+    }
+    return options;
+}
+
+void installExitReporters(const AppOptions& options) {
+    static std::string tracePath;
+    if (options.stats) {
+        // Construct the singletons before registering so they outlive the handler.
+        PerfStats::instance();
+        MemoryStats::instance();
+        std::atexit([] {
+            PerfStats::instance().dump(std::cerr);
+            MemoryStats::instance().dump(std::cerr);
+        });
+    }
+    if (!options.tracePath.empty()) {
+        tracePath = options.tracePath;
+        Tracer::instance().enable();
+        Tracer::instance().setThreadName("main");
+        std::atexit([] {
+            if (!Tracer::instance().writeChromeJson(tracePath)) {
+                std::cerr << "Failed to write trace: " << tracePath << std::endl;
+            }
+        });
+    }
+}
+
+std::shared_ptr<VariantArchive> openArchive(const AppOptions& options) {
+    try {
+        return std::make_shared<VariantArchive>(options.archivePath);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to open variant archive: " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+int runHeadless(const AppOptions& options) {
+    std::shared_ptr<QuestionDatabase> db = std::make_shared<QuestionDatabase>();
+    db->verbose = options.verbose;
+
+    std::cout << "Reading DB from: " << options.bankPath << std::endl;
+    auto loader = std::make_shared<BankLoader>(options.bankPath, options.verbose);
+    loader->start();
+
+    CLI cli(db);
+    cli.setLoader(loader);
+    cli.setArchive(openArchive(options));
+    try {
+        auto watcher = std::make_shared<BankWatcher>(options.bankPath);
+        watcher->start();
+        cli.setWatcher(watcher);
+    } catch (const std::exception& e) {
+        if (options.verbose)
+            std::cerr << "Not watching the question DB for changes: " << e.what() << std::endl;
+    }
+    cli.run();
+
+    // An unreadable bank must not be overwritten with an empty one.
+    if (cli.bankLoadFailed()) {
+        return 1;
+    }
+    try {
+        db->saveBank(options.bankPath);
+    } catch (const std::exception& e) {
+        if (options.verbose)
+            std::cerr << "Failed to save question DB: " << e.what() << std::endl;
+    }
+    return 0;
+}
+
+#ifdef MADEXAM_HAVE_DAEMON
+static GenerationServer* runningServer = nullptr;
+
+int runDaemon(const AppOptions& options) {
+    auto db = std::make_shared<QuestionDatabase>();
+    db->verbose = options.verbose;
+    std::cout << "Reading DB from: " << options.bankPath << std::endl;
+    try {
+        db->openBank(options.bankPath);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to read question DB: " << e.what() << std::endl;
+        return 1;
+    }
+
+    GenerationServer server(db, options.bankPath);
+    try {
+        auto watcher = std::make_shared<BankWatcher>(options.bankPath);
+        watcher->start();
+        server.setWatcher(watcher);
+    } catch (const std::exception& e) {
+        if (options.verbose)
+            std::cerr << "Not watching the question DB for changes: " << e.what() << std::endl;
+    }
+    runningServer = &server;
+    auto onSignal = [](int) { runningServer->stop(); };
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    std::cout << "Serving " << db->getQuestionCount() << " questions on " << options.socketPath << std::endl;
+    int status = 0;
+    try {
+        server.run(options.socketPath);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        status = 1;
+    }
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    runningServer = nullptr;
+    return status;
+}
+#else
+int runDaemon(const AppOptions&) {
+    std::cerr << "--serve needs Unix sockets, which this platform does not have" << std::endl;
+    return 1;
+}
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+#include <memory>
+#include <string>
+
+class VariantArchive;
+
+// Command-line options shared by the GUI and headless executables.
+struct AppOptions {
+    bool useGui = true;
+    bool verbose = false;
+    bool stats = false;
+    std::string tracePath;
+    std::string bankPath;
+    std::string archivePath;
+    // Set by --serve: run the generation daemon on this Unix socket.
+    std::string socketPath;
+};
+
+AppOptions parseAppOptions(int argc, char* argv[]);
+// Registers the --stats and --trace reports to run at process exit.
+void installExitReporters(const AppOptions& options);
+// Opens the variant archive; returns null (after a warning) if it is unusable.
+std::shared_ptr<VariantArchive> openArchive(const AppOptions& options);
+// Loads the bank in the background and runs the interactive CLI on stdin.
+int runHeadless(const AppOptions& options);
+// Serves variant requests on options.socketPath until SIGINT or SIGTERM;
+// fails at once where the daemon is not built (no Unix sockets).
+int runDaemon(const AppOptions& options);
@@ -0,0 +1,276 @@
+// Deterministic synthetic question-bank generator for scale testing.
+//
+//   bankgen --out bank.txt --seed 42 --questions 20000 --topics 40
+//           --zipf 1.1 --options 0:10,3:20,4:60,5:10 --text-words 6:24
+//           --option-words 1:6 --cyrillic 0.7 --common-options 0.15
+//           --tags 0.8
+//
+// An --out path ending in '/' writes a segmented bank directory instead.
+//
+// The same arguments always produce byte-identical output: only
+// std::mt19937_64 (whose sequence is fixed by the standard) is used, and all
+// distributions are implemented here rather than taken from <random>.
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "logic/quiz.h"
+
+namespace {
+
+struct Options {
+    std::string outPath;
+    std::uint64_t seed = 1;
+    int questions = 10000;
+    int topics = 25;
+    double zipf = 1.0;
+    std::vector<std::pair<int, double>> optionCounts = {{0, 10}, {3, 20}, {4, 60}, {5, 10}};
+    int textWordsMin = 6;
+    int textWordsMax = 24;
+    int optionWordsMin = 1;
+    int optionWordsMax = 6;
+    double cyrillic = 0.7;
+    double commonOptions = 0.15;
+    // Chance of each of the difficulty/chapter/author tags being attached.
+    double tags = 0.0;
+};
+
+const char* kAsciiWords[] = {
+    "algorithm", "array", "binary", "cache", "compiler", "data", "energy", "force",
+    "function", "graph", "history", "integral", "kernel", "language", "matrix", "memory",
+    "network", "object", "pointer", "process", "protocol", "queue", "reaction", "server",
+    "signal", "stack", "system", "theorem", "thread", "value", "vector", "velocity",
+    "what", "which", "when", "how", "the", "of", "in", "is", "a", "for", "and", "with"
+};
+
+const char* kCyrillicWords[] = {
+    "алгоритм", "вопрос", "год", "государство", "движение", "закон", "значение", "история",
+    "каком", "какой", "какая", "когда", "масса", "множество", "начало", "область",
+    "память", "период", "процесс", "реакция", "решение", "система", "скорость", "событие",
+    "сила", "страна", "теорема", "уравнение", "функция", "число", "энергия", "является",
+    "в", "и", "на", "с", "по", "для", "это", "что", "из", "при", "как", "был"
+};
+
+const char* kCommonOptions[] = {
+    "True", "False", "Да", "Нет", "None of the above", "Все перечисленное",
+    "Ни один из вариантов", "0", "1", "2", "10", "100"
+};
+
+const char* kDifficulties[] = {"easy", "medium", "hard"};
+
+const char* kAuthors[] = {"ivanova", "petrov", "smith", "kim", "garcia"};
+
+template <typename T, std::size_t N>
+constexpr std::size_t countOf(T (&)[N]) { return N; }
+
+class Generator {
+public:
+    explicit Generator(std::uint64_t seed) : engine(seed) {}
+
+    double uniform() {
+        return static_cast<double>(engine() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    std::uint64_t below(std::uint64_t bound) {
+        return static_cast<std::uint64_t>(uniform() * static_cast<double>(bound));
+    }
+
+    int between(int lo, int hi) {
+        return lo + static_cast<int>(below(static_cast<std::uint64_t>(hi - lo + 1)));
+    }
+
+private:
+    std::mt19937_64 engine;
+};
+
+// Inverse-CDF sampling over a small discrete weight table.
+class DiscreteTable {
+public:
+    explicit DiscreteTable(const std::vector<double>& weights) {
+        double total = 0;
+        for (double w : weights) {
+            total += w;
+            cumulative.push_back(total);
+        }
+        for (double& c : cumulative) {
+            c /= total;
+        }
+    }
+
+    std::size_t sample(Generator& gen) const {
+        double u = gen.uniform();
+        std::size_t lo = 0;
+        std::size_t hi = cumulative.size() - 1;
+        while (lo < hi) {
+            std::size_t mid = (lo + hi) / 2;
+            if (cumulative[mid] < u) lo = mid + 1; else hi = mid;
+        }
+        return lo;
+    }
+
+private:
+    std::vector<double> cumulative;
+};
+
+bool parseRange(const std::string& value, int& lo, int& hi) {
+    auto colon = value.find(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    lo = std::stoi(value.substr(0, colon));
+    hi = std::stoi(value.substr(colon + 1));
+    return lo >= 0 && hi >= lo;
+}
+
+bool parseOptionCounts(const std::string& value, std::vector<std::pair<int, double>>& out) {
+    out.clear();
+    std::istringstream in(value);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        auto colon = item.find(':');
+        if (colon == std::string::npos) {
+            return false;
+        }
+        out.emplace_back(std::stoi(item.substr(0, colon)), std::stod(item.substr(colon + 1)));
+    }
+    return !out.empty();
+}
+
+void printUsage() {
+    std::cerr << "Usage: bankgen --out FILE|DIR/ [--seed N] [--questions N] [--topics N] [--zipf S]\n"
+              << "               [--options COUNT:WEIGHT,...] [--text-words MIN:MAX]\n"
+              << "               [--option-words MIN:MAX] [--cyrillic RATIO] [--common-options RATIO]\n"
+              << "               [--tags RATIO]\n";
+}
+
+bool parseArgs(int argc, char* argv[], Options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--out") {
+            opts.outPath = value;
+        } else if (arg == "--seed") {
+            opts.seed = std::stoull(value);
+        } else if (arg == "--questions") {
+            opts.questions = std::stoi(value);
+        } else if (arg == "--topics") {
+            opts.topics = std::stoi(value);
+        } else if (arg == "--zipf") {
+            opts.zipf = std::stod(value);
+        } else if (arg == "--options") {
+            if (!parseOptionCounts(value, opts.optionCounts)) return false;
+        } else if (arg == "--text-words") {
+            if (!parseRange(value, opts.textWordsMin, opts.textWordsMax)) return false;
+        } else if (arg == "--option-words") {
+            if (!parseRange(value, opts.optionWordsMin, opts.optionWordsMax)) return false;
+        } else if (arg == "--cyrillic") {
+            opts.cyrillic = std::stod(value);
+        } else if (arg == "--common-options") {
+            opts.commonOptions = std::stod(value);
+        } else if (arg == "--tags") {
+            opts.tags = std::stod(value);
+        } else {
+            return false;
+        }
+    }
+    return !opts.outPath.empty() && opts.questions >= 0 && opts.topics > 0;
+}
+
+std::string makeText(Generator& gen, int words, double cyrillic) {
+    std::string text;
+    for (int i = 0; i < words; ++i) {
+        if (i > 0) text += ' ';
+        if (gen.uniform() < cyrillic) {
+            text += kCyrillicWords[gen.below(countOf(kCyrillicWords))];
+        } else {
+            text += kAsciiWords[gen.below(countOf(kAsciiWords))];
+        }
+    }
+    return text;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    try {
+        if (!parseArgs(argc, argv, opts)) {
+            printUsage();
+            return 1;
+        }
+    } catch (const std::exception&) {
+        printUsage();
+        return 1;
+    }
+
+    Generator gen(opts.seed);
+
+    std::vector<std::shared_ptr<Topic>> topics;
+    std::vector<double> topicWeights;
+    for (int t = 0; t < opts.topics; ++t) {
+        topics.push_back(makeCounted<MemorySubsystem::Topics, Topic>(
+            "Тема " + std::to_string(t + 1) + " " + makeText(gen, 2, opts.cyrillic)));
+        topicWeights.push_back(1.0 / std::pow(t + 1, opts.zipf));
+    }
+    DiscreteTable topicTable(topicWeights);
+
+    std::vector<double> optionWeights;
+    for (const auto& entry : opts.optionCounts) {
+        optionWeights.push_back(entry.second);
+    }
+    DiscreteTable optionTable(optionWeights);
+
+    QuestionDatabase db;
+    db.questions.reserve(opts.questions);
+    for (int q = 0; q < opts.questions; ++q) {
+        auto topic = topics[topicTable.sample(gen)];
+        std::string text = std::to_string(q + 1) + ". " +
+            makeText(gen, gen.between(opts.textWordsMin, opts.textWordsMax), opts.cyrillic) + "?";
+
+        int optionCount = opts.optionCounts[optionTable.sample(gen)].first;
+        std::optional<std::vector<std::string>> options;
+        int correctIndex = -1;
+        if (optionCount > 0) {
+            options = std::vector<std::string>();
+            for (int o = 0; o < optionCount; ++o) {
+                if (gen.uniform() < opts.commonOptions) {
+                    options->push_back(kCommonOptions[gen.below(countOf(kCommonOptions))]);
+                } else {
+                    options->push_back(makeText(gen, gen.between(opts.optionWordsMin, opts.optionWordsMax), opts.cyrillic));
+                }
+            }
+            correctIndex = static_cast<int>(gen.below(optionCount));
+        }
+        auto question = makeCounted<MemorySubsystem::Questions, Question>(text, optionCount > 0 ? 1 : 0, options, correctIndex, topic);
+        // Only draw when tags are requested so older banks stay byte-identical.
+        if (opts.tags > 0) {
+            if (gen.uniform() < opts.tags) {
+                question->tags.push_back(std::string("difficulty:") + kDifficulties[gen.below(countOf(kDifficulties))]);
+            }
+            if (gen.uniform() < opts.tags) {
+                question->tags.push_back("chapter:" + std::to_string(gen.between(1, 12)));
+            }
+            if (gen.uniform() < opts.tags) {
+                question->tags.push_back(std::string("author:") + kAuthors[gen.below(countOf(kAuthors))]);
+            }
+        }
+        db.addQuestion(question);
+    }
+
+    try {
+        db.saveBank(opts.outPath);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << opts.questions << " questions in " << opts.topics
+              << " topics to " << opts.outPath << " (seed " << opts.seed << ")" << std::endl;
+    return 0;
+}
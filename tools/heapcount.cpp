@@ -0,0 +1,84 @@
+// Replaces the whole family of global allocation functions, so that every
+// form of new is counted and every form of delete frees what its matching
+// new allocated. Kept out of the benchmark's own translation unit so that
+// the replacements are not inlined into their callers.
+#include "heapcount.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<std::uint64_t> heapAllocations{0};
+
+std::uint64_t heapAllocationCount() {
+    return heapAllocations.load(std::memory_order_relaxed);
+}
+
+static void* allocate(std::size_t size) noexcept {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+static void* allocateAligned(std::size_t size, std::align_val_t alignment) noexcept {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    std::size_t align = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, align);
+#else
+    // aligned_alloc wants a size that is a multiple of the alignment.
+    std::size_t rounded = ((size ? size : 1) + align - 1) / align * align;
+    return std::aligned_alloc(align, rounded);
+#endif
+}
+
+static void release(void* block) noexcept {
+    std::free(block);
+}
+
+static void releaseAligned(void* block) noexcept {
+#ifdef _WIN32
+    _aligned_free(block);
+#else
+    std::free(block);
+#endif
+}
+
+static void* allocateOrThrow(std::size_t size) {
+    if (void* block = allocate(size)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+static void* allocateAlignedOrThrow(std::size_t size, std::align_val_t alignment) {
+    if (void* block = allocateAligned(size, alignment)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size) { return allocateOrThrow(size); }
+void* operator new[](std::size_t size) { return allocateOrThrow(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocateAlignedOrThrow(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocateAlignedOrThrow(size, alignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocateAligned(size, alignment);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void* block) noexcept { release(block); }
+void operator delete[](void* block) noexcept { release(block); }
+void operator delete(void* block, std::size_t) noexcept { release(block); }
+void operator delete[](void* block, std::size_t) noexcept { release(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { release(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { release(block); }
+void operator delete(void* block, std::align_val_t) noexcept { releaseAligned(block); }
+void operator delete[](void* block, std::align_val_t) noexcept { releaseAligned(block); }
+void operator delete(void* block, std::size_t, std::align_val_t) noexcept { releaseAligned(block); }
+void operator delete[](void* block, std::size_t, std::align_val_t) noexcept { releaseAligned(block); }
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept { releaseAligned(block); }
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept { releaseAligned(block); }
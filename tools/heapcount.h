@@ -0,0 +1,6 @@
+#pragma once
+#include <cstdint>
+
+// Number of heap allocations made through any form of operator new so far,
+// counted by the replacement operators in heapcount.cpp.
+std::uint64_t heapAllocationCount();
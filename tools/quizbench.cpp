@@ -0,0 +1,327 @@
+// End-to-end load -> generate -> render benchmark over a bank file or
+// segmented bank directory, typically one produced by bankgen. With the same bank and arguments the work done is
+// identical between runs, so timings are comparable across builds.
+//
+//   quizbench BANK [--variants N] [--per-topic K] [--topics M] [--seed S] [--out DIR] [--weighted]
+//             [--filter TAGS] [--compact] [--gzip] [--formats] [--pipeline] [--overlap]
+//
+// --formats renders the batch once more in each output format and reports
+// the bytes and time each one takes. --pipeline runs the same batch through
+// the sample -> render -> write pipeline and prints its stage counters.
+// --overlap compares every pair of variants in the batch (see analyzeOverlap).
+//
+// Every run also renders the batch twice more in memory and fails if the
+// second pass, with the render buffer already grown, allocates at all.
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "logic/docwriter.h"
+#include "logic/memory.h"
+#include "logic/overlap.h"
+#include "logic/pipeline.h"
+#include "logic/quiz.h"
+#include "logic/stats.h"
+#include "logic/sampler.h"
+#include "heapcount.h"
+
+namespace {
+
+struct Options {
+    std::string bankPath;
+    std::string outDir;
+    std::string filter;
+    int variants = 100;
+    int perTopic = 5;
+    int topics = 3;
+    std::uint64_t seed = 1;
+    bool weighted = false;
+    bool compact = false;
+    bool gzip = false;
+    bool compareFormats = false;
+    bool pipeline = false;
+    bool overlap = false;
+};
+
+struct BatchResult {
+    double millis = 0;
+    std::uintmax_t bytesWritten = 0;
+    // What a reader downloads: the .gz copy where one was written.
+    std::uintmax_t bytesShipped = 0;
+};
+
+double millisSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool parseArgs(int argc, char* argv[], Options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            opts.bankPath = arg;
+            continue;
+        }
+        if (arg == "--weighted" || arg == "--compact" || arg == "--gzip" || arg == "--formats" || arg == "--pipeline" ||
+            arg == "--overlap") {
+            opts.weighted = opts.weighted || arg == "--weighted";
+            opts.compact = opts.compact || arg == "--compact";
+            opts.gzip = opts.gzip || arg == "--gzip";
+            opts.compareFormats = opts.compareFormats || arg == "--formats";
+            opts.pipeline = opts.pipeline || arg == "--pipeline";
+            opts.overlap = opts.overlap || arg == "--overlap";
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--variants") {
+            opts.variants = std::stoi(value);
+        } else if (arg == "--per-topic") {
+            opts.perTopic = std::stoi(value);
+        } else if (arg == "--topics") {
+            opts.topics = std::stoi(value);
+        } else if (arg == "--seed") {
+            opts.seed = std::stoull(value);
+        } else if (arg == "--out") {
+            opts.outDir = value;
+        } else if (arg == "--filter") {
+            opts.filter = value;
+        } else {
+            return false;
+        }
+    }
+    return !opts.bankPath.empty() && opts.variants > 0 && opts.perTopic > 0 && opts.topics > 0;
+}
+
+void addOutputSizes(const std::filesystem::path& path, BatchResult& result) {
+    std::uintmax_t size = std::filesystem::file_size(path);
+    std::filesystem::path gzipPath = path;
+    gzipPath += ".gz";
+    std::error_code missing;
+    std::uintmax_t gzipSize = std::filesystem::file_size(gzipPath, missing);
+    result.bytesWritten += size + (missing ? 0 : gzipSize);
+    result.bytesShipped += missing ? size : gzipSize;
+}
+
+// Writes every variant (and, for compact output, the shared stylesheet) to
+// `dir`, timing the whole batch. Throws on the first failure.
+BatchResult renderBatch(const QuestionDatabase& db, const std::vector<std::shared_ptr<QuizVariant>>& variants,
+                        const std::string& dir, const DocumentOptions& documentOptions) {
+    std::filesystem::create_directories(dir);
+    BatchResult result;
+    // DocumentWriter reports every file on stdout; keep that out of the timing.
+    std::ostringstream sink;
+    auto* previous = std::cout.rdbuf(sink.rdbuf());
+    auto start = std::chrono::steady_clock::now();
+    try {
+        if (documentOptions.compact && !DocumentWriter(documentOptions).writeStylesheet(dir)) {
+            throw std::runtime_error("Failed to write the stylesheet to " + dir);
+        }
+        for (std::size_t i = 0; i < variants.size(); ++i) {
+            auto path = std::filesystem::path(dir) / ("variant_" + std::to_string(i + 1) + ".html");
+            db.writeExamToDoc(path.string(), variants[i], documentOptions);
+        }
+        result.millis = millisSince(start);
+    } catch (...) {
+        std::cout.rdbuf(previous);
+        throw;
+    }
+    std::cout.rdbuf(previous);
+    if (documentOptions.compact) {
+        addOutputSizes(std::filesystem::path(dir) / DocumentWriter::stylesheetName(), result);
+    }
+    for (std::size_t i = 0; i < variants.size(); ++i) {
+        addOutputSizes(std::filesystem::path(dir) / ("variant_" + std::to_string(i + 1) + ".html"), result);
+    }
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    try {
+        if (!parseArgs(argc, argv, opts)) {
+            std::cerr << "Usage: quizbench BANK [--variants N] [--per-topic K] [--topics M] [--seed S] [--out DIR] [--weighted]\n"
+                      << "                 [--filter TAGS] [--compact] [--gzip] [--formats] [--pipeline] [--overlap]\n";
+            return 1;
+        }
+    } catch (const std::exception&) {
+        std::cerr << "Invalid arguments\n";
+        return 1;
+    }
+    if (opts.outDir.empty()) {
+        opts.outDir = (std::filesystem::temp_directory_path() / "quizbench").string();
+    }
+    std::filesystem::create_directories(opts.outDir);
+
+    QuestionDatabase db;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        db.openBank(opts.bankPath);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    double loadMs = millisSince(start);
+
+    // Use the largest topics so the spec does not depend on topic naming.
+    std::vector<std::pair<std::size_t, std::shared_ptr<Topic>>> bySize;
+    for (const auto& topic : db.topics) {
+        bySize.emplace_back(db.topicQuestionCount(topic), topic);
+    }
+    std::stable_sort(bySize.begin(), bySize.end(), [](const auto& a, const auto& b) {
+        return a.first > b.first;
+    });
+    std::vector<QuestionQuota> spec;
+    for (int t = 0; t < opts.topics && t < static_cast<int>(bySize.size()); ++t) {
+        spec.emplace_back(bySize[t].second, opts.perTopic, opts.filter);
+    }
+
+    if (!opts.filter.empty()) {
+        start = std::chrono::steady_clock::now();
+        std::size_t matching = 0;
+        try {
+            matching = db.tagIndex().evaluate(opts.filter).cardinality();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        double filterMs = millisSince(start);
+        std::cout << "filter:    '" << opts.filter << "' matches " << matching << " questions in "
+                  << std::fixed << std::setprecision(3) << filterMs << " ms\n";
+    }
+
+    RngService rng(opts.seed);
+    ExposureSampler sampler(db);
+    std::vector<std::shared_ptr<QuizVariant>> variants;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < opts.variants; ++i) {
+        variants.push_back(db.generateVariant("Вариант " + std::to_string(i + 1), spec, false, rng, i + 1,
+                                              opts.weighted ? &sampler : nullptr));
+        db.recordUsage(*variants.back());
+    }
+    double generateMs = millisSince(start);
+
+    if (opts.gzip && !DocumentWriter::gzipAvailable()) {
+        std::cerr << "Built without zlib: --gzip is ignored\n";
+    }
+    DocumentOptions documentOptions;
+    documentOptions.compact = opts.compact;
+    documentOptions.gzip = opts.gzip;
+    BatchResult rendered;
+    try {
+        rendered = renderBatch(db, variants, opts.outDir, documentOptions);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "bank:      " << opts.bankPath << " (" << db.getQuestionCount() << " questions, "
+              << db.topics.size() << " topics)\n"
+              << "options:   " << StringPool::global().size() << " distinct texts, "
+              << StringPool::global().memoryBytes() << " bytes pooled\n"
+              << "load:      " << loadMs << " ms\n"
+              << "segments:  " << db.segmentsRead() << " read\n"
+              << "generate:  " << generateMs << " ms for " << opts.variants << " variants\n"
+              << "render:    " << rendered.millis << " ms, " << rendered.bytesWritten << " bytes written to " << opts.outDir << "\n";
+
+    // The first pass grows this thread's render buffer to the largest
+    // document; the second must then run without touching the heap.
+    DocumentWriter memoryWriter(documentOptions);
+    std::uint64_t steadyAllocations = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        std::uint64_t before = heapAllocationCount();
+        for (const auto& variant : variants) {
+            memoryWriter.renderHtml(*variant);
+        }
+        steadyAllocations = heapAllocationCount() - before;
+    }
+    std::cout << "steady:    " << steadyAllocations << " heap allocations re-rendering " << variants.size() << " variants\n\n";
+    if (steadyAllocations != 0) {
+        std::cerr << "Steady-state rendering allocated " << steadyAllocations << " times" << std::endl;
+        return 1;
+    }
+
+    if (opts.compareFormats) {
+        struct Format {
+            const char* name;
+            bool compact;
+            bool gzip;
+        };
+        std::vector<Format> formats = {{"standalone", false, false}, {"compact", true, false}};
+        if (DocumentWriter::gzipAvailable()) {
+            formats.push_back({"compact+gzip", true, true});
+        }
+        std::cout << std::left << std::setw(14) << "format" << std::right << std::setw(14) << "written"
+                  << std::setw(14) << "shipped" << std::setw(12) << "ms" << std::setw(10) << "saved" << "\n";
+        BatchResult baseline;
+        for (const auto& format : formats) {
+            DocumentOptions formatOptions;
+            formatOptions.compact = format.compact;
+            formatOptions.gzip = format.gzip;
+            BatchResult result;
+            try {
+                result = renderBatch(db, variants, (std::filesystem::path(opts.outDir) / format.name).string(), formatOptions);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+            if (!format.compact) {
+                baseline = result;
+            }
+            double saved = baseline.bytesShipped ? 100.0 * (1.0 - double(result.bytesShipped) / double(baseline.bytesShipped)) : 0.0;
+            std::cout << std::left << std::setw(14) << format.name << std::right << std::setw(14) << result.bytesWritten
+                      << std::setw(14) << result.bytesShipped << std::setw(12) << result.millis
+                      << std::setw(9) << saved << "%\n";
+        }
+        std::cout << "\n";
+    }
+    if (opts.pipeline) {
+        PipelineOptions pipelineOptions;
+        pipelineOptions.weighted = opts.weighted;
+        pipelineOptions.document = documentOptions;
+        std::filesystem::path dir = std::filesystem::path(opts.outDir) / "pipeline";
+        std::filesystem::create_directories(dir);
+        if (documentOptions.compact && !DocumentWriter(documentOptions).writeStylesheet(dir.string())) {
+            std::cerr << "Failed to write the stylesheet to " << dir.string() << std::endl;
+            return 1;
+        }
+        PipelineReport report;
+        try {
+            report = runVariantPipeline(db, spec, rng, opts.variants, [&dir](std::size_t index) {
+                return (dir / ("variant_" + std::to_string(index + 1) + ".html")).string();
+            }, pipelineOptions);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "lockstep:  " << generateMs + rendered.millis << " ms to generate and render\n"
+                  << "pipeline:  ";
+        report.dump(std::cout);
+        std::cout << "\n";
+    }
+    if (opts.overlap) {
+        std::vector<std::vector<QuestionId>> questionIds;
+        for (const auto& variant : variants) {
+            questionIds.emplace_back();
+            for (const auto& question : variant->questions) {
+                questionIds.back().push_back(question->id);
+            }
+        }
+        std::cout << "overlap:   ";
+        analyzeOverlap(questionIds).dump(std::cout);
+        std::cout << "\n";
+    }
+    PerfStats::instance().dump(std::cout);
+    std::cout << "\n";
+    MemoryStats::instance().dump(std::cout);
+    return 0;
+}
@@ -0,0 +1,241 @@
+// Client for the generation daemon (MadExamCli --serve SOCKET).
+//
+//   quizclient SOCKET [--seed S] [--stream K] [--variants N] [--html] [--shuffle]
+//              [--out DIR] [--key] [--reload] [--bench N] [--clients C] QUOTA...
+//
+// Each QUOTA is COUNT:TOPIC[@FILTER], with TOPIC "*" for any topic. Variants
+// are printed (ids) or written to DIR (--html); --key prints the answer key
+// of variant K. --bench sends N single-variant requests over C connections
+// and reports the round-trip latency percentiles.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "logic/daemon.h"
+
+namespace {
+
+struct Options {
+    std::string socketPath;
+    std::string outDir;
+    std::vector<std::string> quotas;
+    std::uint64_t seed = 1;
+    std::uint64_t stream = 1;
+    int variants = 1;
+    int benchRequests = 0;
+    int clients = 1;
+    bool html = false;
+    bool shuffle = false;
+    bool key = false;
+    bool reload = false;
+};
+
+bool parseArgs(int argc, char* argv[], Options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            if (opts.socketPath.empty()) {
+                opts.socketPath = arg;
+            } else {
+                opts.quotas.push_back(arg);
+            }
+            continue;
+        }
+        if (arg == "--html" || arg == "--shuffle" || arg == "--key" || arg == "--reload") {
+            opts.html = opts.html || arg == "--html";
+            opts.shuffle = opts.shuffle || arg == "--shuffle";
+            opts.key = opts.key || arg == "--key";
+            opts.reload = opts.reload || arg == "--reload";
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--seed") {
+            opts.seed = std::stoull(value);
+        } else if (arg == "--stream") {
+            opts.stream = std::stoull(value);
+        } else if (arg == "--variants") {
+            opts.variants = std::stoi(value);
+        } else if (arg == "--bench") {
+            opts.benchRequests = std::stoi(value);
+        } else if (arg == "--clients") {
+            opts.clients = std::stoi(value);
+        } else if (arg == "--out") {
+            opts.outDir = value;
+        } else {
+            return false;
+        }
+    }
+    return !opts.socketPath.empty() && opts.variants > 0 && opts.clients > 0 && (opts.reload || !opts.quotas.empty());
+}
+
+// COUNT:TOPIC[@FILTER] -> TOPIC<TAB>COUNT<TAB>FILTER
+std::string specText(const std::vector<std::string>& quotas) {
+    std::string spec;
+    for (const auto& quota : quotas) {
+        std::size_t colon = quota.find(':');
+        if (colon == std::string::npos) {
+            throw std::runtime_error("Quota must be COUNT:TOPIC[@FILTER]: " + quota);
+        }
+        std::string topic = quota.substr(colon + 1);
+        std::string filter;
+        std::size_t at = topic.rfind('@');
+        if (at != std::string::npos) {
+            filter = topic.substr(at + 1);
+            topic.erase(at);
+        }
+        spec += topic + '\t' + quota.substr(0, colon) + '\t' + filter + '\n';
+    }
+    return spec;
+}
+
+int connectTo(const std::string& socketPath) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path is too long: " + socketPath);
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Could not connect to " + socketPath);
+    }
+    return fd;
+}
+
+// Sends one request; returns the reply items or throws with the daemon's error.
+std::vector<std::string> request(int fd, const std::string& payload) {
+    std::string status;
+    if (!writeFrame(fd, payload) || !readFrame(fd, status)) {
+        throw std::runtime_error("Connection to the daemon was lost");
+    }
+    if (status.rfind("ok ", 0) != 0) {
+        throw std::runtime_error(status);
+    }
+    std::vector<std::string> items(std::stoul(status.substr(3)));
+    for (auto& item : items) {
+        if (!readFrame(fd, item)) {
+            throw std::runtime_error("Connection to the daemon was lost");
+        }
+    }
+    return items;
+}
+
+int runBench(const Options& opts, const std::string& spec) {
+    std::vector<std::vector<double>> latencies(opts.clients);
+    std::atomic<int> next{0};
+    std::atomic<bool> failed{false};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < opts.clients; ++c) {
+        threads.emplace_back([&, c]() {
+            try {
+                int fd = connectTo(opts.socketPath);
+                for (int i = next++; i < opts.benchRequests && !failed; i = next++) {
+                    std::string payload = "generate " + std::to_string(opts.seed) + " " + std::to_string(opts.stream + i) +
+                                          " 1 " + (opts.html ? "html" : "ids") + (opts.shuffle ? " shuffle" : "") + "\n" + spec;
+                    auto sent = std::chrono::steady_clock::now();
+                    request(fd, payload);
+                    latencies[c].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent).count());
+                }
+                close(fd);
+            } catch (const std::exception& e) {
+                if (!failed.exchange(true)) {
+                    std::cerr << e.what() << std::endl;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (failed) {
+        return 1;
+    }
+    std::vector<double> all;
+    for (const auto& samples : latencies) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto at = [&all](double p) { return all[std::min(all.size() - 1, static_cast<std::size_t>(p * all.size()))]; };
+    std::cout << std::fixed << std::setprecision(1)
+              << all.size() << " requests from " << opts.clients << " clients in " << totalMs << " ms ("
+              << (all.size() * 1000.0 / totalMs) << " req/s)\n"
+              << "latency us: p50 " << at(0.50) << "  p90 " << at(0.90) << "  p99 " << at(0.99)
+              << "  max " << all.back() << "\n";
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    try {
+        if (!parseArgs(argc, argv, opts)) {
+            std::cerr << "Usage: quizclient SOCKET [--seed S] [--stream K] [--variants N] [--html] [--shuffle]\n"
+                      << "                  [--out DIR] [--key] [--reload] [--bench N] [--clients C] COUNT:TOPIC[@FILTER]...\n";
+            return 1;
+        }
+    } catch (const std::exception&) {
+        std::cerr << "Invalid arguments\n";
+        return 1;
+    }
+
+    try {
+        std::string spec = specText(opts.quotas);
+        if (opts.benchRequests > 0) {
+            return runBench(opts, spec);
+        }
+        int fd = connectTo(opts.socketPath);
+        std::string seedAndStream = std::to_string(opts.seed) + " " + std::to_string(opts.stream);
+        std::string flags = opts.shuffle ? " shuffle" : "";
+        std::vector<std::string> items;
+        if (opts.reload) {
+            items = request(fd, "reload\n");
+        } else if (opts.key) {
+            items = request(fd, "key " + seedAndStream + flags + "\n" + spec);
+        } else {
+            items = request(fd, "generate " + seedAndStream + " " + std::to_string(opts.variants) + " " +
+                                    (opts.html ? "html" : "ids") + flags + "\n" + spec);
+        }
+        close(fd);
+
+        if (opts.html && !opts.key && !opts.reload) {
+            std::filesystem::path dir = opts.outDir.empty() ? std::filesystem::path(".") : std::filesystem::path(opts.outDir);
+            std::filesystem::create_directories(dir);
+            for (std::size_t i = 0; i < items.size(); ++i) {
+                auto path = dir / ("variant_" + std::to_string(opts.stream + i) + ".html");
+                std::ofstream out(path, std::ios::binary);
+                out << items[i];
+                if (!out) {
+                    throw std::runtime_error("Failed to write " + path.string());
+                }
+                std::cout << path.string() << "\n";
+            }
+        } else {
+            for (const auto& item : items) {
+                std::cout << item << (item.empty() || item.back() != '\n' ? "\n" : "");
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}